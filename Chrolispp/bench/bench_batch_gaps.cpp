@@ -0,0 +1,191 @@
+/*
+Runs a synthetic protocol on the SimulatedDevice and compares the recorded LED
+timeline with the timeline the protocol asks for. Reports the error of every
+on edge (relative to the first on edge) and of every dark gap between
+consecutive pulses, which is where batch boundaries show up. The planner uses a cost model
+calibrated on the simulator (stored and read back from a file); the batch
+starts it predicts to be late are compared with the measured ones (batches
+started by trigger points have no measured start of their own). The batch
+programs are written to bench_batch_gaps_programs.txt. Exits with 1 if not
+every planned pulse is emitted (run by ctest with a few repetitions).
+Usage: bench_batch_gaps [repetitions] [call_latency_us] [greedy|optimal]
+                        [host|trigger] [initial_break_ms]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+#include "constants.hpp"
+
+namespace {
+struct Pulse {
+  long long on_us;
+  long long off_us;
+};
+
+std::vector<ProtocolStep> makeProtocol(int repetitions,
+                                       ViUInt32 initial_break_ms) {
+  std::vector<ProtocolStep> steps;
+  uint32_t step_id = 1;
+  steps.emplace_back(step_id++, 0, 0, initial_break_ms, 1, 0, false);
+  for (int i = 0; i < repetitions; i++) {
+    steps.emplace_back(step_id++, 0, 5, 5, 2, 500, false);
+    steps.emplace_back(step_id++, 1, 5, 5, 1, 500, false);
+    steps.emplace_back(step_id++, 0, 0, 40, 1, 0, false);
+  }
+  return steps;
+}
+
+std::vector<Pulse> plannedPulses(const std::vector<ProtocolStep>& steps) {
+  std::vector<Pulse> pulses;
+  long long t_us = 0;
+  for (const auto& step : steps) {
+    if (!step.isBreak()) {
+      long long period_us =
+          static_cast<long long>(step.pulse_width_us) +
+          step.time_between_pulses_us;
+      for (ViUInt32 k = 0; k < step.n_pulses; k++) {
+        long long on_us = t_us + k * period_us;
+        pulses.push_back({on_us, on_us + step.pulse_width_us});
+      }
+    }
+    t_us += step.getTotalDurationUs();
+  }
+  return pulses;
+}
+
+std::vector<Pulse> actualPulses(const std::vector<LedEdge>& edges) {
+  std::vector<Pulse> pulses;
+  long long on_since[6] = {-1, -1, -1, -1, -1, -1};
+  for (const auto& edge : edges) {
+    long long t_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(edge.time)
+            .count();
+    if (edge.on) {
+      on_since[edge.led_index] = t_us;
+    } else if (on_since[edge.led_index] >= 0) {
+      pulses.push_back({on_since[edge.led_index], t_us});
+      on_since[edge.led_index] = -1;
+    }
+  }
+  std::sort(pulses.begin(), pulses.end(),
+            [](const Pulse& a, const Pulse& b) { return a.on_us < b.on_us; });
+  return pulses;
+}
+
+void printStats(const char* name, std::vector<long long> values) {
+  if (values.empty()) {
+    std::printf("%-22s n/a\n", name);
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  long long sum = 0;
+  for (long long v : values) {
+    sum += v;
+  }
+  auto percentile = [&values](double p) {
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+  };
+  std::printf("%-22s min %8lld  p50 %8lld  p99 %8lld  max %8lld  mean %8lld us\n",
+              name, values.front(), percentile(0.5), percentile(0.99),
+              values.back(), sum / static_cast<long long>(values.size()));
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int repetitions = argc > 1 ? std::atoi(argv[1]) : 20;
+  int call_latency_us = argc > 2 ? std::atoi(argv[2]) : -1;
+  BatchPlanning planning = argc > 3 && std::string_view(argv[3]) == "optimal"
+                               ? BatchPlanning::Optimal
+                               : BatchPlanning::Greedy;
+  BatchExecution execution = argc > 4 && std::string_view(argv[4]) == "trigger"
+                                 ? BatchExecution::HardwareTrigger
+                                 : BatchExecution::Host;
+  ViUInt32 initial_break_ms =
+      argc > 5 ? static_cast<ViUInt32>(std::atoi(argv[5])) : 10;
+
+  SimulatedDevice::Latencies latencies;
+  if (call_latency_us >= 0) {
+    latencies.per_call.fill(std::chrono::microseconds(call_latency_us));
+  }
+  SimulatedDevice device(latencies);
+  Logger logger("bench_batch_gaps.log");
+  calibrateBatchCostModel(device).save("bench_batch_gaps_cost_model.txt");
+  BatchCostModel cost_model =
+      BatchCostModel::load("bench_batch_gaps_cost_model.txt");
+  ProtocolPlanner planner(&device,
+                          makeProtocol(repetitions, initial_break_ms), &logger,
+                          nullptr, planning, cost_model, execution);
+  std::printf("%s", planner.summarizePredictedLateStarts().c_str());
+  planner.writeBatchPrograms("bench_batch_gaps_programs.txt");
+  std::vector<Pulse> planned = plannedPulses(planner.getSteps());
+
+  planner.setUpDevice();
+  device.resetHistory();
+  planner.executeProtocol();
+  planner.writeTelemetryCsv("bench_batch_gaps_telemetry.csv");
+  std::vector<Pulse> actual = actualPulses(device.getLedTimeline());
+
+  // Telemetry records of the batch starts by the host, by planned start
+  std::map<long long, const BatchTelemetry*> telemetry_by_start;
+  for (const auto& record : planner.getTelemetry()) {
+    telemetry_by_start[record.planned_start_us.count()] = &record;
+  }
+  size_t n_predicted_late = 0;
+  size_t n_measured_late = 0;
+  size_t n_agreeing = 0;
+  size_t n_host_starts = 0;
+  for (const auto& boundary : planner.getBatchPartition().boundaries) {
+    auto found = telemetry_by_start.find(boundary.planned_start_us.count());
+    if (found == telemetry_by_start.end()) {
+      continue;  // started by a trigger point
+    }
+    bool predicted_late = boundary.getPredictedLatenessUs().count() > 0;
+    bool measured_late = found->second->getLatenessUs().count() >
+                         Constants::LATE_START_TOLERANCE_US;
+    n_predicted_late += predicted_late;
+    n_measured_late += measured_late;
+    n_agreeing += predicted_late == measured_late;
+    n_host_starts++;
+  }
+  std::printf(
+      "late batch starts: %zu predicted, %zu measured, prediction right for "
+      "%zu of %zu host starts (%zu batches)\n",
+      n_predicted_late, n_measured_late, n_agreeing, n_host_starts,
+      planner.getBatchPartition().boundaries.size());
+
+  std::printf("planned pulses: %zu, emitted pulses: %zu\n", planned.size(),
+              actual.size());
+  size_t n = std::min(planned.size(), actual.size());
+  if (n == 0) {
+    return 1;
+  }
+  std::vector<long long> on_errors;
+  std::vector<long long> width_errors;
+  std::vector<long long> gap_errors;
+  for (size_t k = 0; k < n; k++) {
+    long long planned_on = planned[k].on_us - planned[0].on_us;
+    long long actual_on = actual[k].on_us - actual[0].on_us;
+    on_errors.push_back(actual_on - planned_on);
+    width_errors.push_back((actual[k].off_us - actual[k].on_us) -
+                           (planned[k].off_us - planned[k].on_us));
+    if (k > 0) {
+      gap_errors.push_back((actual[k].on_us - actual[k - 1].off_us) -
+                           (planned[k].on_us - planned[k - 1].off_us));
+    }
+  }
+  printStats("on edge error", on_errors);
+  printStats("pulse width error", width_errors);
+  printStats("dark gap error", gap_errors);
+  std::printf("drift at last pulse: %lld us\n", on_errors.back());
+  return planned.size() == actual.size() ? 0 : 1;
+}
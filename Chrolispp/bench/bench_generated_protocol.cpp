@@ -0,0 +1,130 @@
+/*
+A generated protocol made into batches on demand (BatchGenerator): the heap
+it takes at most while generating all batches of a long protocol, against the
+heap the ProtocolPlanner keeps for the same steps planned up front, and the
+last batch id (beyond the 65535 of 16-bit ids). Then a short generated
+protocol is executed on the SimulatedDevice.
+Usage: bench_generated_protocol [steps] [executed_steps]
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <vector>
+
+#include "BatchGenerator.hpp"
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+size_t live_bytes = 0;
+size_t peak_bytes = 0;
+
+// Every allocation is preceded by its size
+constexpr size_t HEADER_BYTES = alignof(std::max_align_t);
+
+void* allocate(size_t size) {
+  void* block = std::malloc(size + HEADER_BYTES);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(block) = size;
+  live_bytes += size;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+  return static_cast<char*>(block) + HEADER_BYTES;
+}
+
+void deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  void* block = static_cast<char*>(ptr) - HEADER_BYTES;
+  live_bytes -= *static_cast<size_t*>(block);
+  std::free(block);
+}
+
+// Pulses cycling through the LEDs, every third one followed by a break
+ProtocolStep makeStep(uint32_t i) {
+  if (i % 3 == 2) {
+    return ProtocolStep(i + 1, 0, 0, 30000, 1, 0, true);
+  }
+  return ProtocolStep(i + 1, static_cast<ViUInt16>(i % 6), 1000, 1000, 2,
+                      static_cast<ViUInt16>(100 + i % 900), true);
+}
+
+StepSource makeSource(uint32_t n_steps) {
+  uint32_t i = 0;
+  return [i, n_steps]() mutable -> std::optional<ProtocolStep> {
+    if (i == n_steps) {
+      return std::nullopt;
+    }
+    return makeStep(i++);
+  };
+}
+}  // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { deallocate(ptr); }
+
+int main(int argc, char** argv) {
+  uint32_t n_steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  uint32_t n_executed_steps =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 150;
+  SimulatedDevice device;
+  Logger logger("bench_generated_protocol.log");
+  logger.setMinLevel(LogType::Warning);
+
+  // All batches of the protocol, one at a time
+  size_t base_bytes = live_bytes;
+  peak_bytes = live_bytes;
+  DeviceState device_state;
+  BatchGenerator generator(makeSource(n_steps), &device, &logger,
+                           BatchCostModel(), &device_state);
+  uint32_t last_batch_id = 0;
+  size_t max_lookahead = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (GeneratedBatch generated = generator.next(); generated.batch;
+       generated = generator.next()) {
+    last_batch_id = generated.batch->getBatchId();
+    if (generator.getLookaheadSize() > max_lookahead) {
+      max_lookahead = generator.getLookaheadSize();
+    }
+  }
+  double generate_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  std::printf("%u steps: %u batches generated in %.1f ms, at most %zu steps "
+              "read ahead\n",
+              n_steps, last_batch_id, generate_ms, max_lookahead);
+  std::printf("%-28s %12zu bytes\n", "peak heap, generated",
+              peak_bytes - base_bytes);
+
+  // The same steps planned up front
+  {
+    base_bytes = live_bytes;
+    std::vector<ProtocolStep> steps;
+    steps.reserve(n_steps);
+    for (uint32_t i = 0; i < n_steps; i++) {
+      steps.push_back(makeStep(i));
+    }
+    ProtocolPlanner planner(&device, std::move(steps), &logger);
+    std::printf("%-28s %12zu bytes\n", "kept by the planner, planned",
+                live_bytes - base_bytes);
+  }
+
+  // A short generated protocol, executed
+  ProtocolPlanner planner(&device, makeSource(n_executed_steps), &logger);
+  planner.setUpDevice();
+  planner.executeProtocol();
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+Measures the cost of a log call on the calling (time-critical) thread: the
+mean over many calls of a short trace message, of a longer multi-record
+message, of a formatted message built with std::to_string at the call
+site, of the same message with tracef(), and of a typed event. The writer
+thread formats and writes the records in the background. The call-site
+messages are measured again with traces disabled by the minimum level.
+Then writes the same device-call events to a text and to a binary log and
+compares the file sizes. Finally logs a protocol listing of 12 lines per call
+at once, more than the ring holds, and exits with 1 if a line is missing
+from the log (outside a busy window the caller waits for room).
+Usage: bench_logger [calls]
+*/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "Logger.hpp"
+
+namespace {
+template <typename Body>
+void measure(const char* name, Logger& logger, int calls, Body body) {
+  logger.flush();  // start with an empty ring
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; i++) {
+    body(i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double ns_per_call =
+      std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+  std::printf("%-28s %8.1f ns/call\n", name, ns_per_call);
+}
+
+// What PulseChainBatch::setUpThisBatch() logs for one pulse step
+void logStepEvents(Logger& logger, uint32_t batch_id, uint32_t step_id) {
+  logger.event(LogType::Trace, LogEvent::AddSelfRunningSignal, batch_id,
+               step_id, 0, {1, 0, 20000, 5000, 5000, 2});
+  logger.event(LogType::Trace, LogEvent::AddSelfRunningSignal, batch_id,
+               step_id, 0, {7, 0, 20000, 5000, 5000, 2});
+}
+
+uintmax_t logFileSize(const char* filename, LogFormat format, int steps) {
+  std::filesystem::remove(filename);
+  {
+    Logger logger(filename, format);
+    for (int i = 0; i < steps; i++) {
+      logStepEvents(logger, i / 16, i);
+      if (i % 1000 == 999) {
+        logger.flush();  // stay below the ring capacity
+      }
+    }
+  }
+  return std::filesystem::file_size(filename);
+}
+
+size_t countLines(const char* filename) {
+  std::ifstream file(filename);
+  std::string line;
+  size_t n_lines = 0;
+  while (std::getline(file, line)) {
+    n_lines++;
+  }
+  return n_lines;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int calls = argc > 1 ? std::atoi(argv[1]) : 4000;
+  Logger logger("bench_logger.log");
+  // Lower bound: every log call reads the steady clock once
+  volatile int64_t sink = 0;
+  measure("steady_clock::now() alone", logger, calls, [&sink](int) {
+    sink = sink + std::chrono::steady_clock::now().time_since_epoch().count();
+  });
+  // Stay below the ring capacity, so that no message is dropped and the
+  // producer cost is measured alone.
+  measure("short literal", logger, calls, [&logger](int) {
+    logger.trace("PulseChainBatch execute()");
+  });
+  measure("long literal (2 records)", logger, calls / 2, [&logger](int) {
+    logger.trace(
+        "PulseChainBatch::setUpThisBatch(): Error setting up (breakout board) "
+        "step: signalNr 7, startDelay: 20000us, activeTimeus 5000 us");
+  });
+  measure("to_string at call site", logger, calls, [&logger](int i) {
+    logger.trace("Batch " + std::to_string(i) + " started " +
+                 std::to_string(i * 3) + " us late.");
+  });
+  measure("tracef()", logger, calls, [&logger](int i) {
+    logger.tracef("Batch %d started %d us late.", i, i * 3);
+  });
+  measure("typed event", logger, calls, [&logger](int i) {
+    logger.event(LogType::Trace, LogEvent::AddSelfRunningSignal, i, i, 0,
+                 {1, 0, 20000, 5000, 5000, 2});
+  });
+  logger.setMinLevel(LogType::Info);
+  measure("to_string, trace disabled", logger, calls, [&logger](int i) {
+    logger.trace("Batch " + std::to_string(i) + " started " +
+                 std::to_string(i * 3) + " us late.");
+  });
+  measure("tracef(), trace disabled", logger, calls, [&logger](int i) {
+    logger.tracef("Batch %d started %d us late.", i, i * 3);
+  });
+  logger.setMinLevel(LogType::Trace);
+  logger.flush();
+  std::printf("dropped messages: %llu\n",
+              static_cast<unsigned long long>(logger.getDroppedCount()));
+
+  uintmax_t text_size =
+      logFileSize("bench_logger_events.log", LogFormat::Text, calls);
+  uintmax_t binary_size =
+      logFileSize("bench_logger_events.chrlog", LogFormat::Binary, calls);
+  std::printf("%d steps: text log %ju bytes, binary log %ju bytes (%.1fx)\n",
+              calls, text_size, binary_size,
+              static_cast<double>(text_size) / binary_size);
+
+  // As the listing printed and logged before a run
+  size_t n_lines = 12 * static_cast<size_t>(calls);
+  std::string listing;
+  for (size_t i = 0; i < n_lines; i++) {
+    listing += "Step " + std::to_string(i + 1) + "\tLED 1\t5000 us\n";
+  }
+  std::filesystem::remove("bench_logger_listing.log");
+  uint64_t listing_dropped = 0;
+  {
+    Logger listing_logger("bench_logger_listing.log");
+    auto start = std::chrono::steady_clock::now();
+    listing_logger.multiLineInfo(listing);
+    std::printf("%zu-line listing logged in %.1f ms\n", n_lines,
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count());
+    listing_dropped = listing_logger.getDroppedCount();
+  }
+  size_t n_written = countLines("bench_logger_listing.log");
+  std::printf("listing lines written: %zu of %zu, dropped: %llu\n", n_written,
+              n_lines, static_cast<unsigned long long>(listing_dropped));
+  return n_written == n_lines && listing_dropped == 0 ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+/*
+Planning of a protocol longer than 32-bit microseconds (about 71 min): a day
+of hourly stimulation, an overnight break and another day. The planned batch
+starts are compared with the step durations summed independently in 64 bits
+(and in 32 bits, as the timeline used to be), and the start delays of the
+batch programs with the 32-bit limit of the timing unit.
+Usage: bench_long_protocol [hours_per_day]
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <vector>
+
+#include "BatchPartitioning.hpp"
+#include "DeviceState.hpp"
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+#include "constants.hpp"
+
+namespace {
+constexpr uint64_t HOUR_US = 3600ull * 1000000;
+
+void addBreak(std::vector<ProtocolStep>& steps, uint32_t& step_id,
+              uint64_t duration_us) {
+  for (const auto& step : makeBreakSteps(step_id++, duration_us)) {
+    steps.push_back(step);
+  }
+}
+
+// Every hour 10 min of 20 Hz pulses (5 ms on) alternating two LEDs, then a
+// 50 min break; 12 h overnight break between the days
+std::vector<ProtocolStep> makeProtocol(uint32_t hours_per_day) {
+  std::vector<ProtocolStep> steps;
+  uint32_t step_id = 1;
+  for (int day = 0; day < 2; day++) {
+    for (uint32_t hour = 0; hour < hours_per_day; hour++) {
+      steps.emplace_back(step_id++, static_cast<ViUInt16>(hour % 2), 5, 45,
+                         12000, 500, false);
+      addBreak(steps, step_id, 50 * 60 * 1000000ull);
+    }
+    if (day == 0) {
+      addBreak(steps, step_id, 12 * HOUR_US);
+    }
+  }
+  return steps;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32_t hours_per_day = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 12;
+  SimulatedDevice device;
+  Logger logger("bench_long_protocol.log");
+  logger.setMinLevel(LogType::Warning);
+  std::vector<ProtocolStep> protocol = makeProtocol(hours_per_day);
+  uint64_t duration_us = 0;
+  for (const auto& step : protocol) {
+    duration_us += step.getTotalDurationUs();
+  }
+  std::printf("%zu steps, %.3f h\n", protocol.size(), duration_us / 3.6e9);
+  std::printf("%8s %8s %18s %18s %16s\n", "planning", "batches",
+              "max start error", "32-bit error", "max start delay");
+  for (BatchPlanning planning :
+       {BatchPlanning::Greedy, BatchPlanning::Optimal}) {
+    ProtocolPlanner planner(&device, protocol, &logger, nullptr, planning);
+    const std::vector<ProtocolStep>& steps = planner.getSteps();
+    const BatchPartition& partition = planner.getBatchPartition();
+    // Batch starts from the step durations
+    std::vector<uint64_t> start_us(partition.getBatchCount());
+    uint64_t t_us = 0;
+    uint32_t t32_us = 0;
+    std::vector<uint32_t> start32_us(partition.getBatchCount());
+    ViUInt32 max_start_delay_us = 0;
+    for (size_t i = 0; i < partition.getBatchCount(); i++) {
+      start_us[i] = t_us;
+      start32_us[i] = t32_us;
+      size_t first = partition.batch_starts[i];
+      size_t end = partition.getBatchEnd(i, steps.size());
+      for (size_t i_step = first; i_step < end; i_step++) {
+        t_us += steps[i_step].getTotalDurationUs();
+        t32_us += static_cast<uint32_t>(steps[i_step].getTotalDurationUs());
+      }
+      if (partition.batch_kinds[i] == BatchKind::PulseChain) {
+        BatchProgram program = compileBatchProgram(
+            std::span<const ProtocolStep>(steps.data() + first, end - first));
+        for (const auto& signal : program.signals) {
+          if (signal.start_delay_us > max_start_delay_us) {
+            max_start_delay_us = signal.start_delay_us;
+          }
+        }
+      }
+    }
+    long long max_error_us = 0;
+    long long max_error32_us = 0;
+    for (const auto& boundary : partition.boundaries) {
+      long long planned_us = boundary.planned_start_us.count();
+      max_error_us = std::max(
+          max_error_us,
+          std::llabs(planned_us -
+                     static_cast<long long>(start_us[boundary.i_batch])));
+      max_error32_us = std::max(
+          max_error32_us,
+          std::llabs(planned_us -
+                     static_cast<long long>(start32_us[boundary.i_batch])));
+    }
+    std::printf("%8s %8zu %15lld us %15.3f h %13.1f min\n",
+                planning == BatchPlanning::Optimal ? "optimal" : "greedy",
+                partition.getBatchCount(), max_error_us,
+                max_error32_us / 3.6e9, max_start_delay_us / 6e7);
+  }
+  std::printf("timing unit limit %.1f min\n",
+              Constants::MAX_DEVICE_TIME_US / 6e7);
+  return 0;
+}
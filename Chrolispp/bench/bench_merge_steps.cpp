@@ -0,0 +1,152 @@
+/*
+Time of merging the steps of large generated protocols with long runs of
+mergeable breaks and same-shape pulses, mixed with gapless pulses and
+incompatible steps:
+- legacy: the former ProtocolPlanner::mergeSteps(), which erased the next
+  step from the vector for every merge (O(n^2)), without its per-merge
+  messages. Only run up to legacy_rows rows, and checked to give the same
+  steps as mergeSteps().
+- mergeSteps(): single pass with a write cursor, also with split_gaps.
+Usage: bench_merge_steps [rows] [legacy_rows]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "ProtocolStep.hpp"
+#include "StepMerging.hpp"
+
+namespace {
+std::vector<ProtocolStep> generateProtocol(size_t rows) {
+  std::mt19937 rng(42);
+  std::vector<ProtocolStep> steps;
+  steps.reserve(rows);
+  uint32_t step_id = 0;
+  auto add = [&](ViUInt16 led, ViUInt32 pulse_width, ViUInt32 time_between,
+                 ViUInt32 n_pulses, ViUInt16 brightness) {
+    steps.emplace_back(step_id++, led, pulse_width, time_between, n_pulses,
+                       brightness, true);
+  };
+  while (steps.size() < rows) {
+    ViUInt16 led = static_cast<ViUInt16>(rng() % 6);
+    size_t run = 1 + rng() % 50;
+    switch (rng() % 5) {
+      case 0:  // run of breaks
+        for (size_t i = 0; i < run; i++) {
+          add(0, 0, 100 + 5 * (rng() % 20), 1, 0);
+        }
+        break;
+      case 1:  // run of same-shape pulses
+        for (size_t i = 0; i < run; i++) {
+          add(led, 500, 1000, 1 + rng() % 3, 200);
+        }
+        break;
+      case 2:  // gapless pulse followed by a break
+        add(led, 500, 0, 1, 300);
+        add(0, 0, 2000, 1, 0);
+        break;
+      case 3:  // gapless pulse followed by a single pulse
+        add(led, 500, 0, 1, 400);
+        add(led, 250, 750, 1, 400);
+        break;
+      default:  // incompatible pulses
+        for (size_t i = 0; i < run; i++) {
+          add(static_cast<ViUInt16>(i % 6), 100 + 5 * (i % 7), 500, 2,
+              static_cast<ViUInt16>(100 + i % 900));
+        }
+        break;
+    }
+  }
+  steps.resize(rows, steps.front());
+  return steps;
+}
+
+// The former ProtocolPlanner::mergeSteps() without its messages
+void legacyMergeSteps(std::vector<ProtocolStep>& protocolSteps) {
+  size_t i = 0;
+  while (i < protocolSteps.size() - 1) {
+    ProtocolStep& current = protocolSteps[i];
+    ProtocolStep& next = protocolSteps[i + 1];
+    switch (stepsCompatibleForMerge(current, next)) {
+      case CompatibilityStatus::Incompatible:
+        i++;
+        continue;
+      case CompatibilityStatus::BothBreaks:
+        current.setBreakDuration(current.getBreakDurationUs() +
+                                 next.getBreakDurationUs());
+        break;
+      case CompatibilityStatus::CompatibleSameShape:
+        current.n_pulses += next.n_pulses;
+        break;
+      case CompatibilityStatus::CompatibleGaplessAndBreak:
+        current.time_between_pulses_us += next.getBreakDurationUs();
+        break;
+      case CompatibilityStatus::CompatibleGaplessAndSingle:
+        current.pulse_width_us += next.pulse_width_us;
+        current.time_between_pulses_us += next.time_between_pulses_us;
+        current.n_pulses = 1;
+        break;
+      default:  // not returned by stepsCompatibleForMerge()
+        break;
+    }
+    protocolSteps.erase(protocolSteps.begin() + i + 1);
+  }
+}
+
+bool sameSteps(const std::vector<ProtocolStep>& a,
+               const std::vector<ProtocolStep>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].step_id != b[i].step_id || a[i].led_index != b[i].led_index ||
+        a[i].pulse_width_us != b[i].pulse_width_us ||
+        a[i].time_between_pulses_us != b[i].time_between_pulses_us ||
+        a[i].n_pulses != b[i].n_pulses || a[i].brightness != b[i].brightness) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Merge>
+double measureMs(std::vector<ProtocolStep>& steps, Merge merge) {
+  auto start = std::chrono::steady_clock::now();
+  merge(steps);
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t legacy_rows = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50000;
+
+  std::vector<ProtocolStep> legacy_steps = generateProtocol(legacy_rows);
+  std::vector<ProtocolStep> merged_steps = legacy_steps;
+  double legacy_ms = measureMs(legacy_steps, legacyMergeSteps);
+  double merge_ms = measureMs(
+      merged_steps, [](std::vector<ProtocolStep>& s) { mergeSteps(s); });
+  std::printf("%8zu rows: legacy %10.2f ms, mergeSteps() %8.2f ms, %s\n",
+              legacy_rows, legacy_ms, merge_ms,
+              sameSteps(legacy_steps, merged_steps) ? "same result"
+                                                     : "RESULTS DIFFER");
+
+  std::vector<ProtocolStep> steps = generateProtocol(rows);
+  MergeReport report;
+  double ms = measureMs(steps, [&report](std::vector<ProtocolStep>& s) {
+    report = mergeSteps(s);
+  });
+  std::printf("%8zu rows: mergeSteps() %8.2f ms\n", rows, ms);
+  std::printf("%s\n", summarizeMergeReport(report).c_str());
+  steps = generateProtocol(rows);
+  ms = measureMs(steps, [&report](std::vector<ProtocolStep>& s) {
+    report = mergeSteps(s, true);
+  });
+  std::printf("%8zu rows: mergeSteps(split_gaps) %8.2f ms\n", rows, ms);
+  std::printf("%s\n", summarizeMergeReport(report).c_str());
+  return sameSteps(legacy_steps, merged_steps) ? 0 : 1;
+}
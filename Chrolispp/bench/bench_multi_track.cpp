@@ -0,0 +1,123 @@
+/*
+A multi-track protocol run on the SimulatedDevice: a pulse train on LED 1 (470
+nm) with a long pulse on LED 3 (590 nm) in the middle of it, then the train
+again at another brightness. Prints the batches the planner makes of it and
+the error of every emitted on and off edge against the planned one, per LED,
+relative to the first planned edge. Exits with 1 if not every planned edge
+is emitted (run by ctest).
+Usage: bench_multi_track [call_latency_us]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "Logger.hpp"
+#include "MultiTrackProtocol.hpp"
+#include "ProtocolPlanner.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+MultiTrackProtocol makeProtocol() {
+  MultiTrackProtocol protocol;
+  protocol.tracks.resize(2);
+  // 20 pulses of 5 ms every 50 ms, twice
+  protocol.tracks[0].push_back({0, 100000, 5000, 45000, 20, 500});
+  protocol.tracks[0].push_back({0, 1500000, 5000, 45000, 20, 1000});
+  // 200 ms in the middle of the first train
+  protocol.tracks[1].push_back({2, 500000, 200000, 100000, 1, 300});
+  return protocol;
+}
+
+struct PlannedEdge {
+  long long time_us;
+  ViUInt16 led_index;
+  bool on;
+};
+
+std::vector<PlannedEdge> plannedEdges(const MultiTrackProtocol& protocol) {
+  std::vector<PlannedEdge> edges;
+  for (const auto& track : protocol.tracks) {
+    for (const auto& train : track) {
+      long long t_us = train.start_us;
+      for (ViUInt32 i = 0; i < train.n_pulses; i++) {
+        edges.push_back({t_us, train.led_index, true});
+        edges.push_back({t_us + train.pulse_width_us, train.led_index, false});
+        t_us += train.pulse_width_us + train.time_between_pulses_us;
+      }
+    }
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const PlannedEdge& a, const PlannedEdge& b) {
+                     return a.time_us < b.time_us;
+                   });
+  return edges;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int call_latency_us = argc > 1 ? std::atoi(argv[1]) : -1;
+  SimulatedDevice::Latencies latencies;
+  if (call_latency_us >= 0) {
+    latencies.per_call.fill(std::chrono::microseconds(call_latency_us));
+  }
+  SimulatedDevice device(latencies);
+  Logger logger("bench_multi_track.log");
+  BatchCostModel cost_model = calibrateBatchCostModel(device);
+  MultiTrackProtocol protocol = makeProtocol();
+  ProtocolPlanner planner(&device, protocol, &logger, cost_model);
+  std::printf("%zu trains: %zu batches\n", protocol.getTrainCount(),
+              planner.getBatchPartition().getBatchCount());
+  std::printf("%s", planner.summarizePredictedLateStarts().c_str());
+  planner.setUpDevice();
+  device.resetHistory();
+  auto start = device.now();
+  planner.executeProtocol();
+
+  std::vector<PlannedEdge> planned = plannedEdges(protocol);
+  std::vector<LedEdge> emitted = device.getLedTimeline();
+  std::printf("planned edges: %zu, emitted edges: %zu\n", planned.size(),
+              emitted.size());
+  if (emitted.empty()) {
+    return 1;
+  }
+  // The first emitted edge is where the first planned one should be
+  long long offset_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          emitted[0].time - start)
+          .count() -
+      planned[0].time_us;
+  std::printf("%4s %12s %12s %10s\n", "LED", "planned ms", "emitted ms",
+              "error us");
+  for (ViUInt16 led : {0, 2}) {
+    std::vector<PlannedEdge> planned_led;
+    std::vector<LedEdge> emitted_led;
+    std::copy_if(planned.begin(), planned.end(),
+                 std::back_inserter(planned_led),
+                 [led](const PlannedEdge& e) { return e.led_index == led; });
+    std::copy_if(emitted.begin(), emitted.end(),
+                 std::back_inserter(emitted_led),
+                 [led](const LedEdge& e) { return e.led_index == led; });
+    long long max_error_us = 0;
+    for (size_t k = 0; k < std::min(planned_led.size(), emitted_led.size());
+         k++) {
+      long long emitted_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              emitted_led[k].time - start)
+              .count() -
+          offset_us;
+      long long error_us = emitted_us - planned_led[k].time_us;
+      max_error_us = std::max(max_error_us, std::abs(error_us));
+      if (k < 4 || led == 2) {
+        std::printf("%4u %12.3f %12.3f %10lld\n", led + 1,
+                    planned_led[k].time_us / 1000.0, emitted_us / 1000.0,
+                    error_us);
+      }
+    }
+    std::printf("LED %u: %zu of %zu edges, max error %lld us\n", led + 1,
+                emitted_led.size(), planned_led.size(), max_error_us);
+  }
+  return emitted.size() == planned.size() ? 0 : 1;
+}
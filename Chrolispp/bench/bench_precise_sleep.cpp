@@ -0,0 +1,42 @@
+/*
+Measures how well Timing::precise_sleep_for() honours the requested duration
+for a range of durations typical of breaks between batches, and how much of
+the wait was spent in the spin phase (the learned overshoot margin).
+Usage: bench_precise_sleep [iterations_per_duration]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Timing.hpp"
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+  const long long durations_us[] = {10, 100, 500, 1000, 1500, 5000, 20000};
+
+  std::printf("%10s %10s %10s %10s %10s %10s\n", "request", "min", "p50",
+              "p99", "max", "margin");
+  for (long long duration_us : durations_us) {
+    std::vector<long long> errors_ns;
+    errors_ns.reserve(iterations);
+    for (int i = 0; i < iterations; i++) {
+      auto start = Timing::Clock::now();
+      Timing::precise_sleep_for(std::chrono::microseconds(duration_us));
+      auto slept = Timing::Clock::now() - start;
+      errors_ns.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(slept).count() -
+          duration_us * 1000);
+    }
+    std::sort(errors_ns.begin(), errors_ns.end());
+    auto percentile = [&errors_ns](double p) {
+      return errors_ns[static_cast<size_t>(p * (errors_ns.size() - 1))] / 1000.0;
+    };
+    std::printf("%8lldus %8.1fus %8.1fus %8.1fus %8.1fus %8lldus\n",
+                duration_us, percentile(0.0), percentile(0.5), percentile(0.99),
+                percentile(1.0),
+                static_cast<long long>(Timing::sleep_overshoot_estimate().count()));
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*
+Rendering a planned protocol as text (the listing printed and logged before a
+run): time to render plans of growing length into a std::string
+(ProtocolPlanner::toString()) and into a std::ostream
+(ProtocolPlanner::writeTo()), per step, which stays flat if rendering is
+linear in the protocol length. Both renderings are compared.
+Usage: bench_render_protocol [max_steps]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+// Pulses cycling through the LEDs with a pulse width that never repeats (so
+// no batch is folded), every sixth step a break
+std::vector<ProtocolStep> makeProtocol(size_t n_steps) {
+  std::vector<ProtocolStep> steps;
+  steps.reserve(n_steps);
+  for (size_t i = 0; i < n_steps; i++) {
+    uint32_t step_id = static_cast<uint32_t>(i + 1);
+    if (i % 6 == 5) {
+      steps.emplace_back(step_id, 0, 0, 20000, 1, 0, true);
+    } else {
+      steps.emplace_back(step_id, static_cast<ViUInt16>(i % 6),
+                         static_cast<ViUInt32>(100 + 5 * i), 1000, 1, 500,
+                         true);
+    }
+  }
+  return steps;
+}
+
+template <typename Render>
+double timeMs(Render render) {
+  auto start = std::chrono::steady_clock::now();
+  render();
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t max_steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  SimulatedDevice device;
+  Logger logger("bench_render_protocol.log");
+  logger.setMinLevel(LogType::Warning);
+  std::printf("%10s %10s %12s %12s %10s %12s %10s %6s\n", "steps", "batches",
+              "bytes", "string ms", "ns/step", "ostream ms", "ns/step",
+              "same");
+  for (size_t n_steps = max_steps / 100; n_steps <= max_steps;
+       n_steps *= 10) {
+    if (n_steps == 0) {
+      continue;
+    }
+    ProtocolPlanner planner(&device, makeProtocol(n_steps), &logger);
+    std::string text;
+    double string_ms =
+        timeMs([&] { text = planner.toString("", "\t", "\t\t"); });
+    std::ostringstream stream;
+    double stream_ms =
+        timeMs([&] { planner.writeTo(stream, "", "\t", "\t\t"); });
+    std::printf("%10zu %10zu %12zu %12.2f %10.1f %12.2f %10.1f %6s\n",
+                n_steps, planner.getBatchSchedule().unique_batches.size(),
+                text.size(), string_ms, 1e6 * string_ms / n_steps, stream_ms,
+                1e6 * stream_ms / n_steps,
+                stream.str() == text ? "yes" : "no");
+  }
+  return 0;
+}
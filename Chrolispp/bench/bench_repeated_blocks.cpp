@@ -0,0 +1,59 @@
+/*
+Planning of the typical stimulation paradigm, one block of steps repeated many
+times: time to construct the ProtocolPlanner (merging, partitioning, block
+detection, batch creation), and the number of batch objects created (one per
+unique batch) against the number of batch starts they cover.
+Usage: bench_repeated_blocks [greedy|optimal]
+*/
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+// Block of 6 steps: three LEDs, each pulsed and followed by a break
+std::vector<ProtocolStep> makeProtocol(size_t repetitions) {
+  std::vector<ProtocolStep> steps;
+  steps.reserve(6 * repetitions);
+  uint32_t step_id = 0;
+  for (size_t i = 0; i < repetitions; i++) {
+    for (ViUInt16 led : {0, 2, 4}) {
+      steps.emplace_back(step_id++, led, 5000, 5000, 2, 300 + 100 * led,
+                         true);
+      steps.emplace_back(step_id++, 0, 0, 30000, 1, 0, true);
+    }
+  }
+  return steps;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  BatchPlanning planning =
+      argc > 1 && std::string_view(argv[1]) == "optimal"
+          ? BatchPlanning::Optimal
+          : BatchPlanning::Greedy;
+  SimulatedDevice device;
+  Logger logger("bench_repeated_blocks.log");
+  std::printf("%12s %10s %12s %14s %8s %14s\n", "repetitions", "steps",
+              "plan ms", "unique batches", "blocks", "batch starts");
+  for (size_t repetitions : {100, 1000, 10000}) {
+    std::vector<ProtocolStep> steps = makeProtocol(repetitions);
+    size_t n_steps = steps.size();
+    auto start = std::chrono::steady_clock::now();
+    ProtocolPlanner planner(&device, std::move(steps), &logger, nullptr,
+                            planning);
+    double plan_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    const BatchSchedule& schedule = planner.getBatchSchedule();
+    std::printf("%12zu %10zu %12.2f %14zu %8zu %14zu\n", repetitions, n_steps,
+                plan_ms, schedule.unique_batches.size(),
+                schedule.blocks.size(), schedule.getExecutedBatchCount());
+  }
+  return 0;
+}
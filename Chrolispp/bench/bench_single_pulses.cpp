@@ -0,0 +1,121 @@
+/*
+A train of single pulses on one LED with alternating brightness (so that the
+steps cannot be merged into one pulse chain) and short dark gaps, run on the
+SimulatedDevice: the batches the planner makes of it, the timing unit calls
+they issue, and the error of the emitted pulses against the planned ones.
+signals_per_channel limits the signals the simulated timing unit takes per
+channel (0: no limit), as on a device that only takes one. Exits with 1 if not
+every planned pulse is emitted or the calibration does not find the limit
+(run by ctest).
+Usage: bench_single_pulses [pulses] [gap_ms] [call_latency_us]
+                           [signals_per_channel]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+std::vector<ProtocolStep> makeProtocol(int n_pulses, ViUInt32 gap_ms) {
+  std::vector<ProtocolStep> steps;
+  uint32_t step_id = 1;
+  steps.emplace_back(step_id++, 0, 0, 100, 1, 0, false);  // initial break
+  for (int i = 0; i < n_pulses; i++) {
+    steps.emplace_back(step_id++, 2, 5, gap_ms, 1, i % 2 == 0 ? 400 : 800,
+                       false);
+  }
+  steps.emplace_back(step_id++, 0, 0, 100, 1, 0, false);
+  return steps;
+}
+
+void printErrors(const char* name, std::vector<long long> values) {
+  if (values.empty()) {
+    std::printf("%-18s n/a\n", name);
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  std::printf("%-18s min %8lld  p50 %8lld  max %8lld us\n", name,
+              values.front(), values[values.size() / 2], values.back());
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int n_pulses = argc > 1 ? std::atoi(argv[1]) : 50;
+  ViUInt32 gap_ms = argc > 2 ? static_cast<ViUInt32>(std::atoi(argv[2])) : 5;
+  int call_latency_us = argc > 3 ? std::atoi(argv[3]) : -1;
+  size_t signals_per_channel =
+      argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0;
+
+  SimulatedDevice::Latencies latencies;
+  if (call_latency_us >= 0) {
+    latencies.per_call.fill(std::chrono::microseconds(call_latency_us));
+  }
+  SimulatedDevice device(latencies);
+  device.setMaxSignalsPerChannel(signals_per_channel);
+  Logger logger("bench_single_pulses.log");
+  BatchCostModel cost_model = calibrateBatchCostModel(device);
+  std::printf("signals per channel: %zu probed\n",
+              cost_model.signals_per_channel);
+  if (signals_per_channel > 0 &&
+      cost_model.signals_per_channel != signals_per_channel) {
+    return 1;
+  }
+  ProtocolPlanner planner(&device, makeProtocol(n_pulses, gap_ms), &logger,
+                          nullptr, BatchPlanning::Greedy, cost_model);
+  planner.setUpDevice();
+  device.resetHistory();
+  planner.executeProtocol();
+
+  size_t n_timing_unit_calls = 0;
+  for (const auto& record : device.getCallLog()) {
+    n_timing_unit_calls += record.call == DeviceCall::ResetSequence ||
+                           record.call == DeviceCall::AddSelfRunningSignal;
+  }
+  std::printf("%d pulses: %zu batches, %zu reset/add signal calls\n", n_pulses,
+              planner.getBatchPartition().getBatchCount(),
+              n_timing_unit_calls);
+
+  // Planned pulses of LED 3, relative to the first one
+  std::vector<long long> planned_on;
+  long long t_us = 0;
+  for (const auto& step : planner.getSteps()) {
+    if (!step.isBreak()) {
+      planned_on.push_back(t_us);
+    }
+    t_us += step.getTotalDurationUs();
+  }
+  std::vector<long long> on_us;
+  std::vector<long long> width_us;
+  for (const auto& edge : device.getLedTimeline()) {
+    long long time_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(edge.time)
+            .count();
+    if (edge.on) {
+      on_us.push_back(time_us);
+    } else if (!on_us.empty()) {
+      width_us.push_back(time_us - on_us.back());
+    }
+  }
+  std::printf("planned pulses: %zu, emitted pulses: %zu\n", planned_on.size(),
+              on_us.size());
+  if (on_us.empty() || planned_on.empty()) {
+    return 1;
+  }
+  std::vector<long long> on_errors;
+  std::vector<long long> width_errors;
+  for (size_t k = 0; k < std::min(on_us.size(), planned_on.size()); k++) {
+    on_errors.push_back((on_us[k] - on_us[0]) -
+                        (planned_on[k] - planned_on[0]));
+    width_errors.push_back(width_us[k] - 5000);
+  }
+  printErrors("on edge error", on_errors);
+  printErrors("pulse width error", width_errors);
+  return on_us.size() == planned_on.size() ? 0 : 1;
+}
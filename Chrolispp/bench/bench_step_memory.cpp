@@ -0,0 +1,107 @@
+/*
+Heap memory of planning a long protocol that does not repeat (every batch is
+unique, so none is folded): the bytes allocated for the steps themselves
+against the bytes the ProtocolPlanner keeps and at most uses while planning,
+and the number of allocations made while planning.
+The batches refer to ranges of the planner's steps, so the steps are only
+held once however many batches there are, but the compiled programs (two
+generator signals per pulse step) and the per-batch bookkeeping still make
+the planner keep several times the bytes of the steps. The batches are stored by value in
+one vector and their programs in one ProgramArena, so the allocations do not
+grow with the number of batches.
+Usage: bench_step_memory [steps]
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "Logger.hpp"
+#include "ProtocolPlanner.hpp"
+#include "ProtocolStep.hpp"
+#include "SimulatedDevice.hpp"
+
+namespace {
+size_t live_bytes = 0;
+size_t peak_bytes = 0;
+size_t n_allocations = 0;
+
+// Every allocation is preceded by its size
+constexpr size_t HEADER_BYTES = alignof(std::max_align_t);
+
+void* allocate(size_t size) {
+  void* block = std::malloc(size + HEADER_BYTES);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(block) = size;
+  n_allocations++;
+  live_bytes += size;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+  return static_cast<char*>(block) + HEADER_BYTES;
+}
+
+void deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  void* block = static_cast<char*>(ptr) - HEADER_BYTES;
+  live_bytes -= *static_cast<size_t*>(block);
+  std::free(block);
+}
+
+// Pulse steps cycling through the LEDs with a pulse width that never repeats
+std::vector<ProtocolStep> makeProtocol(size_t n_steps) {
+  std::vector<ProtocolStep> steps;
+  steps.reserve(n_steps);
+  for (size_t i = 0; i < n_steps; i++) {
+    steps.emplace_back(static_cast<uint32_t>(i),
+                       static_cast<ViUInt16>(i % 6),
+                       static_cast<ViUInt32>(100 + 5 * i), 1000, 1, 500,
+                       true);
+  }
+  return steps;
+}
+}  // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { deallocate(ptr); }
+
+int main(int argc, char** argv) {
+  size_t n_steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+  SimulatedDevice device;
+  Logger logger("bench_step_memory.log");
+  size_t base_bytes = live_bytes;
+  std::vector<ProtocolStep> steps = makeProtocol(n_steps);
+  size_t steps_bytes = live_bytes - base_bytes;
+  peak_bytes = live_bytes;
+  size_t base_allocations = n_allocations;
+  auto start = std::chrono::steady_clock::now();
+  ProtocolPlanner planner(&device, std::move(steps), &logger);
+  double plan_ms = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  size_t kept_bytes = live_bytes - base_bytes;
+  size_t planning_allocations = n_allocations - base_allocations;
+  size_t n_batches = planner.getBatchSchedule().unique_batches.size();
+  std::printf("%zu steps (%zu bytes each), %zu batches, planned in %.1f ms\n",
+              n_steps, sizeof(ProtocolStep), n_batches, plan_ms);
+  std::printf("%-24s %12zu bytes\n", "steps", steps_bytes);
+  std::printf("%-24s %12zu bytes (%.1f per step)\n", "kept by the planner",
+              kept_bytes, static_cast<double>(kept_bytes) / n_steps);
+  std::printf("%-24s %12zu bytes (%.1f per step)\n", "peak while planning",
+              peak_bytes - base_bytes,
+              static_cast<double>(peak_bytes - base_bytes) / n_steps);
+  std::printf("%-24s %12zu (%.2f per batch)\n", "allocations",
+              planning_allocations,
+              static_cast<double>(planning_allocations) / n_batches);
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+Per-message cost of log timestamps, before and after moving the formatting to
+the writer thread:
+- before: what Logger::getTimestamp() did on the logging thread for every
+  message (system_clock::now, localtime, strftime, snprintf, std::string).
+- after, log time: reading the raw steady_clock ticks.
+- after, write time: TimestampFormatter::format() with the per-second cached
+  date prefix, for lines 50 us apart (as in a batch dump), and for lines more
+  than a second apart (cache miss on every line).
+Usage: bench_timestamp [calls]
+*/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "TimestampFormatter.hpp"
+
+namespace {
+// The former Logger::getTimestamp()
+std::string legacyTimestamp() {
+  auto now = std::chrono::system_clock::now();
+  std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+  std::tm now_tm;
+#ifdef _WIN32
+  localtime_s(&now_tm, &now_time);
+#else
+  localtime_r(&now_time, &now_tm);
+#endif
+  char buffer[30];
+  std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &now_tm);
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                now.time_since_epoch()) %
+            1000;
+  char timestamp[40];
+  std::snprintf(timestamp, sizeof(timestamp), "%s.%03d", buffer,
+                static_cast<int>(ms.count()));
+  return timestamp;
+}
+
+template <typename Body>
+void measure(const char* name, int calls, Body body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; i++) {
+    body(i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  std::printf("%-40s %8.1f ns/call\n", name,
+              std::chrono::duration<double, std::nano>(elapsed).count() /
+                  calls);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int calls = argc > 1 ? std::atoi(argv[1]) : 200000;
+  volatile size_t sink = 0;
+
+  measure("before: getTimestamp() at log time", calls,
+          [&sink](int) { sink = sink + legacyTimestamp().size(); });
+  measure("after: steady_clock ticks at log time", calls, [&sink](int) {
+    sink = sink + static_cast<size_t>(
+                      std::chrono::steady_clock::now().time_since_epoch().count());
+  });
+
+  // Tick counts as the writer sees them
+  int64_t now_ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+  int64_t ticks_per_us =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::microseconds(1))
+          .count();
+  std::vector<int64_t> dense(calls);
+  std::vector<int64_t> sparse(calls);
+  for (int i = 0; i < calls; i++) {
+    dense[i] = now_ticks + i * 50 * ticks_per_us;
+    sparse[i] = now_ticks + static_cast<int64_t>(i) * 1100000 * ticks_per_us;
+  }
+  TimestampFormatter formatter;
+  char out[TimestampFormatter::LENGTH];
+  measure("after: format(), lines 50 us apart", calls,
+          [&](int i) { sink = sink + formatter.format(dense[i], out); });
+  measure("after: format(), lines 1.1 s apart", calls,
+          [&](int i) { sink = sink + formatter.format(sparse[i], out); });
+  std::printf("sample: %.*s\n", static_cast<int>(TimestampFormatter::LENGTH),
+              out);
+  return 0;
+}
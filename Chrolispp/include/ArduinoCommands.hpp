@@ -1,13 +1,11 @@
 #ifndef ARDUINO_COMMANDS_HPP
 #define ARDUINO_COMMANDS_HPP
 
-#include <Windows.h>
-
-#include <iostream>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 
-#include "TL6WL.h"
+#include "visatype.h"
 
 // Command words for Arduino communication
 constexpr uint8_t APPEND_STEP =
@@ -49,8 +47,5 @@ ArduinoDataPacket createStepDataPacket(ViUInt16& brightness,
 
 ViUInt16 scaleBrightnessToArduino(ViUInt16& brightness,
                                   int dac_resolution_bits);
-uint8_t sendCommandToArduino(HANDLE h_Serial, uint8_t command);
-uint16_t sendDataPacketToArduino(HANDLE h_Serial, ArduinoDataPacket& packet,
-                                 int dac_resolution_bits);
 uint8_t computeCRC(const ArduinoDataPacket& packet);
 #endif  // ARDUINO_COMMANDS_HPP
\ No newline at end of file
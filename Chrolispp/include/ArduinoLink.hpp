@@ -0,0 +1,29 @@
+#ifndef ARDUINO_LINK_HPP
+#define ARDUINO_LINK_HPP
+
+#include <cstdint>
+
+#include "ArduinoCommands.hpp"
+
+/*
+ArduinoLink: connection to the Arduino running the chroliscpp firmware, as seen
+by the ProtocolPlanner. The serial implementation (SerialArduinoLink) is
+Windows-only; the planner itself only needs this interface.
+*/
+class ArduinoLink {
+ public:
+  virtual ~ArduinoLink() = default;
+  /*
+  Send a single-byte command word (see ArduinoCommands.hpp), return the
+  response byte.
+  */
+  virtual uint8_t sendCommand(uint8_t command) = 0;
+  /*
+  Send a data packet (command word APPEND_STEP), return the CRC the Arduino
+  computed.
+  */
+  virtual uint16_t sendDataPacket(ArduinoDataPacket& packet,
+                                  int dac_resolution_bits) = 0;
+};
+
+#endif  // ARDUINO_LINK_HPP
@@ -0,0 +1,58 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "DeviceState.hpp"
+#include "InitialBreakBatch.hpp"
+#include "ProtocolBatch.hpp"
+#include "PulseChainBatch.hpp"
+#include "SinglePulsesBatch.hpp"
+#include "Timing.hpp"
+
+/*
+Batch: a batch of any kind (see ProtocolBatch.hpp) by value, with the
+functions of the batch classes. The batches of a protocol are a contiguous
+std::vector<Batch>: creating one takes no allocation of its own (its program
+is in a ProgramArena), and executing them needs no virtual calls.
+Constructed in place, e.g.
+  Batch(std::in_place_type<PulseChainBatch>, batch_id, device_ptr, steps,
+        logger_ptr, programs, device_state)
+Moving a batch keeps it valid (it refers to its steps and its program, which
+do not move).
+*/
+class Batch {
+ public:
+  template <typename Kind, typename... Args>
+  explicit Batch(std::in_place_type_t<Kind> kind, Args&&... args)
+      : batch(kind, std::forward<Args>(args)...) {}
+
+  std::chrono::microseconds getBusyDurationUs() const {
+    return getBase().getBusyDurationUs();
+  }
+  std::chrono::microseconds getTotalDurationUs() const {
+    return getBase().getTotalDurationUs();
+  }
+  std::chrono::microseconds getStartupDelayUs() const;
+  uint32_t getBatchId() const { return getBase().getBatchId(); }
+  std::string getBatchType() const { return getBase().getBatchType(); }
+  const BatchProgramView* getProgram() const;
+  void setUpThisBatch();
+  std::chrono::microseconds execute();
+  // See ProtocolBatch::setUpNextBatch()
+  std::chrono::microseconds setUpNextBatch(
+      Batch& next_batch, Timing::Clock::time_point next_execute_deadline);
+  // See ProtocolBatch::appendBatchTo()
+  void appendTo(std::string& out, const std::string& prefix,
+                const std::string& step_level_prefix) const;
+
+ private:
+  std::variant<InitialBreakBatch, PulseChainBatch, SinglePulsesBatch> batch;
+
+  const ProtocolBatch& getBase() const;
+};
+
+#endif  // BATCH_HPP
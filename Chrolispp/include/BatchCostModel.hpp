@@ -0,0 +1,95 @@
+#ifndef BATCH_COST_MODEL_HPP
+#define BATCH_COST_MODEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "ChrolisDevice.hpp"
+#include "DeviceState.hpp"
+#include "constants.hpp"
+
+/*
+BatchCostModel: estimated duration of every device call, and from it the time
+a batch boundary needs out of the idle time at the end of the previous batch:
+- if the previous batch is a PulseChainBatch, its generator start (execute()
+  returns that much after the end of its busy part) and turning off the LEDs
+  after it,
+- setting up the batch (PulseChainBatch::setUpThisBatch(): stop the
+  generator, and the calls of its BatchSetUp: reset the sequence, add
+  signals and trigger points, brightness),
+- its startup delay (the batch is executed that much ahead of its planned
+  start).
+The idle time at the end of the previous batch hides up to that much. The
+default call durations are rough estimates (see constants.hpp); measured ones
+come from calibrateBatchCostModel() and can be stored with save().
+signals_per_channel is how many signals the timing unit takes per channel in
+one sequence, i.e. how many steps of one LED a PulseChainBatch may have (1
+unless probed, see probeSignalsPerChannel()).
+*/
+struct BatchCostModel {
+  std::array<std::chrono::microseconds, static_cast<size_t>(DeviceCall::Count)>
+      call_us;
+  std::chrono::microseconds startup_delay_us;  // pulse batches only
+  size_t signals_per_channel = 1;
+
+  BatchCostModel();
+
+  std::chrono::microseconds& operator[](DeviceCall call) {
+    return call_us[static_cast<size_t>(call)];
+  }
+  std::chrono::microseconds operator[](DeviceCall call) const {
+    return call_us[static_cast<size_t>(call)];
+  }
+  // PulseChainBatch::setUpThisBatch() with the calls of set_up
+  std::chrono::microseconds estimateSetUpUs(const BatchSetUp& set_up) const;
+  // Programming everything for a batch with n_pulse_steps pulse steps (0:
+  // only breaks, nothing to program), the most a set up can take
+  std::chrono::microseconds estimateSetUpUs(size_t n_pulse_steps) const;
+  // Boundary time before a batch set up with the calls of set_up. The LEDs
+  // are only turned off after a pulse batch with a trailing break, but
+  // without one the batch is late anyway.
+  std::chrono::microseconds estimateBoundaryUs(const BatchSetUp& set_up,
+                                               bool after_pulse_batch) const;
+  // Boundary time programming everything for n_pulse_steps pulse steps
+  std::chrono::microseconds estimateBoundaryUs(size_t n_pulse_steps,
+                                               bool after_pulse_batch) const;
+
+  /*
+  Text file with one "<call name> <microseconds>" line per device call, a
+  "StartupDelay <microseconds>" and a "SignalsPerChannel <count>" line, e.g.
+  "ResetSequence 512". Lines starting
+  with # are comments. load() keeps the defaults for missing entries. Both
+  throw std::runtime_error if the file cannot be read or written, load() also
+  for unknown or malformed entries.
+  */
+  void save(const std::string& filename) const;
+  static BatchCostModel load(const std::string& filename);
+};
+
+/*
+Measure the device calls PulseChainBatch uses to set up and end a batch:
+repetitions times the calls of setting up a batch with one step (stop
+generator, reset sequence, LED and breakout box signal, brightness), a
+triggered signal and a trigger point, and turning off the LEDs, taking the 90th
+percentile of each call, and probeSignalsPerChannel(). Leaves the LEDs off,
+the brightness at 0 and the signal table empty. Not time critical, call it
+before a protocol runs. Throws std::runtime_error if a call fails.
+*/
+BatchCostModel calibrateBatchCostModel(ChrolisDevice& device,
+                                       int repetitions = 50);
+
+/*
+How many self-running signals with different start delays the timing unit
+accepts on one channel in one sequence, up to max_signals: adds pulses on
+LED 1 and its breakout box output one after the other until a call fails.
+Only the acceptance of the calls is checked, not the light output. Leaves
+the signal table empty and the generator stopped. Throws std::runtime_error
+if not even one signal is accepted.
+*/
+size_t probeSignalsPerChannel(
+    ChrolisDevice& device,
+    size_t max_signals = Constants::MAX_PROBED_SIGNALS_PER_CHANNEL);
+
+#endif  // BATCH_COST_MODEL_HPP
@@ -0,0 +1,73 @@
+#ifndef BATCH_GENERATOR_HPP
+#define BATCH_GENERATOR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "Batch.hpp"
+#include "BatchCostModel.hpp"
+#include "ChrolisDevice.hpp"
+#include "DeviceState.hpp"
+#include "Logger.hpp"
+#include "ProgramArena.hpp"
+#include "ProtocolStep.hpp"
+
+/*
+StepSource: yields the steps of a protocol one at a time and std::nullopt
+after the last one, e.g. a protocol generated on the fly that is too long to
+hold in memory.
+*/
+using StepSource = std::function<std::optional<ProtocolStep>()>;
+
+/*
+GeneratedBatch: a batch made by BatchGenerator together with the steps and
+the program it refers to (see ProtocolBatch), so that they live exactly as
+long as the batch. Moving it keeps the batch valid.
+*/
+struct GeneratedBatch {
+  std::vector<ProtocolStep> steps;
+  ProgramArena programs;
+  std::optional<Batch> batch;
+};
+
+/*
+BatchGenerator: makes the batches of a protocol one at a time from a
+StepSource, so that executing a protocol of any length takes constant memory.
+The batch boundaries are the greedy ones (greedyBatchEnd()); a batch is only
+made once the step after it has been read. Consecutive breaks are merged as
+they are read (as long as they fit one step), no other steps are merged and
+there is no block folding, so every batch is made (and programmed) anew.
+Batch ids count from 1 in execution order.
+The steps are read ahead only as far as needed to find the end of the next
+batch, usually a few steps. Throws std::invalid_argument for an invalid step
+(as the ProtocolPlanner checks), when it is read.
+*/
+class BatchGenerator {
+ public:
+  BatchGenerator(StepSource source, ChrolisDevice* device_ptr,
+                 Logger* logger_ptr, const BatchCostModel& model,
+                 DeviceState* device_state);
+  // The next batch, an empty GeneratedBatch (no batch) after the last
+  GeneratedBatch next();
+  uint64_t getStepsRead() const { return n_steps_read; }
+  // Steps read but not yet in a batch
+  size_t getLookaheadSize() const { return lookahead.size(); }
+
+ private:
+  StepSource source;
+  ChrolisDevice* device_ptr;
+  Logger* logger_ptr;
+  BatchCostModel model;
+  DeviceState* device_state;
+  std::vector<ProtocolStep> lookahead;
+  bool source_done = false;
+  uint64_t n_steps_read = 0;
+  uint32_t next_batch_id = 1;
+
+  // Read up to n_steps more steps into the lookahead, false if none was left
+  bool readAhead(size_t n_steps);
+};
+
+#endif  // BATCH_GENERATOR_HPP
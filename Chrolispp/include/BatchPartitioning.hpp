@@ -0,0 +1,134 @@
+#ifndef BATCH_PARTITIONING_HPP
+#define BATCH_PARTITIONING_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "ProtocolStep.hpp"
+
+/*
+How ProtocolPlanner groups the (merged) steps into batches, see the batch
+definition in ProtocolBatch.hpp:
+- Greedy: a batch ends at its first break, or before the first step that
+  uses an LED already used in the batch (if the timing unit takes several
+  signals per channel, BatchCostModel::signals_per_channel: once that many
+  steps used it, or with another brightness).
+  The break steps after the first one of a long break (makeBreakSteps()) are
+  a batch of breaks of their own.
+- Optimal: batch boundaries minimise the setup time that is not hidden by the
+  idle time before a batch (see BatchCostModel), then the number of batches.
+  Breaks may be inside a batch, a batch of only breaks is only possible at
+  the start of the protocol. Steps are merged with
+  split_gaps (see mergeSteps()), so that repeated pulses of one LED need
+  fewer batches.
+With both, a run of single pulses that does not fit in one pulse chain (an LED
+used more often than the timing unit takes, or with several brightnesses),
+with dark gaps too short to reprogram the timing unit in, is one SinglePulses
+batch (see singlePulsesEnd()). Optimal only uses one where it hides more set
+up time than batches of pulse chains would.
+With both, a batch ends before a step that would start too late in it for the
+32-bit timing unit (Constants::MAX_DEVICE_TIME_US after the batch start),
+while the timeline of the protocol is 64-bit.
+*/
+enum class BatchPlanning { Greedy, Optimal };
+
+// How a batch is executed, see ProtocolBatch.hpp
+enum class BatchKind {
+  Breaks,       // InitialBreakBatch
+  PulseChain,   // PulseChainBatch, timed by the signal generator
+  SinglePulses  // SinglePulsesBatch, timed by the host
+};
+
+/*
+BoundaryPrediction: what the cost model predicts for the start of a batch
+(except the first one, which is set up before the protocol starts).
+*/
+struct BoundaryPrediction {
+  size_t i_batch;
+  // Planned start of the batch, relative to the start of the protocol
+  std::chrono::microseconds planned_start_us;
+  // Idle time at the end of the previous batch
+  std::chrono::microseconds available_us;
+  // BatchCostModel::estimateBoundaryUs() of the batch
+  std::chrono::microseconds needed_us;
+  // Predicted lateness of the previous batch, which delays the set up
+  std::chrono::microseconds carried_over_us{0};
+
+  // Boundary time not hidden by the idle time, without carried over lateness
+  std::chrono::microseconds getExposedUs() const {
+    return needed_us > available_us ? needed_us - available_us
+                                    : std::chrono::microseconds(0);
+  }
+  std::chrono::microseconds getPredictedLatenessUs() const {
+    std::chrono::microseconds late_us =
+        needed_us + carried_over_us - available_us;
+    return late_us.count() > 0 ? late_us : std::chrono::microseconds(0);
+  }
+};
+
+/*
+BatchPartition: the batches as ranges of step indices; batch i contains the
+steps [batch_starts[i], batch_starts[i + 1]) (the last one up to the end) and
+is executed as batch_kinds[i].
+*/
+struct BatchPartition {
+  std::vector<size_t> batch_starts;
+  std::vector<BatchKind> batch_kinds;
+  // One per batch after the first, following the programmed state (see
+  // DeviceState)
+  std::vector<BoundaryPrediction> boundaries;
+  // Sum over the batch boundaries of the boundary time not covered by the
+  // idle time before the batch (BoundaryPrediction::getExposedUs())
+  std::chrono::microseconds exposed_setup_us{0};
+
+  size_t getBatchCount() const { return batch_starts.size(); }
+  size_t getPredictedLateCount() const {
+    size_t n_late = 0;
+    for (const auto& boundary : boundaries) {
+      if (boundary.getPredictedLatenessUs().count() > 0) {
+        n_late++;
+      }
+    }
+    return n_late;
+  }
+  size_t getBatchEnd(size_t i_batch, size_t n_steps) const {
+    return i_batch + 1 < batch_starts.size() ? batch_starts[i_batch + 1]
+                                             : n_steps;
+  }
+};
+
+/*
+End of the SinglePulses batch starting at steps[first], or first if there is
+none. The batch takes single pulses (n_pulses 1) and the breaks between them
+as long as the dark time after a pulse is too short to set up a batch of one
+pulse step in (BatchCostModel::estimateBoundaryUs()), and ends with the
+breaks after the last one. It must not fit in one PulseChainBatch (otherwise
+that does the same in hardware), and the host must be able to
+switch every edge: pulse widths and non-zero dark gaps are at least
+getMinSoftwareEdgeUs().
+*/
+size_t singlePulsesEnd(const std::vector<ProtocolStep>& steps, size_t first,
+                       const BatchCostModel& model);
+/*
+End of the batch starting at steps[first] with BatchPlanning::Greedy, and its
+kind: the original ProtocolPlanner::getNextBatch() rule, except that a run of
+single pulses is one SinglePulses batch (see singlePulsesEnd()), and that an
+LED may be used again as long as the timing unit takes another signal for it
+(BatchCostModel::signals_per_channel) with the same brightness. A break at
+first is a batch of its own, together with the breaks right after it. Only
+looks at the steps up to the returned end and the one after it (and the
+breaks after a single pulse).
+*/
+size_t greedyBatchEnd(const std::vector<ProtocolStep>& steps, size_t first,
+                      const BatchCostModel& model, BatchKind& kind);
+// Shortest time between two brightness calls of a SinglePulsesBatch: twice
+// the estimated call duration, half of it left for the host timing jitter
+std::chrono::microseconds getMinSoftwareEdgeUs(const BatchCostModel& model);
+
+BatchPartition partitionBatches(const std::vector<ProtocolStep>& steps,
+                                BatchPlanning planning,
+                                const BatchCostModel& model);
+
+#endif  // BATCH_PARTITIONING_HPP
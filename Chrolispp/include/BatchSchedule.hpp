@@ -0,0 +1,79 @@
+#ifndef BATCH_SCHEDULE_HPP
+#define BATCH_SCHEDULE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "BatchPartitioning.hpp"
+#include "DeviceState.hpp"
+#include "ProtocolStep.hpp"
+#include "TriggerChaining.hpp"
+
+/*
+BatchBlock: a sequence of unique batches (indices into
+BatchSchedule::unique_batches) executed repetitions times in a row.
+*/
+struct BatchBlock {
+  std::vector<size_t> batches;
+  size_t repetitions;
+};
+
+/*
+BatchSchedule: the batches of a BatchPartition with the repeated ones folded,
+so that a protocol of one block repeated hundreds of times needs one batch
+object (and one BatchProgram) per distinct batch instead of one per
+repetition:
+- unique_batches: every distinct batch at its first occurrence in the
+  partition. Two batches are the same if their steps are the same apart from
+  the step ids. With BatchExecution::HardwareTrigger, a unique batch may be a
+  trigger chain of several batches of the partition.
+- blocks: the partition in order, as runs of repeated blocks. A single batch
+  that does not repeat is a block with one batch and 1 repetition.
+*/
+struct BatchSchedule {
+  std::vector<ScheduledBatch> unique_batches;
+  std::vector<BatchBlock> blocks;
+
+  // Number of batches executed, i.e. of batch starts by the host (the batch
+  // count of the partition without trigger chains)
+  size_t getExecutedBatchCount() const {
+    size_t n_batches = 0;
+    for (const auto& block : blocks) {
+      n_batches += block.batches.size() * block.repetitions;
+    }
+    return n_batches;
+  }
+};
+
+/*
+Find the repeated blocks of at most max_block_batches batches in the
+partition of steps. At every position, the block length that covers the most
+batches with its repetitions is taken (the shortest one on a tie), e.g.
+A B C A B C A B C D becomes (A B C) x 3, D.
+*/
+BatchSchedule scheduleBatches(
+    const std::vector<ProtocolStep>& steps, const BatchPartition& partition,
+    BatchExecution execution = BatchExecution::Host,
+    const BatchCostModel& model = BatchCostModel(),
+    size_t max_block_batches = 16);
+
+/*
+Redo the boundary predictions of the partition for the schedule, given the
+program of every unique batch (nullptr: nothing to program). A batch started
+by a trigger point needs nothing from the host (needed and available time
+0), it is only late by the lateness carried over from its chain start. The
+start of a trigger chain needs the set up of the whole chain program and its
+trigger lead.
+*/
+void predictScheduledBoundaries(
+    const std::vector<ProtocolStep>& steps, const BatchSchedule& schedule,
+    const std::vector<const BatchProgramView*>& programs,
+    const BatchCostModel& model, BatchPartition& partition);
+
+// One line per block, e.g. "3 x batches 2 3 4", prefixed with prefix
+std::string dumpBatchSchedule(const BatchSchedule& schedule,
+                              const std::string& prefix = "");
+
+#endif  // BATCH_SCHEDULE_HPP
@@ -0,0 +1,43 @@
+#ifndef BATCH_TELEMETRY_HPP
+#define BATCH_TELEMETRY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+BatchTelemetry: timing record of one executed batch, filled in by
+ProtocolPlanner::executeProtocol(). Start times are relative to the planned
+start of the protocol (the first step), so actual_start_us - planned_start_us
+is how late (or early, if negative) the batch started.
+*/
+struct BatchTelemetry {
+  uint32_t batch_id;
+  std::chrono::microseconds planned_start_us;
+  std::chrono::microseconds actual_start_us;
+  std::chrono::microseconds setup_duration_us;    // setUpThisBatch()
+  std::chrono::microseconds execute_duration_us;  // execute()
+  // How far past the deadline the wait for the batch start ended. 0 if the
+  // set up itself ran past the deadline (no wait), see lateness instead.
+  std::chrono::microseconds sleep_overshoot_us;
+
+  std::chrono::microseconds getLatenessUs() const {
+    return actual_start_us - planned_start_us;
+  }
+};
+
+/*
+Write the records as CSV with a header line, times in microseconds. Throws
+std::runtime_error if the file cannot be written.
+*/
+void writeBatchTelemetryCsv(const std::vector<BatchTelemetry>& telemetry,
+                            const std::string& filename);
+/*
+Multi-line summary (min/p50/p90/p99/max) of lateness, set up duration, execute
+duration and sleep overshoot over all records.
+*/
+std::string summarizeBatchTelemetry(
+    const std::vector<BatchTelemetry>& telemetry);
+
+#endif  // BATCH_TELEMETRY_HPP
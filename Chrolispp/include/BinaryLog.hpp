@@ -0,0 +1,90 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "LogRecords.hpp"
+
+/*
+Binary run log written by Logger (LogFormat::Binary) and read by
+chrolispp-logdump. Integers are little-endian; "varint" is the LEB128 encoding
+(7 bits per byte, low bits first), "zigzag" maps signed values to unsigned
+ones (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) before the varint encoding.
+- File header (32 bytes): magic "CHRLOGB1", uint32 version, uint32 reserved,
+  int64 wall clock (ns since the Unix epoch) and int64 steady clock (ns) taken
+  at the same instant, to convert record times to local time.
+- Records, each:
+  - uint8: RecordKind in the low nibble, LogType in the high nibble,
+  - zigzag varint: steady clock ns minus that of the previous record (of the
+    header for the first record),
+  - varint: payload size, followed by the payload:
+    - kind Text: the message bytes.
+    - kind Event: varint LogEvent, varint batch id, varint step id + 1 (0 for
+      LogEventData::NO_STEP), zigzag varint status, varint n_args, n_args x
+      varint args.
+A device call event takes about 20 bytes instead of about 120 as a text line.
+*/
+namespace BinaryLog {
+constexpr char MAGIC[8] = {'C', 'H', 'R', 'L', 'O', 'G', 'B', '1'};
+constexpr uint32_t VERSION = 1;
+constexpr std::string_view FILE_EXTENSION = ".chrlog";
+
+enum class RecordKind : uint8_t { Text = 0, Event = 1 };
+
+struct Header {
+  uint32_t version;
+  int64_t wall_clock_ns;
+  int64_t steady_clock_ns;
+};
+
+struct Entry {
+  int64_t steady_ns;
+  LogType type;
+  RecordKind kind;
+  std::string text;    // kind Text
+  LogEventData event;  // kind Event
+};
+
+/*
+Writer: writes the header on construction, then one record per call. Records
+must be written in the order of their steady clock times for compact deltas
+(out of order is allowed, just larger).
+*/
+class Writer {
+ public:
+  Writer(std::ostream& out, const Header& header);
+  void writeText(int64_t steady_ns, LogType type, std::string_view text);
+  void writeEvent(int64_t steady_ns, LogType type, const LogEventData& event);
+
+ private:
+  std::ostream& out;
+  int64_t last_ns;
+
+  void writeRecord(int64_t steady_ns, RecordKind kind, LogType type,
+                   const char* payload, size_t size);
+};
+
+/*
+Reader: reads the header on construction (throws std::runtime_error if the
+stream is not a binary run log), then one entry per next() call.
+*/
+class Reader {
+ public:
+  explicit Reader(std::istream& in);
+  const Header& getHeader() const { return header; }
+  // Read the next entry. Returns false at the end of the log; throws
+  // std::runtime_error on a truncated or malformed record.
+  bool next(Entry& entry);
+
+ private:
+  std::istream& in;
+  Header header;
+  int64_t last_ns;
+};
+}  // namespace BinaryLog
+
+#endif  // BINARY_LOG_HPP
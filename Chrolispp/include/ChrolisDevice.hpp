@@ -0,0 +1,83 @@
+#ifndef CHROLIS_DEVICE_HPP
+#define CHROLIS_DEVICE_HPP
+
+#include "visatype.h"
+
+/*
+ChrolisDevice: the subset of the TL6WL driver API that the planner, the batches
+and the LED helper functions use. Every method mirrors the TL6WL_* function of
+the same name (without the instrument handle) and returns its ViStatus, so
+call sites keep the usual "if (VI_SUCCESS != err)" error handling.
+Implementations:
+- TL6WLDevice: forwards to the vendor driver (Windows only, needs TL6WL_xx.lib).
+- SimulatedDevice: software model of the Chrolis with configurable call
+  latencies and a recorded LED timeline, for benchmarking and timing
+  regression checks without hardware.
+*/
+
+// The ChrolisDevice methods, e.g. to index per-call latencies
+enum class DeviceCall {
+  SetHeadPowerStates = 0,
+  SetHeadBrightness,
+  SetLinearModeValue,
+  ResetSequence,
+  AddSelfRunningSignal,
+  AddTriggeredSignal,
+  AddTriggerPoint,
+  LoopBackTrigger,
+  StartStopGenerator,
+  Close,
+  Count  // number of call types, keep last
+};
+
+class ChrolisDevice {
+ public:
+  virtual ~ChrolisDevice() = default;
+
+  virtual ViStatus setLED_HeadPowerStates(ViBoolean led1, ViBoolean led2,
+                                          ViBoolean led3, ViBoolean led4,
+                                          ViBoolean led5, ViBoolean led6) = 0;
+  virtual ViStatus setLED_HeadBrightness(ViUInt16 led1, ViUInt16 led2,
+                                         ViUInt16 led3, ViUInt16 led4,
+                                         ViUInt16 led5, ViUInt16 led6) = 0;
+  virtual ViStatus setLED_LinearModeValue(ViUInt16 value) = 0;
+  virtual ViStatus TU_ResetSequence() = 0;
+  /*
+  signalNr: 1-6 are the LED channels, 7-12 the corresponding breakout box
+  (BOB) TTL outputs.
+  */
+  virtual ViStatus TU_AddGeneratedSelfRunningSignal(ViUInt8 signalNr,
+                                                    ViBoolean activeLow,
+                                                    ViUInt32 startDelayus,
+                                                    ViUInt32 activeTimeus,
+                                                    ViUInt32 inactiveTimeus,
+                                                    ViUInt32 repetitionCount) = 0;
+  /*
+  Like a self-running signal, but the pattern (start delay, then
+  repetitionCount pulses) starts every time a trigger point fires for the
+  signal, instead of once at the generator start.
+  */
+  virtual ViStatus TU_AddGeneratedTriggeredSignal(ViUInt8 signalNr,
+                                                  ViBoolean activeLow,
+                                                  ViUInt32 startDelayus,
+                                                  ViUInt32 activeTimeus,
+                                                  ViUInt32 inactiveTimeus,
+                                                  ViUInt32 repetitionCount) = 0;
+  /*
+  Append a trigger point to the sequence. The trigger points are armed one
+  after the other, the first one at the generator start. An armed trigger
+  point fires after edgeCount edges of signal signalNr (0: at once), starting
+  the triggered signals in affectedSignalBitmask (bit 0: signal 1), and arms
+  the next one.
+  */
+  virtual ViStatus TU_AddTriggerPoint(ViUInt8 signalNr, ViBoolean startsLow,
+                                      ViUInt32 edgeCount,
+                                      ViInt16 affectedSignalBitmask) = 0;
+  // After the last trigger point fired, arm trigger point refTrigPoint (1:
+  // the first one) again, i.e. repeat until the generator is stopped
+  virtual ViStatus TU_LoopBackTrigger(ViUInt32 refTrigPoint) = 0;
+  virtual ViStatus TU_StartStopGeneratorOutput_TU(ViBoolean start) = 0;
+  virtual ViStatus close() = 0;
+};
+
+#endif  // CHROLIS_DEVICE_HPP
@@ -0,0 +1,166 @@
+#ifndef DEVICE_STATE_HPP
+#define DEVICE_STATE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ProtocolStep.hpp"
+#include "constants.hpp"
+#include "visatype.h"
+
+/*
+GeneratorSignal: the parameters of one TU_AddGeneratedSelfRunningSignal()
+call, or TU_AddGeneratedTriggeredSignal() if triggered, see ChrolisDevice.
+*/
+struct GeneratorSignal {
+  ViUInt8 signal_nr;
+  ViBoolean active_low;
+  ViUInt32 start_delay_us;
+  ViUInt32 active_us;
+  ViUInt32 inactive_us;
+  ViUInt32 repetitions;
+  bool triggered = false;
+
+  bool operator==(const GeneratorSignal& other) const = default;
+};
+
+// The parameters of one TU_AddTriggerPoint() call, see ChrolisDevice
+struct TriggerPoint {
+  ViUInt8 signal_nr;
+  ViBoolean starts_low;
+  ViUInt32 edge_count;
+  ViInt16 affected_signal_bitmask;
+
+  bool operator==(const TriggerPoint& other) const = default;
+};
+
+/*
+BatchProgram: everything a PulseChainBatch sends to the device, compiled from
+its steps at plan time, so that setUpThisBatch() and execute() only loop over
+it:
+- signals: an LED and a breakout box signal per pulse step, in step order,
+  each starting after the startup guard and the steps before it,
+- brightness: head brightness, 0 for the LEDs the steps do not use,
+- power_states: head power states while the batch runs, on for the LEDs the
+  steps use,
+- trigger_points: added after the signals, only for a trigger chain (see
+  compileTriggerChain()),
+- startup_delay_us: start delay of the first step, i.e. how long before its
+  planned start the batch starts the generator.
+*/
+struct BatchProgram {
+  std::vector<GeneratorSignal> signals;
+  std::vector<uint32_t> signal_step_ids;  // step of every signal, for logging
+  std::vector<TriggerPoint> trigger_points;
+  ViUInt32 startup_delay_us = Constants::STARTUP_GUARD_US;
+  std::array<ViUInt16, 6> brightness = {0, 0, 0, 0, 0, 0};
+  std::array<ViBoolean, 6> power_states = {VI_FALSE, VI_FALSE, VI_FALSE,
+                                           VI_FALSE, VI_FALSE, VI_FALSE};
+};
+
+/*
+BatchProgramView: a BatchProgram whose signals and trigger points are stored
+elsewhere, e.g. in the ProgramArena of all batches of a protocol, so that a
+batch holding it takes no allocation of its own. Valid as long as the storage
+is. A BatchProgram converts to a view of itself (like std::string to
+std::string_view).
+*/
+struct BatchProgramView {
+  std::span<const GeneratorSignal> signals;
+  std::span<const uint32_t> signal_step_ids;
+  std::span<const TriggerPoint> trigger_points;
+  ViUInt32 startup_delay_us = Constants::STARTUP_GUARD_US;
+  std::array<ViUInt16, 6> brightness = {0, 0, 0, 0, 0, 0};
+  std::array<ViBoolean, 6> power_states = {VI_FALSE, VI_FALSE, VI_FALSE,
+                                           VI_FALSE, VI_FALSE, VI_FALSE};
+
+  BatchProgramView() = default;
+  BatchProgramView(const BatchProgram& program)
+      : signals(program.signals),
+        signal_step_ids(program.signal_step_ids),
+        trigger_points(program.trigger_points),
+        startup_delay_us(program.startup_delay_us),
+        brightness(program.brightness),
+        power_states(program.power_states) {}
+};
+
+// Throws std::logic_error if a start delay does not fit the 32-bit timing
+// unit (the batch partitioning ends batches before that, see
+// greedyBatchEnd())
+BatchProgram compileBatchProgram(std::span<const ProtocolStep> steps);
+// The same into program, reusing the capacity of its vectors, e.g. when
+// compiling the batches of a long protocol one after the other
+void compileBatchProgram(std::span<const ProtocolStep> steps,
+                         BatchProgram& program);
+/*
+The program of a SinglePulsesBatch: one self-running signal per LED the steps
+use that stays active from the generator start until the end of the last
+pulse (after the startup guard), so that the pulses are switched by the head
+brightness alone (0 in the program). No breakout box signals. Throws
+std::logic_error like compileBatchProgram() if the signal is too long.
+*/
+BatchProgram compileSinglePulsesProgram(std::span<const ProtocolStep> steps);
+void compileSinglePulsesProgram(std::span<const ProtocolStep> steps,
+                                BatchProgram& program);
+/*
+The program as text, one line per signal and trigger point and one each for
+brightness, power states and startup delay, every line starting with prefix,
+e.g. "signal  1 active_low 0 start_delay_us 20000 active_us 5000 inactive_us
+5000 repetitions 2 step 2", e.g. to diff the programs of two plans.
+*/
+std::string dumpBatchProgram(const BatchProgramView& program,
+                             const std::string& prefix = "");
+
+/*
+BatchSetUp: the timing unit and head calls needed to get from the programmed
+state to a BatchProgram (the generator is always stopped first):
+- reset: TU_ResetSequence(), then all signals are added,
+- otherwise the programmed signals are the start of the program and only the
+  n_added_signals missing ones are added (n_added_triggered_signals of them
+  triggered ones), then the n_added_trigger_points missing trigger points,
+- set_brightness: setLED_HeadBrightness() unless the brightness is unchanged.
+*/
+struct BatchSetUp {
+  bool reset = true;
+  size_t n_added_signals = 0;
+  bool set_brightness = true;
+  size_t n_added_triggered_signals = 0;
+  size_t n_added_trigger_points = 0;
+
+  // Programming everything, e.g. if the device state is unknown
+  static BatchSetUp full(size_t n_signals) { return {true, n_signals, true}; }
+  static BatchSetUp full(const BatchProgramView& program);
+};
+
+/*
+DeviceState: shadow copy of what the batches programmed into the device, so
+that a batch only issues the calls that change something. std::nullopt means
+unknown (nothing programmed through this state yet, or a call failed), which
+makes the next batch program everything. Only valid as long as nothing else
+changes the device between the batches.
+*/
+struct DeviceState {
+  std::optional<std::vector<GeneratorSignal>> signals;  // signal table
+  std::optional<std::vector<TriggerPoint>> trigger_points;
+  std::optional<std::array<ViUInt16, 6>> brightness;
+  std::optional<std::array<ViBoolean, 6>> power_states;
+
+  void forget() {
+    signals.reset();
+    trigger_points.reset();
+    brightness.reset();
+    power_states.reset();
+  }
+  BatchSetUp diff(const BatchProgramView& program) const;
+  // The signals, trigger points and brightness of program are programmed
+  // (reusing the capacity of the vectors), e.g. to predict the set up of the
+  // next batch
+  void setProgrammed(const BatchProgramView& program);
+};
+
+#endif  // DEVICE_STATE_HPP
@@ -1,7 +1,8 @@
 
 #ifndef DURATION_AND_UNIT_HPP
 
-#include "TL6WL.h"
+#include "visatype.h"
+#include <cstdint>
 #include <string>
 
 #define DURATION_AND_UNIT_HPP
@@ -13,17 +14,18 @@ struct DurationAndUnit {
 
 /// <summary>
 ///  Given a duration in microseconds, find the most appropriate unit (us or ms).
+///  A duration too long for 32-bit us is in ms, rounded to the nearest ms.
 /// </summary>
 /// <param name="duration_us">The duration in us</param>
 /// <returns></returns>
-inline DurationAndUnit findDurationAndUnit(ViUInt32 duration_us) {
+inline DurationAndUnit findDurationAndUnit(uint64_t duration_us) {
     DurationAndUnit result;
-    if (duration_us % 1000 == 0) {
-        result.duration = duration_us / 1000;
+    if (duration_us % 1000 == 0 || duration_us > UINT32_MAX) {
+        result.duration = static_cast<ViUInt32>((duration_us + 500) / 1000);
         result.unit = "ms";
     }
     else {
-        result.duration = duration_us;
+        result.duration = static_cast<ViUInt32>(duration_us);
         result.unit = "us";
     }
     return result;
@@ -1,20 +1,18 @@
 #ifndef INITIAL_BREAK_BATCH_HPP
 #define INITIAL_BREAK_BATCH_HPP
-#include <vector>
+#include <span>
 
 #include "ProtocolBatch.hpp"
 
 class InitialBreakBatch : public ProtocolBatch {
  public:
-  InitialBreakBatch(unsigned short batch_id, ViSession instr, const std::vector<ProtocolStep>& steps, Logger* logger_ptr);
+  InitialBreakBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                    std::span<const ProtocolStep> steps, Logger* logger_ptr);
 
-  std::chrono::microseconds getBusyDurationUs() const override;
-  std::chrono::microseconds getTotalDurationUs() const override;
-  std::chrono::microseconds execute() override;
-  void setUpNextBatch(ProtocolBatch& next_batch) override;
-  void setUpThisBatch() override;
-  char* toChars(const std::string& prefix,
-                const std::string& step_level_prefix) override;
+  std::chrono::microseconds execute();
+  void setUpThisBatch();
+  void appendTo(std::string& out, const std::string& prefix,
+                const std::string& step_level_prefix) const;
 };
 
 #endif  // INITIAL_BREAK_BATCH_HPP
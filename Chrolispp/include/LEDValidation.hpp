@@ -0,0 +1,30 @@
+#ifndef LED_VALIDATION_HPP
+#define LED_VALIDATION_HPP
+
+#include <exception>
+#include <string>
+
+#include "visatype.h"
+
+/*
+Platform-independent parameter checks for the LED machine. The functions that
+drive the device directly (and need Windows) are in LEDFunctions.hpp.
+*/
+bool LED_ValidateLEDIndex(ViUInt16 led_index);
+bool LED_ValidateParams(ViUInt16 led_index, ViUInt32 n_pulses,
+                        ViUInt16& brightness);
+bool LED_ValidateBrightness(ViUInt16& brightness);
+std::string readBoxStatusWarnings(ViUInt32 boxStatus);
+class led_machine_error : public std::exception {
+ public:
+  explicit led_machine_error(const std::string& message) : message_(message) {}
+
+  virtual const char* what() const noexcept override {
+    return message_.c_str();
+  }
+
+ private:
+  std::string message_;
+};
+
+#endif  // LED_VALIDATION_HPP
@@ -0,0 +1,83 @@
+#ifndef LOG_RECORDS_HPP
+#define LOG_RECORDS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// The numeric values are stored in binary logs, append new types only
+enum class LogType : uint8_t { Trace, Error, Info, Protocol, Warning };
+
+// Order for level filtering: Trace < Info < Protocol < Warning < Error
+constexpr int logTypeSeverity(LogType type) {
+  switch (type) {
+    case LogType::Trace:
+      return 0;
+    case LogType::Info:
+      return 1;
+    case LogType::Protocol:
+      return 2;
+    case LogType::Warning:
+      return 3;
+    case LogType::Error:
+      return 4;
+  }
+  return 4;
+}
+
+/*
+LogEvent: typed log records. Instead of building a message string on the
+time-critical path, the call site logs the event type, batch and step id, the
+ViStatus and up to LogEventData::MAX_ARGS numeric arguments. They are
+rendered to text only when written to a text log, or by chrolispp-logdump
+from a binary log.
+*/
+enum class LogEvent : uint16_t {
+  // TL6WL calls, args are the call arguments (without the instrument handle)
+  SetHeadPowerStates = 0,
+  SetHeadBrightness,
+  SetLinearModeValue,
+  ResetSequence,
+  AddSelfRunningSignal,
+  StartStopGenerator,
+  Close,
+  // Planner events
+  BatchLate,  // args: lateness in us
+  // TL6WL trigger calls, after BatchLate to keep the values of older logs
+  AddTriggeredSignal,
+  AddTriggerPoint,
+  LoopBackTrigger,
+  Count       // number of event types, keep last
+};
+
+struct LogEventData {
+  static constexpr size_t MAX_ARGS = 8;
+  static constexpr uint32_t NO_STEP = UINT32_MAX;  // not about a single step
+
+  LogEvent event;
+  uint8_t n_args;
+  uint8_t reserved;
+  uint32_t batch_id;
+  uint32_t step_id;  // or NO_STEP
+  int32_t status;    // ViStatus
+  uint32_t args[MAX_ARGS];
+
+  static LogEventData make(LogEvent event, uint32_t batch_id, uint32_t step_id,
+                           int32_t status,
+                           std::initializer_list<uint32_t> args);
+};
+
+const char* logTypeString(LogType type);  // e.g. "[TRACE]"
+// Parse a level name, e.g. "trace" or "WARNING". Returns false if unknown.
+bool parseLogType(std::string_view name, LogType& type);
+const char* logEventName(LogEvent event);  // e.g. "TU_ResetSequence"
+/*
+Render an event as a log message, e.g.
+"TU_AddGeneratedSelfRunningSignal(1, 0, 20000, 5000, 5000, 2) = 0 (batch 2,
+step 3)".
+*/
+std::string renderLogEvent(const LogEventData& data);
+
+#endif  // LOG_RECORDS_HPP
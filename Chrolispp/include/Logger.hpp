@@ -1,43 +1,257 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
+#include <atomic>
 #include <chrono>
-#include <ctime>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 
-enum class LogType { Trace, Error, Info, Protocol, Warning };
+#include "BinaryLog.hpp"
+#include "LogRecords.hpp"
+#include "TimestampFormatter.hpp"
 
-struct LogMessage {
+enum class LogFormat {
+  Text,   // one "timestamp\t[TYPE]\tmessage" line per message
+  Binary  // BinaryLog records, render with chrolispp-logdump
+};
+
+/*
+LogRecord: one fixed-size slot of the Logger ring buffer. Messages longer than
+TEXT_CAPACITY span several consecutive records, all but the last one flagged
+CONTINUED. Records flagged EVENT hold a LogEventData instead of text.
+*/
+struct LogRecord {
+  static constexpr size_t TEXT_CAPACITY = 116;
+  static constexpr uint8_t CONTINUED = 1;
+  static constexpr uint8_t EVENT = 2;
+
+  int64_t ticks;  // steady_clock ticks at log time
   LogType type;
-  std::string timestamp;
-  std::string message;
+  uint8_t flags;
+  uint16_t length;  // bytes used in text
+  char text[TEXT_CAPACITY];
 };
+static_assert(sizeof(LogRecord) == 128, "LogRecord should be two cache lines");
+static_assert(sizeof(LogEventData) <= LogRecord::TEXT_CAPACITY,
+              "LogEventData must fit into one LogRecord");
 
+/*
+Logger: asynchronous logger. log() and the level functions only copy the
+message into a single-producer/single-consumer ring buffer of LogRecords
+together with the raw steady_clock time; a background writer thread formats
+the records and writes them to the file.
+- Log calls must come from one thread at a time (the producer). The writer
+  thread is the only consumer.
+- The writer drains the ring periodically; flush() blocks until everything
+  logged before the call is written to the file.
+- Memory use is fixed by the ring capacity. If the ring is full, the caller
+  wakes the writer and waits for room, so no message is lost; only inside a
+  busy window, where the caller must not block, is the message dropped
+  instead. The number of dropped messages is written to the log as a
+  warning.
+- Busy windows (beginBusyWindow()/endBusyWindow(), or a BusyWindow guard)
+  mark time-critical stretches, e.g. a batch between starting the generator
+  and turning the LEDs off. The writer does no formatting or file I/O inside
+  a busy window; beginBusyWindow() waits for the line being written, if any.
+  When a busy window ends with the ring filled to the high-water mark or
+  beyond, the writer is woken immediately to make room before the next one.
+- Messages below the minimum level (setMinLevel(), see logTypeSeverity()) are
+  discarded at the call. The printf-style functions (logf(), tracef(), ...)
+  only format their arguments if the level is enabled, so call sites should
+  use them instead of building strings.
+- Compiling with CHROLISPP_STRIP_TRACE defined removes trace messages and
+  trace events: the checks are compile-time constants and the calls are
+  optimized away, including their arguments.
+*/
 class Logger {
  public:
-  explicit Logger(const std::string& filename);
+  static constexpr size_t DEFAULT_RING_CAPACITY = 8192;  // records, 1 MiB
+#ifdef CHROLISPP_STRIP_TRACE
+  static constexpr bool TRACE_COMPILED = false;
+#else
+  static constexpr bool TRACE_COMPILED = true;
+#endif
+
+  /*
+  format: a text log is appended to, a binary log is overwritten.
+  ring_capacity: number of LogRecords, rounded up to a power of two.
+  high_water_mark: fill level (records) at which the writer is woken as soon
+  as no busy window is active; 0 means half the capacity.
+  */
+  explicit Logger(const std::string& filename,
+                  LogFormat format = LogFormat::Text,
+                  size_t ring_capacity = DEFAULT_RING_CAPACITY,
+                  size_t high_water_mark = 0);
   ~Logger();
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  // Messages less severe than level are discarded. Default: LogType::Trace
+  void setMinLevel(LogType level) {
+    min_severity.store(logTypeSeverity(level), std::memory_order_relaxed);
+  }
+  bool isEnabled(LogType type) const {
+    if constexpr (!TRACE_COMPILED) {
+      if (type == LogType::Trace) {
+        return false;
+      }
+    }
+    return logTypeSeverity(type) >=
+           min_severity.load(std::memory_order_relaxed);
+  }
+
   void log(LogType type,
-           const std::string& message);    // The generic log function
-  void trace(const std::string& message);  // technical log messages get a \t
-                                           // for easier readability
-  void info(const std::string& message);   // general information messages
-  void multiLineInfo(char* msg);           // for multi-line info messages
-  void multiLineProtocol(char* msg);       // for multi-line protocol messages
-  void error(const std::string& message);  // for critical errors
+           std::string_view message);    // The generic log function
+  // Typed record (see LogEvent), no string is built by the caller
+  void event(LogType type, LogEvent event, uint32_t batch_id, uint32_t step_id,
+             int32_t status, std::initializer_list<uint32_t> args = {}) {
+    if (isEnabled(type)) {
+      logEvent(type, event, batch_id, step_id, status, args);
+    }
+  }
+  /*
+  printf-style message, formatted only if type is enabled. Arguments must be
+  numbers or C strings (std::string: pass .c_str()).
+  */
+  template <typename... Args>
+  void logf(LogType type, const char* format, const Args&... args) {
+    if (isEnabled(type)) {
+      formatAndLog(type, format, args...);
+    }
+  }
+  template <typename... Args>
+  void tracef(const char* format, const Args&... args) {
+    logf(LogType::Trace, format, args...);
+  }
+  template <typename... Args>
+  void infof(const char* format, const Args&... args) {
+    logf(LogType::Info, format, args...);
+  }
+  template <typename... Args>
+  void protocolf(const char* format, const Args&... args) {
+    logf(LogType::Protocol, format, args...);
+  }
+  template <typename... Args>
+  void warningf(const char* format, const Args&... args) {
+    logf(LogType::Warning, format, args...);
+  }
+  template <typename... Args>
+  void errorf(const char* format, const Args&... args) {
+    logf(LogType::Error, format, args...);
+  }
+  // technical log messages get a \t for easier readability
+  void trace(std::string_view message) {
+    if (isEnabled(LogType::Trace)) {
+      log(LogType::Trace, message);
+    }
+  }
+  void info(std::string_view message);   // general information messages
+  void multiLineInfo(std::string_view msg);  // for multi-line info messages
+  void multiLineProtocol(
+      std::string_view msg);  // for multi-line protocol messages
+  void error(std::string_view message);  // for critical errors
   void warning(
-      const std::string& message);  // for warnings that are not critical errors
+      std::string_view message);  // for warnings that are not critical errors
   void protocol(
-      const std::string& message);  // for logging experiment protocol
-                                    // steps (most relevant for the user)
+      std::string_view message);  // for logging experiment protocol
+                                  // steps (most relevant for the user)
+  // Blocks until all messages are written. Not allowed inside a busy window.
   void flush();
+  void beginBusyWindow();
+  void endBusyWindow();
+  // Marks a busy window for the lifetime of the guard
+  class BusyWindow {
+   public:
+    explicit BusyWindow(Logger& logger) : logger(logger) {
+      logger.beginBusyWindow();
+    }
+    ~BusyWindow() { logger.endBusyWindow(); }
+    BusyWindow(const BusyWindow&) = delete;
+    BusyWindow& operator=(const BusyWindow&) = delete;
+
+   private:
+    Logger& logger;
+  };
+  // Number of messages dropped so far because the ring buffer was full
+  // inside a busy window
+  uint64_t getDroppedCount() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
 
  private:
   std::ofstream logFile;
-  std::vector<LogMessage> buffer;
-  std::string getTimestamp();
-  std::string format(const LogMessage& msg);
+  std::unique_ptr<BinaryLog::Writer> binary_writer;  // LogFormat::Binary only
+  // Ring buffer: capacity is a power of two, head and tail count records
+  // ever written/consumed (index = count & mask).
+  std::unique_ptr<LogRecord[]> ring;
+  size_t ring_mask;
+  alignas(64) std::atomic<uint64_t> head{0};  // written by the producer
+  uint64_t cached_tail = 0;  // producer's last seen tail, avoids sharing
+  alignas(64) std::atomic<uint64_t> tail{0};  // written by the writer
+  std::atomic<uint64_t> dropped{0};
+  uint64_t dropped_reported = 0;  // writer only
+  size_t high_water_mark;
+  // Handshake between producer and writer: neither may be inside its part
+  // while the other one is (busy window / writing a line).
+  std::atomic<bool> busy{false};
+  std::atomic<bool> writer_active{false};
+  std::atomic<int> min_severity{logTypeSeverity(LogType::Trace)};
+
+  TimestampFormatter timestamp_formatter;  // writer only
+
+  std::thread writer;
+  std::mutex writer_mutex;
+  std::condition_variable writer_wakeup;
+  std::condition_variable flush_done;
+  std::condition_variable room_available;  // the writer drained the ring
+  std::atomic<bool> waiting_for_room{false};
+  bool stop_requested = false;
+  uint64_t flush_requests = 0;
+  uint64_t flushes_done = 0;
+
+  void writerLoop();
+  // Writer thread only. Returns false if interrupted by a busy window.
+  bool drain(bool ignore_busy);
+  bool enterWrite(bool ignore_busy);
+  void leaveWrite() { writer_active.store(false); }
+  // Reserve n_records slots, waiting for the writer to make room if full.
+  // Returns false (and counts a drop) inside a busy window or if n_records
+  // exceeds the capacity.
+  bool reserve(size_t n_records, uint64_t& current_head);
+  bool hasRoom(size_t n_records, uint64_t current_head);
+  void logEvent(LogType type, LogEvent event, uint32_t batch_id,
+                uint32_t step_id, int32_t status,
+                std::initializer_list<uint32_t> args);
+  template <typename... Args>
+  void formatAndLog(LogType type, const char* format, const Args&... args) {
+    static_assert(((std::is_arithmetic_v<Args> ||
+                    std::is_pointer_v<std::decay_t<Args>>) &&
+                   ...),
+                  "Logger::logf(): arguments must be numbers or C strings");
+    char buffer[LogRecord::TEXT_CAPACITY * 4];
+    int length = std::snprintf(buffer, sizeof(buffer), format, args...);
+    if (length < 0) {
+      return;
+    }
+    if (static_cast<size_t>(length) < sizeof(buffer)) {
+      log(type, std::string_view(buffer, length));
+      return;
+    }
+    std::string message(length, '\0');
+    std::snprintf(message.data(), message.size() + 1, format, args...);
+    log(type, message);
+  }
+  void writeLine(LogType type, int64_t ticks, std::string_view message);
+  void writeEvent(LogType type, int64_t ticks, const LogEventData& data);
 };
 
 #endif  // LOGGER_HPP
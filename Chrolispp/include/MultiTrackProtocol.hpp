@@ -0,0 +1,107 @@
+#ifndef MULTI_TRACK_PROTOCOL_HPP
+#define MULTI_TRACK_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "DeviceState.hpp"
+#include "ProtocolStep.hpp"
+#include "visatype.h"
+
+/*
+TrackPulseTrain: n_pulses pulses of one LED (pulse_width_us on,
+time_between_pulses_us off after every pulse) starting start_us after the
+start of the protocol. The times of the pulses are 32-bit like those of a
+ProtocolStep, the start and end are 64-bit.
+*/
+struct TrackPulseTrain {
+  ViUInt16 led_index;
+  uint64_t start_us;
+  ViUInt32 pulse_width_us;
+  ViUInt32 time_between_pulses_us;
+  ViUInt32 n_pulses;
+  ViUInt16 brightness;
+
+  // End of the last pulse
+  uint64_t getLastEdgeUs() const {
+    return getEndUs() - time_between_pulses_us;
+  }
+  // End of the dark time after the last pulse
+  uint64_t getEndUs() const {
+    return start_us + static_cast<uint64_t>(n_pulses) *
+                          (static_cast<uint64_t>(pulse_width_us) +
+                           time_between_pulses_us);
+  }
+};
+
+/*
+MultiTrackProtocol: stimuli that overlap in time, e.g. a 470 nm pulse train
+with a 590 nm pulse in the middle of it, which the sequential ProtocolStep
+list cannot describe. Every track is a list of pulse trains with absolute
+start times, in order and not overlapping each other; the tracks run in
+parallel. Two trains of one LED must not overlap, whichever tracks they are
+in.
+*/
+struct MultiTrackProtocol {
+  std::vector<std::vector<TrackPulseTrain>> tracks;
+
+  size_t getTrainCount() const;
+  // End of the last dark time of all trains
+  uint64_t getDurationUs() const;
+};
+
+/*
+TrackSegment: trains of a MultiTrackProtocol that are programmed at once and
+run as one PulseChainBatch, each train as an LED and a breakout box signal
+starting at its own start delay:
+- steps: the trains as pulse steps (us mode), in order of their start, for
+  logging,
+- start_us: start of the first train of the segment, i.e. the planned start
+  of the batch,
+- busy_end_us: end of the last pulse of the segment,
+- end_us: start of the next segment (the end of the protocol for the last
+  one), the dark time from busy_end_us on is where the next one is set up.
+*/
+struct TrackSegment {
+  std::vector<ProtocolStep> steps;
+  BatchProgram program;
+  uint64_t start_us;
+  uint64_t busy_end_us;
+  uint64_t end_us;
+};
+
+/*
+Merge the tracks into segments in order of the train starts. A train is added
+to the current segment as long as the timing unit can take it (one brightness
+per LED, at most model.signals_per_channel trains per LED, see
+probeSignalsPerChannel(), and a 32-bit start delay, i.e. up to about 71 min
+after the start of the segment), so that overlapping trains run on the
+device.
+Otherwise a new segment starts with it, which needs all trains of the current
+segment to have ended by then (the host reprograms the device in between).
+Step ids count the trains from 1 in order of their start.
+Throws std::invalid_argument if the protocol is empty, a train is invalid
+(LED index, brightness, no pulses or no pulse width), the trains of a track
+are out of order or overlap, two trains of one LED overlap, or trains that
+overlap cannot be programmed at once.
+*/
+std::vector<TrackSegment> compileTrackSegments(
+    const MultiTrackProtocol& protocol, const BatchCostModel& model);
+
+/*
+Multi-track protocol CSV: one pulse train per row with 7 columns, track
+(non-negative integer, rows of one track in order), start, LED index, pulse
+width, time between pulses, number of pulses and brightness, and an
+optional 8th us mode column (1: start and times in us, otherwise ms), see
+the README. Throws std::runtime_error if the file cannot be read or a row is
+malformed, e.g. a pulse width longer than 32-bit us.
+*/
+MultiTrackProtocol readMultiTrackCSV(const std::string& filename);
+// Whether the first row of the CSV file has the 7 or 8 columns of a
+// multi-track protocol (and not the 5 or 6 of a sequential one)
+bool isMultiTrackCSV(const std::string& filename);
+
+#endif  // MULTI_TRACK_PROTOCOL_HPP
@@ -0,0 +1,48 @@
+#ifndef PROGRAM_ARENA_HPP
+#define PROGRAM_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "DeviceState.hpp"
+#include "ProtocolStep.hpp"
+
+/*
+ProgramArena: the signals and trigger points of the programs of many batches
+(e.g. of all unique batches of a protocol) in one vector each, so that a
+batch only holds a BatchProgramView of its range and programming a long
+protocol takes a fixed number of allocations instead of some per batch.
+The capacity is reserved up front (see countSignalsBound()) and never grows
+afterwards, as that would move the programs under the views: add() throws
+std::logic_error if a program does not fit. Moving the arena keeps the views
+valid.
+
+// Usage:
+ProgramArena programs;
+programs.reserve(ProgramArena::countSignalsBound(steps), 0);
+BatchProgramView program = programs.addBatchProgram(steps);
+*/
+class ProgramArena {
+ public:
+  // Most signals the programs of steps can have: an LED and a breakout box
+  // signal per pulse step, for any batch kind and for trigger chains
+  static size_t countSignalsBound(std::span<const ProtocolStep> steps);
+
+  void reserve(size_t n_signals, size_t n_trigger_points);
+  // Copy the signals and trigger points of program into the arena
+  BatchProgramView add(const BatchProgramView& program);
+  // The program of compileBatchProgram() or compileSinglePulsesProgram(),
+  // compiled without an allocation of its own
+  BatchProgramView addBatchProgram(std::span<const ProtocolStep> steps);
+  BatchProgramView addSinglePulsesProgram(std::span<const ProtocolStep> steps);
+
+ private:
+  std::vector<GeneratorSignal> signals;
+  std::vector<uint32_t> signal_step_ids;
+  std::vector<TriggerPoint> trigger_points;
+  BatchProgram compiled;  // reused by addBatchProgram() and the like
+};
+
+#endif  // PROGRAM_ARENA_HPP
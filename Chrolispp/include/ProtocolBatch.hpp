@@ -1,5 +1,5 @@
 /*
-* An interface for batch classes with custom setup, execution ... logic.
+* The common part of the batch classes with custom setup, execution ... logic.
 A batch is a group of protocol steps that can be programmed at once. It may not
 start with a break (except possibly the first batch in the sequence, as the
 setup of the first step is not time-critical), and may or may not end with a
@@ -10,134 +10,177 @@ a batch. These are the fundamentally different types:
   first batch in the sequence.
 - Sequence of pulse trains/chains: each LED can be used only once in the batch,
   i.e. if a step uses an LED that is already used in the batch, this step
-  should be in the next batch (this is the restriction of the LED machine).
+  should be in the next batch (this is the restriction of the LED machine,
+  unless probeSignalsPerChannel() finds that it takes several signals per
+  channel).
   Breaks (0 brightness) can be anywhere in the batch except in the very end.
 - Sequence of single pulses, i.e. n_pulses = 1; they can be with or without a
     trailing break (the latter is called gapless). These can be controlled in a
     different manner (directly manipulating brightness without reprogramming the
 LED machine and without using its internal clock). The timing is handled inside
 this software. Any number of single pulses can be in one batch, even if they
-    use the same LED.
+    use the same LED. See SinglePulsesBatch.
 */
 
 #ifndef PROTOCOL_BATCH_HPP
 #define PROTOCOL_BATCH_HPP
 #include <chrono>
+#include <cstdio>
 #include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "ChrolisDevice.hpp"
+#include "DeviceState.hpp"
 #include "Logger.hpp"
 #include "ProtocolStep.hpp"
+#include "Timing.hpp"
 #include "constants.hpp"
 /*
  Usage:
- - Create a derived class from ProtocolBatch, implementing the pure virtual
-  functions.
-  - Create an instance of the derived class, passing a vector of ProtocolStep
-  instances, a VI Instrument handle (see Chrolis example code) and a pointer to
- a Logger instance to the constructor.
+ - Derive a batch class from ProtocolBatch, implementing execute(),
+  setUpThisBatch() and appendTo() (and getStartupDelayUs() and getProgram() if
+  it programs the device), and add it to the kinds of Batch (Batch.hpp). The
+  functions are not virtual: a Batch holds one of the kinds by value and
+  dispatches to it, so that the batches of a protocol are one contiguous
+  std::vector<Batch> without an allocation per batch.
+  - Create a Batch of the class, passing a span of ProtocolStep
+  instances (not copied: the batch refers to them, so they must outlive it,
+  e.g. a range of the ProtocolPlanner steps), a pointer to a ChrolisDevice (TL6WLDevice wrapping the VI
+  Instrument handle, or a SimulatedDevice) and a pointer to a Logger instance
+  to the constructor.
   - If only one batch:
     - Call setUpThisBatch() to set up the batch (e.g. program the LED
     machine).
     - Call execute() to execute the batch. This returns the actual time taken
     in microseconds.
-    - Sleep for (total_duration_ms - busy_duration_ms) time.
-  - If multiple batches: use a std::vector of pointers to the batch instances.
+    - Sleep until the planned end of the batch.
+  - If multiple batches: use a std::vector of Batch.
       - For the first batch:
           - Call current_batch.setUpThisBatch() to set up the batch (e.g.
             program the LED machine). This step is not time-critical, as the
             sequence is not yet running.
           - Call execute() to execute the first batch. This starts the first
  batch (and the time critical part).
-          - Call setUpNextBatch(next_batch). This automatically waits for the
-            rest of the duration remaining from the total_duration_ms (or not
- wait if already behind schedule).
+          - Call setUpNextBatch(next_batch, deadline). This automatically waits
+            until the deadline at which next_batch.execute() has to be called
+            (or does not wait if already behind schedule).
     - For each subsequent batch:
         - Call execute() on the current batch.
-        - Call current_batch.setUpNextBatch(next_batch) (if available)
-        - If current_batch is the last, wait for (total_duration_ms -
- busy_duration_ms).
+        - Call current_batch.setUpNextBatch(next_batch, deadline) (if
+          available)
+        - If current_batch is the last, wait until the planned end of the
+ batch.
+  Deadlines are absolute: the planned start of a batch (sum of the total
+  durations of all batches before it, counted from one epoch) minus its
+  getStartupDelayUs(), so timing errors of one batch do not carry over to the
+  next.
 */
 class ProtocolBatch {
  public:
-  ProtocolBatch(unsigned short batch_id, ViSession instr,
-                const std::vector<ProtocolStep>& steps, Logger* logger_ptr)
+  ProtocolBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                std::span<const ProtocolStep> steps, Logger* logger_ptr)
       : batch_id(batch_id),
-        instr(instr),
+        device_ptr(device_ptr),
         logger_ptr(logger_ptr),
         protocol_steps(steps),
         busy_duration_us(0),
         total_duration_us(0) {};
-  virtual ~ProtocolBatch() = default;
 
-  virtual std::chrono::microseconds getBusyDurationUs() const = 0;
-  virtual std::chrono::microseconds getTotalDurationUs() const = 0;
-  virtual std::chrono::microseconds execute() = 0;
-  unsigned short getBatchId() const { return batch_id; }
+  std::chrono::microseconds getBusyDurationUs() const {
+    return busy_duration_us;
+  }
+  std::chrono::microseconds getTotalDurationUs() const {
+    return total_duration_us;
+  }
+  /*
+  Time from calling execute() until the first step of the batch starts, e.g.
+  the start delay the signal generator is programmed with. execute() has to be
+  called this much ahead of the planned start of the batch.
+  */
+  std::chrono::microseconds getStartupDelayUs() const {
+    return std::chrono::microseconds(0);
+  }
+  uint32_t getBatchId() const { return batch_id; }
   std::string getBatchType() const { return batch_type; }
 
   /*
   set_up_next_batch() should be called after execute(), in the time between
-  busy_duration_ms elapsed and the total total_duration_ms. It should set up
-  the next batch (e.g. program the LED machine) so that it is ready to be
-  started immediately after total_duration_ms elapsed. set_up_next_batch()
-  throws an error if called before execute().
+  busy_duration_ms elapsed and the total total_duration_ms. It sets up the
+  next batch (next_batch.setUpThisBatch(), e.g. program the LED machine) and
+  then waits until next_execute_deadline, the time at which
+  next_batch.execute() has to be called. Returns the time the set up took.
+  set_up_next_batch() throws an error if called before execute().
+  NextBatch is a Batch, or a batch class.
   */
-  virtual void setUpNextBatch(
-      ProtocolBatch& next_batch) = 0;  // TODO: this function is implemented the
-                                       // same way for each implementation! Need
-                                       // to avoid repeating code...
-  virtual void setUpThisBatch() = 0;
-  virtual char* toChars(const std::string& prefix,
-                        const std::string& step_level_prefix) = 0;
+  template <typename NextBatch>
+  std::chrono::microseconds setUpNextBatch(
+      NextBatch& next_batch, Timing::Clock::time_point next_execute_deadline);
+  // What the batch programs into the device, nullptr if nothing (e.g. a
+  // break)
+  const BatchProgramView* getProgram() const { return nullptr; }
 
  protected:
-  unsigned short batch_id;  // number of different ids is 65535
-  std::string batch_type;   // type of batch, e.g. InitialBreakBatch,
-                            // PulseChainBatch, SinglePulsesBatch
-  ViSession instr;
+  uint32_t batch_id;
+  const char* batch_type = "";  // type of batch, e.g. InitialBreakBatch,
+                                // PulseChainBatch, SinglePulsesBatch
+  ChrolisDevice* device_ptr;
   Logger* logger_ptr;
-  std::vector<ProtocolStep> protocol_steps;
+  std::span<const ProtocolStep> protocol_steps;  // owned by the caller
   std::chrono::microseconds busy_duration_us;
   std::chrono::microseconds total_duration_us;
   bool execute_attempted = false;  // Block running execute() more than once
-                                   // (even if execute() did not succeed)
+                                   // per set up (even if execute() did not
+                                   // succeed). A batch of a repeated block is
+                                   // set up and executed again.
+  // Log a device call of this batch as a typed event: trace level if it
+  // succeeded, error level otherwise
+  void logEvent(LogEvent event, uint32_t step_id, ViStatus status,
+                std::initializer_list<uint32_t> args = {}) {
+    logger_ptr->event(status == VI_SUCCESS ? LogType::Trace : LogType::Error,
+                      event, batch_id, step_id, status, args);
+  }
   /*
-  Convert batch to printable chars message.
-  The caller is responsible for deleting the returned char array.
-  batchName: name of the batch, e.g. "Batch 1"
+  Append the batch to out: a line describing the batch after prefix, then one
+  line per step after step_level_prefix.
+  batch_name: name of the batch, e.g. "PulseChainBatch"
   prefix: prefix only for the first line (describing the batch), e.g. "\t"
   step_level_prefix: prefix for each step line, e.g. "\t\t"
   */
-  char* batchToChars(const std::string& batchName, const std::string& prefix,
-                     const std::string& step_level_prefix) {
-    const int buffer_size =
-        Constants::BATCH_HEADER_CHARS_BUFFERSIZE + prefix.length() +
-        protocol_steps.size() *
-            (Constants::STEP_CHARS_BUFFERSIZE + step_level_prefix.length());
-    char* batchChars = new char[buffer_size];
-    std::snprintf(batchChars, buffer_size, "%s%s (id %hu) with %zu step(s):\n",
-                  prefix.c_str(), batchName.c_str(), batch_id,
-                  protocol_steps.size());
-    for (auto& step : protocol_steps) {
-      char* stepChars = step.toChars(step_level_prefix);
-      // Use strncat_s if available, otherwise use strncat with bounds
-      // checking
-#ifdef _MSC_VER  // Check if compiling with Microsoft Visual Studio
-      // strncat_s the step level prefix first
-      strncat_s(batchChars, buffer_size, stepChars,
-                buffer_size - std::strlen(batchChars) - 1);
-      strncat_s(batchChars, buffer_size, "\n",
-                buffer_size - std::strlen(batchChars) - 1);
-#else
-      strncat(batchChars, stepChars, buffer_size - std::strlen(batchChars) - 1);
-      strncat(batchChars, "\n", buffer_size - std::strlen(batchChars) - 1);
-#endif
-      delete[] stepChars;
+  void appendBatchTo(std::string& out, const char* batch_name,
+                     const std::string& prefix,
+                     const std::string& step_level_prefix) const {
+    char line[96];
+    std::snprintf(line, sizeof(line), "%s (id %u) with %zu step(s):\n",
+                  batch_name, batch_id, protocol_steps.size());
+    out += prefix;
+    out += line;
+    for (const auto& step : protocol_steps) {
+      step.appendTo(out, step_level_prefix);
+      out += '\n';
     }
-    return batchChars;
   }
 };
 
+template <typename NextBatch>
+std::chrono::microseconds ProtocolBatch::setUpNextBatch(
+    NextBatch& next_batch, Timing::Clock::time_point next_execute_deadline) {
+  logger_ptr->tracef("%s setUpNextBatch()", batch_type);
+  if (!execute_attempted) {
+    throw std::logic_error(
+        "Cannot set up next batch before executing this batch.");
+  }
+  auto start = Timing::Clock::now();
+  next_batch.setUpThisBatch();
+  auto setup_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      Timing::Clock::now() - start);
+  // Wait for the rest of the break, if any left after the set up (returns
+  // immediately if already behind schedule)
+  Timing::precise_sleep_until(next_execute_deadline);
+  logger_ptr->tracef("%s setUpNextBatch() done.", batch_type);
+  return setup_duration_us;
+}
+
 #endif  // PROTOCOL_BATCH_HPP
@@ -1,16 +1,25 @@
 #ifndef PROTOCOL_PLANNER_HPP
 #define PROTOCOL_PLANNER_HPP
 
-#include <Windows.h>
-
-#include <optional>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
 #include <vector>
 
 #include "ArduinoCommands.hpp"
+#include "ArduinoLink.hpp"
+#include "Batch.hpp"
+#include "BatchGenerator.hpp"
+#include "BatchPartitioning.hpp"
+#include "BatchSchedule.hpp"
+#include "BatchTelemetry.hpp"
+#include "ChrolisDevice.hpp"
+#include "DeviceState.hpp"
 #include "Logger.hpp"
-#include "ProtocolBatch.hpp"
+#include "MultiTrackProtocol.hpp"
+#include "ProgramArena.hpp"
 #include "ProtocolStep.hpp"
-#include "TL6WL.h"
 #include "DurationAndUnit.hpp"
 
 enum ValidationResult {
@@ -20,7 +29,7 @@ enum ValidationResult {
   INVALID_BRIGHTNESS = 3
 };
 /*
-A ProtocolPlanner is responsible for managing a sequence of ProtocolSteps, validating them, and executing them in batches. It interacts with the TL6WL device and optionally an Arduino for timing control. 
+A ProtocolPlanner is responsible for managing a sequence of ProtocolSteps, validating them, and executing them in batches. It interacts with the TL6WL device (through a ChrolisDevice, which may also be a SimulatedDevice) and optionally an Arduino for timing control. 
 The class provides methods to set up the device, execute the protocol, and convert the protocol to a string representation for logging or display purposes.
 
  
@@ -29,9 +38,9 @@ The class provides methods to set up the device, execute the protocol, and conve
 
 #include "ProtocolPlanner.hpp"
 #include "ProtocolStep.hpp"
-#include "TL6WL.h"
+#include "SimulatedDevice.hpp"
 int main() {
-  ViSession instr = 0;
+  SimulatedDevice device;
   std::vector<ProtocolStep> protocolSteps;
   std::unique_ptr<Logger> logger;  // for accessing the logger outside try
   std::unique_ptr<ProtocolPlanner> planner;
@@ -42,41 +51,110 @@ int main() {
       protocolSteps.push_back(protocolStep);
   }
 
-  // Create ProtocolPlanner object with instr, protocolSteps and logger
-  //ProtocolPlanner planner(instr, protocolSteps, logger.get());
+  // Create ProtocolPlanner object with device, protocolSteps and logger
+  //ProtocolPlanner planner(&device, protocolSteps, logger.get());
   planner =
-    std::make_unique<ProtocolPlanner>(instr, protocolSteps, logger.get());
+    std::make_unique<ProtocolPlanner>(&device, protocolSteps, logger.get());
 }
 */
 class ProtocolPlanner {
  public:
-  ProtocolPlanner(ViSession instr, std::vector<ProtocolStep> protocolSteps,
-                  Logger* logger_ptr, std::optional<HANDLE> h_Serial);
+  ProtocolPlanner(ChrolisDevice* device_ptr,
+                  std::vector<ProtocolStep> protocolSteps,
+                  Logger* logger_ptr, ArduinoLink* arduino_ptr = nullptr,
+                  BatchPlanning planning = BatchPlanning::Greedy,
+                  const BatchCostModel& cost_model = BatchCostModel(),
+                  BatchExecution execution = BatchExecution::Host);
+  /*
+  Plan a multi-track protocol: one PulseChainBatch per segment of
+  compileTrackSegments() (after an InitialBreakBatch if the first train does
+  not start at 0), each executed once in order. getSteps() are the trains of
+  all segments. No Arduino, as its steps are sequential.
+  */
+  ProtocolPlanner(ChrolisDevice* device_ptr, const MultiTrackProtocol& protocol,
+                  Logger* logger_ptr,
+                  const BatchCostModel& cost_model = BatchCostModel());
+  /*
+  Run a protocol read from step_source while it is executed, e.g. a generated
+  one of any length: the batches are made on demand by a BatchGenerator (see
+  there for what differs from planning all steps), so memory does not grow
+  with the protocol, apart from the telemetry of the executed batches. Nothing
+  is planned before the run: getSteps(), the partition and the schedule are
+  empty, and the protocol can be executed once. No Arduino.
+  */
+  ProtocolPlanner(ChrolisDevice* device_ptr, StepSource step_source,
+                  Logger* logger_ptr,
+                  const BatchCostModel& cost_model = BatchCostModel());
   const std::vector<ProtocolStep>& getSteps() const { return steps; }
+  // Batch boundaries and the predicted timing of every batch start
+  const BatchPartition& getBatchPartition() const { return batch_partition_; }
+  // Repeated blocks of the partition, one batch object per unique batch
+  const BatchSchedule& getBatchSchedule() const { return batch_schedule_; }
+  /*
+  Multi-line report of the batch starts the cost model predicts to be late
+  (the set up does not fit in the idle time before the batch), at most
+  max_lines of them, to be shown before the protocol is started.
+  */
+  std::string summarizePredictedLateStarts(size_t max_lines = 10) const;
   void setUpDevice();
   void executeProtocol();
-  char* toChars(const std::string& prefix,
-                const std::string& batch_level_prefix,
-                const std::string& step_level_prefix);
+  // Timing record of every batch of the last executeProtocol() run
+  const std::vector<BatchTelemetry>& getTelemetry() const { return telemetry_; }
+  void writeTelemetryCsv(const std::string& filename) const;
+  // The BatchProgram of every unique batch as text (see dumpBatchProgram()),
+  // followed by the schedule (see dumpBatchSchedule()), e.g. to diff two
+  // plans of a protocol. Throws std::runtime_error if the file cannot be
+  // written.
+  std::string dumpBatchPrograms() const;
+  void writeBatchPrograms(const std::string& filename) const;
+  /*
+  The protocol as text: a line describing it after prefix, then every unique
+  batch (see ProtocolBatch::appendBatchTo(), batch lines after
+  batch_level_prefix and step lines after step_level_prefix), each followed by
+  an empty line. writeTo() renders the batches into out a chunk at a time, so
+  a long protocol is not held as text at once.
+  */
+  void writeTo(std::ostream& out, const std::string& prefix,
+               const std::string& batch_level_prefix,
+               const std::string& step_level_prefix) const;
+  std::string toString(const std::string& prefix,
+                       const std::string& batch_level_prefix,
+                       const std::string& step_level_prefix) const;
 
  private:
-  ViSession instr;
+  ChrolisDevice* device_ptr;
   bool batches_loaded = false;
   bool device_set_up = false;
   bool useArduino_ = false;
-  int i_next_batch_to_execute = 0;
+  // The only copy of the (merged) steps: the batches refer to ranges of it,
+  // so it is not changed once they are created
   std::vector<ProtocolStep> steps;
   size_t n_steps;
   Logger* logger_ptr;
-  HANDLE h_Serial_;
-  std::unique_ptr<ProtocolBatch> getNextBatch(unsigned short batch_id,
-                                              int& step_cursor);
+  ArduinoLink* arduino_ptr_ = nullptr;
+  BatchPlanning planning_;
+  BatchCostModel batch_cost_model_;
+  BatchExecution execution_;
+  BatchPartition batch_partition_;
+  BatchSchedule batch_schedule_;
+  // What the batches programmed into the device, shared by all batches
+  DeviceState device_state_;
   ValidationResult validateStep(ProtocolStep& step);
   void shutDownDevice();
   std::vector<ArduinoDataPacket> arduino_data_packets_;
-  std::vector<std::unique_ptr<ProtocolBatch>> batches;
-  void mergeSteps(std::vector<ProtocolStep>& protocolSteps);
-  std::vector<std::unique_ptr<ProtocolBatch>> translateToBatches();
+  // The programs of all batches, which refer to them like to the steps
+  ProgramArena programs_;
+  // One batch per unique batch of batch_schedule_, i.e. batches[i] has the
+  // steps of batch_schedule_.unique_batches[i] (all batches of a trigger
+  // chain) and batch id i + 1
+  std::vector<Batch> batches;
+  // Steps of a protocol whose batches are generated during the run
+  StepSource step_source_;
+  std::vector<BatchTelemetry> telemetry_;
+  std::vector<Batch> translateToBatches();
+  std::vector<Batch> translateTracksToBatches(
+      std::vector<TrackSegment> segments);
+  void appendHeaderTo(std::string& out, const std::string& prefix) const;
   void createArduinoDataPackets(int dac_resolution_bits);
   void sendDataPacketsToArduino(int dac_resolution_bits);
 };
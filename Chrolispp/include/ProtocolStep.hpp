@@ -1,15 +1,26 @@
 #ifndef PROTOCOL_STEP_HPP
 #define PROTOCOL_STEP_HPP
 
+#include <cstdint>
 #include <string>
-#include "TL6WL.h"  // class is specific to this equipment (ThorLabs 6 LED machine)
+#include <vector>
+
+#include "visatype.h"  // class is specific to this equipment (ThorLabs 6 LED machine)
+/*
+ProtocolStep: one row of a protocol. Its times are 32-bit microseconds, which
+is what the TL6WL timing unit takes; the constructor throws
+std::invalid_argument for a pulse width or time between pulses (after the
+conversion to us) longer than Constants::MAX_DEVICE_TIME_US. The duration of
+a step, and of a protocol, is 64-bit (getTotalDurationUs()), so that a long
+break is several break steps (see makeBreakSteps()).
+*/
 class ProtocolStep {
  public:
-  ProtocolStep(unsigned short step_id, ViUInt16 led_index,
+  ProtocolStep(uint32_t step_id, ViUInt16 led_index,
                ViUInt32 pulse_width, ViUInt32 time_between_pulses,
                ViUInt32 n_pulses, ViUInt16 brightness, bool is_us_mode);
 
-  unsigned short step_id;  // unique step ID. Index makes most sense.
+  uint32_t step_id;  // unique step ID. Index makes most sense.
   /// <summary>
   /// The LED index (0-5 for TL6WL).
   /// </summary>
@@ -52,14 +63,23 @@ class ProtocolStep {
   /// Get the total duration of the step in microseconds.
   /// </summary>
   /// <returns>The total duration in microseconds.</returns>
-  ViUInt32 getTotalDurationUs() const;
+  uint64_t getTotalDurationUs() const;
   /// <summary>
   /// Change the break duration of this step to the specified value (in us).
   /// </summary>
   /// <param name="break_duration_us"></param>
-  void setBreakDuration(int break_duration_us);
+  void setBreakDuration(ViUInt32 break_duration_us);
   void printStep();
-  char* toChars(const std::string& prefix);
+  // Append the step as one line (without the newline) to out, after prefix
+  void appendTo(std::string& out, const std::string& prefix) const;
 };
 
+/*
+A break of break_duration_us (a multiple of 5 us) as break steps of at most
+Constants::MAX_BREAK_STEP_US each, all with step_id, e.g. an overnight break
+between two stimulation sessions. No step for a break of 0 us.
+*/
+std::vector<ProtocolStep> makeBreakSteps(uint32_t step_id,
+                                         uint64_t break_duration_us);
+
 #endif  // PROTOCOL_STEP_HPP
@@ -1,38 +1,76 @@
 #ifndef PULSE_CHAIN_BATCH_HPP
 #define PULSE_CHAIN_BATCH_HPP
-#include <vector>
+#include <memory>
+#include <span>
 
+#include "DeviceState.hpp"
 #include "Logger.hpp"
+#include "ProgramArena.hpp"
 #include "ProtocolBatch.hpp"
 
 /*
 PulseChainBatch: Executes a series of steps with no configuration necessary
 in-between. The steps must
-1. Each have a different LED index (or be a break)
+1. Each have a different LED index (or be a break), unless the timing unit
+takes several signals per channel (BatchCostModel::signals_per_channel): then
+up to that many steps may use one LED, all with the same brightness
 2. Each may have 1 or more pulses (n_pulses >= 1) if not a break
 3. There must be a time between pulses that is > 0 (i.e. no "gapless pulses";
 for this, GaplessPulseBatch must be used)
 4. A break may only occur at the end of the batch (i.e. the last step may be a
 break)
+The signals, brightness and power states are compiled in the constructor
+into a ProgramArena (owned by the caller like the steps, e.g. the
+ProtocolPlanner's one for all batches) and not changed afterwards.
+If a DeviceState is given (shared by all batches of a protocol), the batch
+only issues the calls that change the programmed state, e.g. no reset and no
+signals if the previous batch programmed the same signals, and no brightness
+call if it is unchanged. Without one, everything is programmed.
+The batch may also run a precompiled program over the steps of several
+batches, e.g. a trigger chain (compileTriggerChain()), whose later batches
+are started by trigger points on the device instead of by the host, or the
+program of a segment of a multi-track protocol (compileTrackSegments()),
+whose steps overlap: then the busy and total duration are given, as the sum
+of the step durations is not its length.
 */
 
 class PulseChainBatch : public ProtocolBatch {
  public:
-  PulseChainBatch(unsigned short batch_id, ViSession instr,
-                  const std::vector<ProtocolStep>& steps, Logger* logger_ptr);
+  PulseChainBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                  std::span<const ProtocolStep> steps, Logger* logger_ptr,
+                  ProgramArena& programs, DeviceState* device_state = nullptr);
+  // program: stored by the caller, e.g. in a ProgramArena
+  PulseChainBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                  std::span<const ProtocolStep> steps, Logger* logger_ptr,
+                  BatchProgramView program,
+                  DeviceState* device_state = nullptr);
+  PulseChainBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                  std::span<const ProtocolStep> steps, Logger* logger_ptr,
+                  BatchProgramView program,
+                  std::chrono::microseconds busy_duration_us,
+                  std::chrono::microseconds total_duration_us,
+                  DeviceState* device_state = nullptr);
 
-  std::chrono::microseconds getBusyDurationUs() const override;
-  std::chrono::microseconds getTotalDurationUs() const override;
-  std::chrono::microseconds execute() override;
-  void setUpNextBatch(ProtocolBatch& next_batch) override;
-  void setUpThisBatch() override;
-  char* toChars(const std::string& prefix,
-                const std::string& step_level_prefix) override;
+  std::chrono::microseconds getStartupDelayUs() const;
+  std::chrono::microseconds execute();
+  void setUpThisBatch();
+  void appendTo(std::string& out, const std::string& prefix,
+                const std::string& step_level_prefix) const;
+  const BatchProgramView* getProgram() const { return &program; }
 
- private:
-  int led_mask = 0;
+ protected:
   bool has_trailing_break = false;  // Whether there
-  bool has_guard = false; // Whether the first step has a guard break (for very short pulses)
+  BatchProgramView program;  // not changed after the constructor
+  // Unknown, only made without a shared one (so that a batch of the planner
+  // does not carry one)
+  std::unique_ptr<DeviceState> own_device_state;
+  DeviceState* device_state_ptr;  // shared one, nullptr without
+
+  // The shared DeviceState, or the own one (not a pointer to it, so that the
+  // batch can be moved)
+  DeviceState& getDeviceState() {
+    return device_state_ptr != nullptr ? *device_state_ptr : *own_device_state;
+  }
 };
 
 #endif  // PULSE_CHAIN_BATCH_HPP
@@ -0,0 +1,33 @@
+#ifndef SERIAL_ARDUINO_LINK_HPP
+#define SERIAL_ARDUINO_LINK_HPP
+
+#include <Windows.h>
+
+#include "ArduinoCommands.hpp"
+#include "ArduinoLink.hpp"
+
+uint8_t sendCommandToArduino(HANDLE h_Serial, uint8_t command);
+uint16_t sendDataPacketToArduino(HANDLE h_Serial, ArduinoDataPacket& packet,
+                                 int dac_resolution_bits);
+
+/*
+SerialArduinoLink: ArduinoLink over an already opened and configured serial
+port (see COMFunctions.hpp). The handle is not closed by this class.
+*/
+class SerialArduinoLink : public ArduinoLink {
+ public:
+  explicit SerialArduinoLink(HANDLE h_Serial) : h_Serial(h_Serial) {}
+
+  uint8_t sendCommand(uint8_t command) override {
+    return sendCommandToArduino(h_Serial, command);
+  }
+  uint16_t sendDataPacket(ArduinoDataPacket& packet,
+                          int dac_resolution_bits) override {
+    return sendDataPacketToArduino(h_Serial, packet, dac_resolution_bits);
+  }
+
+ private:
+  HANDLE h_Serial;
+};
+
+#endif  // SERIAL_ARDUINO_LINK_HPP
@@ -0,0 +1,203 @@
+#ifndef SIMULATED_DEVICE_HPP
+#define SIMULATED_DEVICE_HPP
+
+#include <array>
+#include <chrono>
+#include <vector>
+
+#include "ChrolisDevice.hpp"
+
+/*
+SimulatedDevice: software model of a Chrolis for running the planner and the
+batches without hardware.
+- Every call blocks the caller for a configurable latency (busy-wait, so the
+  host-side timing looks like a USB round trip), then takes effect.
+- The timing unit keeps a signal table (TU_ResetSequence clears it,
+  TU_AddGeneratedSelfRunningSignal appends to it). Starting the generator takes
+  a snapshot of the table; the LED channels (signals 1-6) then follow their
+  programmed on/off pattern from the moment the start call returned. A
+  channel is active while any of its signals is. The number of signals per
+  channel can be limited (setMaxSignalsPerChannel()) to model a device that
+  only takes one, further ones are rejected with VI_ERROR_PARAMETER2.
+- Triggered signals (TU_AddGeneratedTriggeredSignal) start their pattern every
+  time a trigger point fires for them; a new start cuts the previous one
+  short. The trigger points (TU_AddTriggerPoint) are armed one after the other,
+  the first one at the generator start, and fire after edgeCount edges (rising
+  or falling, startsLow is not checked) of their signal after being armed, 0
+  edges meaning at once. TU_LoopBackTrigger arms trigger point refTrigPoint
+  (1-based) again after the last one fired.
+- Light is emitted by LED i while its signal is active AND its head power state
+  is on AND its brightness is > 0. getLedTimeline() reconstructs the exact
+  on/off edges of all LEDs from the recorded history.
+All times are nanoseconds since the simulator epoch (construction or
+resetHistory()).
+*/
+
+struct SimulatedSignal {
+  ViUInt8 signal_nr;
+  ViBoolean active_low;
+  ViUInt32 start_delay_us;
+  ViUInt32 active_us;
+  ViUInt32 inactive_us;
+  ViUInt32 repetitions;  // 0: repeat until the generator is stopped
+  bool triggered = false;  // started by trigger points, not the generator
+};
+
+struct SimulatedTriggerPoint {
+  ViUInt8 signal_nr;
+  ViBoolean starts_low;
+  ViUInt32 edge_count;
+  ViInt16 affected_signal_bitmask;
+};
+
+struct SimulatedCallRecord {
+  DeviceCall call;
+  std::chrono::nanoseconds begin;
+  std::chrono::nanoseconds end;  // time the call took effect
+  ViStatus status;
+};
+
+struct LedEdge {
+  std::chrono::nanoseconds time;
+  ViUInt16 led_index;   // 0-5
+  bool on;              // true: light turns on, false: light turns off
+  ViUInt16 brightness;  // brightness at an on edge, 0 at an off edge
+};
+
+class SimulatedDevice : public ChrolisDevice {
+ public:
+  // Rough USB round-trip times, to be replaced by measured values if known.
+  struct Latencies {
+    std::array<std::chrono::nanoseconds, static_cast<size_t>(DeviceCall::Count)>
+        per_call = {
+            std::chrono::microseconds(1000),  // SetHeadPowerStates
+            std::chrono::microseconds(1000),  // SetHeadBrightness
+            std::chrono::microseconds(1000),  // SetLinearModeValue
+            std::chrono::microseconds(500),   // ResetSequence
+            std::chrono::microseconds(500),   // AddSelfRunningSignal
+            std::chrono::microseconds(500),   // AddTriggeredSignal
+            std::chrono::microseconds(500),   // AddTriggerPoint
+            std::chrono::microseconds(500),   // LoopBackTrigger
+            std::chrono::microseconds(500),   // StartStopGenerator
+            std::chrono::microseconds(0),     // Close
+    };
+    std::chrono::nanoseconds& operator[](DeviceCall call) {
+      return per_call[static_cast<size_t>(call)];
+    }
+    std::chrono::nanoseconds operator[](DeviceCall call) const {
+      return per_call[static_cast<size_t>(call)];
+    }
+  };
+
+  SimulatedDevice();
+  explicit SimulatedDevice(const Latencies& latencies);
+
+  ViStatus setLED_HeadPowerStates(ViBoolean led1, ViBoolean led2,
+                                  ViBoolean led3, ViBoolean led4,
+                                  ViBoolean led5, ViBoolean led6) override;
+  ViStatus setLED_HeadBrightness(ViUInt16 led1, ViUInt16 led2, ViUInt16 led3,
+                                 ViUInt16 led4, ViUInt16 led5,
+                                 ViUInt16 led6) override;
+  ViStatus setLED_LinearModeValue(ViUInt16 value) override;
+  ViStatus TU_ResetSequence() override;
+  ViStatus TU_AddGeneratedSelfRunningSignal(ViUInt8 signalNr,
+                                            ViBoolean activeLow,
+                                            ViUInt32 startDelayus,
+                                            ViUInt32 activeTimeus,
+                                            ViUInt32 inactiveTimeus,
+                                            ViUInt32 repetitionCount) override;
+  ViStatus TU_AddGeneratedTriggeredSignal(ViUInt8 signalNr,
+                                          ViBoolean activeLow,
+                                          ViUInt32 startDelayus,
+                                          ViUInt32 activeTimeus,
+                                          ViUInt32 inactiveTimeus,
+                                          ViUInt32 repetitionCount) override;
+  ViStatus TU_AddTriggerPoint(ViUInt8 signalNr, ViBoolean startsLow,
+                              ViUInt32 edgeCount,
+                              ViInt16 affectedSignalBitmask) override;
+  ViStatus TU_LoopBackTrigger(ViUInt32 refTrigPoint) override;
+  ViStatus TU_StartStopGeneratorOutput_TU(ViBoolean start) override;
+  ViStatus close() override;
+
+  // Time since the simulator epoch.
+  std::chrono::nanoseconds now() const;
+  const Latencies& getLatencies() const { return latencies; }
+  void setLatencies(const Latencies& new_latencies) {
+    latencies = new_latencies;
+  }
+  const std::vector<SimulatedSignal>& getSignalTable() const {
+    return signal_table;
+  }
+  const std::vector<SimulatedTriggerPoint>& getTriggerPoints() const {
+    return trigger_points;
+  }
+  // 0: no limit (the default)
+  void setMaxSignalsPerChannel(size_t max_signals) {
+    max_signals_per_channel = max_signals;
+  }
+  bool isGeneratorRunning() const { return generator_running; }
+  const std::vector<SimulatedCallRecord>& getCallLog() const {
+    return call_log;
+  }
+  /*
+  Reconstruct all LED on/off edges (sorted by time) from the recorded history.
+  Signals of a generator run that is still active are evaluated as if the
+  generator kept running; infinitely repeating signals are cut at now().
+  */
+  std::vector<LedEdge> getLedTimeline() const;
+  /*
+  Forget the recorded history and the call log and restart the epoch. The
+  current device state (power states, brightness, signal table) is kept.
+  */
+  void resetHistory();
+
+ private:
+  struct PowerEvent {
+    std::chrono::nanoseconds time;
+    std::array<bool, 6> states;
+  };
+  struct BrightnessEvent {
+    std::chrono::nanoseconds time;
+    std::array<ViUInt16, 6> brightness;
+  };
+  struct GeneratorRun {
+    std::chrono::nanoseconds start;
+    std::chrono::nanoseconds stop;  // nanoseconds::max() while running
+    std::vector<SimulatedSignal> signals;
+    std::vector<SimulatedTriggerPoint> trigger_points;
+    ViUInt32 loop_back_trigger_point;  // 0: none
+  };
+
+  Latencies latencies;
+  std::chrono::steady_clock::time_point epoch;
+  std::array<bool, 6> power_states = {false, false, false,
+                                      false, false, false};
+  std::array<ViUInt16, 6> brightness = {0, 0, 0, 0, 0, 0};
+  ViUInt16 linear_mode_value = 0;
+  size_t max_signals_per_channel = 0;
+  bool generator_running = false;
+  std::vector<SimulatedSignal> signal_table;
+  std::vector<SimulatedTriggerPoint> trigger_points;
+  ViUInt32 loop_back_trigger_point = 0;
+  std::vector<PowerEvent> power_events;
+  std::vector<BrightnessEvent> brightness_events;
+  std::vector<GeneratorRun> generator_runs;
+  std::vector<SimulatedCallRecord> call_log;
+
+  // Busy-wait for the latency of the call, return the time it takes effect.
+  std::chrono::nanoseconds simulateLatency(DeviceCall call);
+  ViStatus record(DeviceCall call, std::chrono::nanoseconds begin,
+                  std::chrono::nanoseconds end, ViStatus status);
+  ViStatus addSignal(DeviceCall call, const SimulatedSignal& signal);
+  void stopGenerator(std::chrono::nanoseconds time);
+  /*
+  Start times of every signal of a run: the generator start for the
+  self-running signals, the times their trigger points fired for the
+  triggered ones. Trigger points firing at or after run_end are not followed
+  once the sequence looped back.
+  */
+  static std::vector<std::vector<std::chrono::nanoseconds>> signalStarts(
+      const GeneratorRun& run, std::chrono::nanoseconds run_end);
+};
+
+#endif  // SIMULATED_DEVICE_HPP
@@ -0,0 +1,50 @@
+#ifndef SINGLE_PULSES_BATCH_HPP
+#define SINGLE_PULSES_BATCH_HPP
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "DeviceState.hpp"
+#include "Logger.hpp"
+#include "PulseChainBatch.hpp"
+
+/*
+SinglePulsesBatch: a sequence of single pulses (n_pulses = 1) and breaks,
+timed by the host instead of the signal generator, so that any number of
+pulses fits in one batch, even if they use the same LED. The timing unit is
+only programmed with one gate signal per LED that stays active for the whole
+batch (compileSinglePulsesProgram(), set up like a PulseChainBatch with that
+program), the pulses are switched on and off by setting the head brightness
+at their edges. Coincident edges (gapless pulses) are one call.
+Every brightness call is issued call_lead_us ahead of its edge (the
+estimated call duration, see BatchCostModel), the edges are absolute
+deadlines from the start of the batch. Pulses and dark gaps shorter than a
+call cannot be timed this way, see singlePulsesEnd().
+The breakout box signals are not driven by a SinglePulsesBatch.
+*/
+
+class SinglePulsesBatch : public PulseChainBatch {
+ public:
+  SinglePulsesBatch(uint32_t batch_id, ChrolisDevice* device_ptr,
+                    std::span<const ProtocolStep> steps, Logger* logger_ptr,
+                    std::chrono::microseconds call_lead_us,
+                    ProgramArena& programs,
+                    DeviceState* device_state = nullptr);
+
+  std::chrono::microseconds execute();
+
+ private:
+  // Head brightness from time_us after the planned start of the batch on
+  struct BrightnessEdge {
+    std::chrono::microseconds time_us;
+    std::array<ViUInt16, 6> brightness;
+    uint32_t step_id;
+  };
+
+  std::vector<BrightnessEdge> edges;
+  std::chrono::microseconds call_lead_us;
+};
+
+#endif  // SINGLE_PULSES_BATCH_HPP
@@ -0,0 +1,94 @@
+#ifndef STEP_MERGING_HPP
+#define STEP_MERGING_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ProtocolStep.hpp"
+
+enum class CompatibilityStatus : int {
+  Incompatible = 0,
+  BothBreaks = 1,
+  CompatibleSameShape = 2,
+  CompatibleGaplessAndBreak = 3,
+  CompatibleGaplessAndSingle = 4,
+  // Only with split_gaps, see mergeSteps()
+  CompatibleAfterGapSplit = 5
+};
+
+/*
+Check if two steps (it is assumed that step2 follows step1 directly) are
+compatible and return:
+- Incompatible if not compatible,
+- BothBreaks if both are breaks (0 brightness),
+- CompatibleSameShape if both are non-breaks with the same led index,
+  brightness, pulse width and time between pulses,
+- CompatibleGaplessAndBreak if step1 is a gapless single pulse (i.e. time
+  between pulses = 0) and step2 is a break. The break becomes the time between
+  pulses of the merged step.
+- CompatibleGaplessAndSingle if step1 is a gapless single pulse and step2 is a
+  single pulse with the same led index and brightness. The pulse widths add
+  up, the time between pulses of step2 is kept.
+Steps are only compatible if the merged times and number of pulses still fit
+32 bits (Constants::MAX_DEVICE_TIME_US), e.g. the break steps of a long break
+(makeBreakSteps()) stay separate.
+Priorities (highest to lowest):
+1. CompatibleGaplessAndBreak
+2. CompatibleGaplessAndSingle
+3. CompatibleSameShape
+4. BothBreaks
+*/
+CompatibilityStatus stepsCompatibleForMerge(const ProtocolStep& step1,
+                                            const ProtocolStep& step2);
+
+/*
+MergeReport: what mergeSteps() did, to be logged after the pass instead of
+one message per merge.
+*/
+struct MergeReport {
+  // A step of the merged protocol that absorbed the steps following it
+  struct MergedStep {
+    size_t index;       // index in the merged protocol
+    size_t n_absorbed;  // number of original steps merged into it
+  };
+
+  size_t steps_before = 0;
+  size_t steps_after = 0;
+  // Number of merges per CompatibilityStatus (Incompatible stays 0)
+  size_t merge_counts[6] = {0, 0, 0, 0, 0, 0};
+  std::vector<MergedStep> merged_steps;
+
+  // Number of merges. A gap split keeps the number of steps.
+  size_t getMergeCount() const {
+    size_t merges = 0;
+    for (size_t count : merge_counts) {
+      merges += count;
+    }
+    return merges;
+  }
+  size_t getMergeCount(CompatibilityStatus status) const {
+    return merge_counts[static_cast<int>(status)];
+  }
+};
+
+/*
+Merge consecutive breaks and consecutive compatible steps (see
+stepsCompatibleForMerge()) in place, in a single pass: each step is either
+merged into the last kept step or moved next to it. A merged step keeps the
+id of its first step, e.g. if steps 2, 3, 4 are merged, the steps 1, 2, 3, 4,
+5 become 1, 2, 5.
+split_gaps: also merge a single pulse into the preceding pulse chain of the
+same shape if only its trailing gap is longer, by splitting the gap into the
+time between pulses of the chain and a break. E.g. 300 ms pulse, 300 ms break,
+300 ms pulse, 500 ms break becomes 2 x (300 ms pulse, 300 ms break) and a
+200 ms break: the LED is programmed once instead of twice, the timeline is
+unchanged. The break keeps the id of the split step.
+*/
+MergeReport mergeSteps(std::vector<ProtocolStep>& steps,
+                       bool split_gaps = false);
+
+// One line, e.g. "Merged 10 steps into 4: 6 merges (breaks: 2, ...)."
+std::string summarizeMergeReport(const MergeReport& report);
+
+#endif  // STEP_MERGING_HPP
@@ -0,0 +1,48 @@
+#ifndef TL6WL_DEVICE_HPP
+#define TL6WL_DEVICE_HPP
+
+#include "ChrolisDevice.hpp"
+#include "TL6WL.h"
+
+/*
+TL6WLDevice: ChrolisDevice backed by the ThorLabs TL6WL driver. The session
+must already be opened with TL6WL_init(); close() closes it.
+*/
+class TL6WLDevice : public ChrolisDevice {
+ public:
+  explicit TL6WLDevice(ViSession instr) : instr(instr) {}
+
+  ViSession getSession() const { return instr; }
+
+  ViStatus setLED_HeadPowerStates(ViBoolean led1, ViBoolean led2,
+                                  ViBoolean led3, ViBoolean led4,
+                                  ViBoolean led5, ViBoolean led6) override;
+  ViStatus setLED_HeadBrightness(ViUInt16 led1, ViUInt16 led2, ViUInt16 led3,
+                                 ViUInt16 led4, ViUInt16 led5,
+                                 ViUInt16 led6) override;
+  ViStatus setLED_LinearModeValue(ViUInt16 value) override;
+  ViStatus TU_ResetSequence() override;
+  ViStatus TU_AddGeneratedSelfRunningSignal(ViUInt8 signalNr,
+                                            ViBoolean activeLow,
+                                            ViUInt32 startDelayus,
+                                            ViUInt32 activeTimeus,
+                                            ViUInt32 inactiveTimeus,
+                                            ViUInt32 repetitionCount) override;
+  ViStatus TU_AddGeneratedTriggeredSignal(ViUInt8 signalNr,
+                                          ViBoolean activeLow,
+                                          ViUInt32 startDelayus,
+                                          ViUInt32 activeTimeus,
+                                          ViUInt32 inactiveTimeus,
+                                          ViUInt32 repetitionCount) override;
+  ViStatus TU_AddTriggerPoint(ViUInt8 signalNr, ViBoolean startsLow,
+                              ViUInt32 edgeCount,
+                              ViInt16 affectedSignalBitmask) override;
+  ViStatus TU_LoopBackTrigger(ViUInt32 refTrigPoint) override;
+  ViStatus TU_StartStopGeneratorOutput_TU(ViBoolean start) override;
+  ViStatus close() override;
+
+ private:
+  ViSession instr;
+};
+
+#endif  // TL6WL_DEVICE_HPP
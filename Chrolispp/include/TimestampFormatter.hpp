@@ -0,0 +1,46 @@
+#ifndef TIMESTAMP_FORMATTER_HPP
+#define TIMESTAMP_FORMATTER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+TimestampFormatter: renders raw steady_clock tick counts (as stored by the
+Logger at log time) as local wall-clock time "YYYY-MM-DD HH:MM:SS.mmm".
+The wall-clock time of a tick count is derived from one (system_clock,
+steady_clock) pair taken at construction, so timestamps are monotonic even if
+the system clock is adjusted during a run. The date/time part is cached per
+second; for consecutive lines within the same second only the milliseconds
+are rendered.
+*/
+class TimestampFormatter {
+ public:
+  static constexpr size_t LENGTH = 23;  // "YYYY-MM-DD HH:MM:SS.mmm"
+
+  TimestampFormatter();
+  // For tick counts recorded elsewhere, e.g. read from a binary log
+  TimestampFormatter(std::chrono::system_clock::time_point wall_epoch,
+                     std::chrono::steady_clock::time_point steady_epoch);
+  std::chrono::system_clock::time_point getWallEpoch() const {
+    return wall_epoch;
+  }
+  std::chrono::steady_clock::time_point getSteadyEpoch() const {
+    return steady_epoch;
+  }
+  /*
+  Write the timestamp of steady_ticks into out (LENGTH characters, no null
+  terminator). Returns LENGTH.
+  */
+  size_t format(int64_t steady_ticks, char* out);
+
+ private:
+  static constexpr size_t PREFIX_LENGTH = 19;  // "YYYY-MM-DD HH:MM:SS"
+
+  std::chrono::system_clock::time_point wall_epoch;
+  std::chrono::steady_clock::time_point steady_epoch;
+  int64_t cached_second;  // seconds since the Unix epoch of cached_prefix
+  char cached_prefix[PREFIX_LENGTH + 1];
+};
+
+#endif  // TIMESTAMP_FORMATTER_HPP
@@ -2,8 +2,26 @@
 #define TIMING_HPP
 #include <chrono>
 
+/*
+Timing: hybrid sleep for the time-critical parts of protocol execution.
+precise_sleep_until() lets the OS sleep for the bulk of the wait (so the CPU is
+not burnt for long breaks) and spin-waits on the steady clock for the last
+stretch. The amount by which the OS oversleeps a request is learned online
+(smoothed mean + 4 x mean deviation, per thread), and the OS sleep is cut short
+by that margin, so that the deadline is hit to within a few tens of
+microseconds. On Windows, the 1 ms timer resolution is requested once on first
+use and released at program exit.
+*/
 namespace Timing {
-void precise_sleep_for(std::chrono::milliseconds ms);
-}
+using Clock = std::chrono::steady_clock;
+
+void precise_sleep_until(Clock::time_point deadline);
+void precise_sleep_for(std::chrono::microseconds duration);
+/*
+Current estimate of the OS sleep overshoot of the calling thread, i.e. how
+early the OS sleep is ended before the spin phase takes over.
+*/
+std::chrono::microseconds sleep_overshoot_estimate();
+}  // namespace Timing
 
 #endif  // TIMING_HPP
@@ -0,0 +1,73 @@
+#ifndef TRIGGER_CHAINING_HPP
+#define TRIGGER_CHAINING_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "BatchCostModel.hpp"
+#include "BatchPartitioning.hpp"
+#include "DeviceState.hpp"
+#include "ProtocolStep.hpp"
+#include "constants.hpp"
+
+/*
+How ProtocolPlanner starts the batches:
+- Host: every batch is started by the host at its deadline (stop the
+  generator, program the batch, start the generator).
+- HardwareTrigger: runs of consecutive batches are programmed at once as a
+  trigger chain, in which every batch after the first one is started by a
+  trigger point on the last edge of the batch before it, i.e. from the
+  device clock. Only the chain start is timed by the host. Transitions the
+  device cannot express (see compileTriggerChain()) end the chain, the next
+  batch is then started by the host as with Host.
+*/
+enum class BatchExecution { Host, HardwareTrigger };
+
+/*
+ScheduledBatch: what the planner executes as one batch, the batches
+[first_batch, end_batch) of a BatchPartition. More than one batch only for a
+trigger chain, whose first batch starts trigger_lead_us after the generator
+start.
+*/
+struct ScheduledBatch {
+  size_t first_batch;
+  size_t end_batch;
+  ViUInt32 trigger_lead_us = Constants::STARTUP_GUARD_US;
+
+  size_t getBatchCount() const { return end_batch - first_batch; }
+  bool isTriggerChain() const { return getBatchCount() > 1; }
+};
+
+/*
+Split the partition into trigger chains, in order and covering all batches
+(a batch that cannot be chained, e.g. one that is not a BatchKind::PulseChain,
+is a ScheduledBatch of its own).
+next_same_batch[i] is the index of the next batch with the same steps as
+batch i, or the batch count if there is none: if the chain would run into it,
+the chain starts with the trigger lead that batch gets later on (so that its
+signals can be triggered again), provided the host can still set up the
+chain in the idle time before it.
+*/
+std::vector<ScheduledBatch> chainBatches(
+    const std::vector<ProtocolStep>& steps, const BatchPartition& partition,
+    const std::vector<size_t>& next_same_batch, const BatchCostModel& model);
+
+/*
+The program of a trigger chain. All signals are triggered signals, one per
+signal number: a batch whose signals are already in the program with other
+parameters (e.g. an LED used again with another pulse shape or lead), or
+whose LEDs are in the program with another brightness, cannot be chained.
+- Trigger point 1 fires at the generator start and starts the first batch,
+  which starts trigger_lead_us later.
+- Trigger point k + 1 counts the edges of the LED signal of the last pulse
+  step of batch k and fires at its last falling edge, starting batch k + 1
+  after the dark time left until its planned start. That step needs distinct
+  edges (a time between its pulses if there are several) and some dark time
+  after it.
+Throws std::logic_error if the batches cannot be chained, see chainBatches().
+*/
+BatchProgram compileTriggerChain(const std::vector<ProtocolStep>& steps,
+                                 const BatchPartition& partition,
+                                 const ScheduledBatch& chain);
+
+#endif  // TRIGGER_CHAINING_HPP
@@ -1,14 +1,28 @@
 #ifndef CONSTANTS_HPP
 #define CONSTANTS_HPP
+#include <cstddef>
+
+#include "visatype.h"
+
 namespace Constants {
-constexpr int BATCH_HEADER_CHARS_BUFFERSIZE =
-    48;  // Buffer size for ProtocolBatch header
 constexpr int STEP_CHARS_BUFFERSIZE =
-    128;  // Buffer size for ProtocolStep printing function
-constexpr int PROTOCOL_PLANNER_HEADER_CHARS_BUFFERSIZE = 30;
+    160;  // Buffer size for a ProtocolStep line (without prefix)
 constexpr int DAC_RESOLUTION_BITS =
     12;  // Default DAC resolution bits for Arduino
 // FIXME 20 ms is sometimes not enough, sometimes even too much guard time... What does it depend on? PC load, or something else?
-constexpr ViUInt32 STARTUP_GUARD_US = 20000;  // Startup guard time in microseconds. Intended to fix issue stemming from having to start the Chrolis internal generator and only then give power to the LED, resulting in skipped light pulses if they are too short.
+constexpr ViUInt32 STARTUP_GUARD_US = 20000;  // Startup guard time in microseconds. Intended to fix issue stemming from having to start the Chrolis internal generator and only then give power to the LED, resulting in skipped light pulses if they are too short. Batches are started this much ahead of their planned start, so the guard does not shift the protocol.
+// Longest time the TL6WL timing unit takes (start delays, pulse widths, times
+// between pulses are 32-bit microseconds), about 71.6 min. Longer breaks are
+// several break steps of at most MAX_BREAK_STEP_US (1 h) each.
+constexpr ViUInt32 MAX_DEVICE_TIME_US = 0xFFFFFFFF;
+constexpr ViUInt32 MAX_BREAK_STEP_US = 3600000000;
+constexpr long long LATE_START_TOLERANCE_US =
+    100;  // Batch starts later than this are logged as late
+// Estimated device call durations of the default BatchCostModel, until
+// measured with calibrateBatchCostModel()
+constexpr long long LED_CALL_ESTIMATE_US = 1000;  // setLED_* calls
+constexpr long long TU_CALL_ESTIMATE_US = 500;    // TU_* calls
+// Most signals per timing unit channel probeSignalsPerChannel() tries
+constexpr size_t MAX_PROBED_SIGNALS_PER_CHANNEL = 16;
 }  // namespace Constants
 #endif  // CONSTANTS_HPP
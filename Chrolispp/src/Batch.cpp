@@ -0,0 +1,39 @@
+#include "Batch.hpp"
+
+std::chrono::microseconds Batch::getStartupDelayUs() const {
+  return std::visit([](const auto& kind) { return kind.getStartupDelayUs(); },
+                    batch);
+}
+
+const BatchProgramView* Batch::getProgram() const {
+  return std::visit([](const auto& kind) { return kind.getProgram(); }, batch);
+}
+
+void Batch::setUpThisBatch() {
+  std::visit([](auto& kind) { kind.setUpThisBatch(); }, batch);
+}
+
+std::chrono::microseconds Batch::execute() {
+  return std::visit([](auto& kind) { return kind.execute(); }, batch);
+}
+
+std::chrono::microseconds Batch::setUpNextBatch(
+    Batch& next_batch, Timing::Clock::time_point next_execute_deadline) {
+  return std::visit(
+      [&](auto& kind) {
+        return kind.setUpNextBatch(next_batch, next_execute_deadline);
+      },
+      batch);
+}
+
+void Batch::appendTo(std::string& out, const std::string& prefix,
+                     const std::string& step_level_prefix) const {
+  std::visit(
+      [&](const auto& kind) { kind.appendTo(out, prefix, step_level_prefix); },
+      batch);
+}
+
+const ProtocolBatch& Batch::getBase() const {
+  return std::visit(
+      [](const auto& kind) -> const ProtocolBatch& { return kind; }, batch);
+}
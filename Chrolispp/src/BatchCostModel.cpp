@@ -0,0 +1,249 @@
+#include "BatchCostModel.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Timing.hpp"
+#include "constants.hpp"
+
+using std::chrono::microseconds;
+
+namespace {
+// Each pulse step is programmed as one LED and one breakout box signal
+constexpr size_t SIGNALS_PER_PULSE_STEP = 2;
+constexpr const char* STARTUP_DELAY_NAME = "StartupDelay";
+constexpr const char* SIGNALS_PER_CHANNEL_NAME = "SignalsPerChannel";
+
+// Names used in the cost model file, in DeviceCall order
+constexpr const char* DEVICE_CALL_NAMES[] = {
+    "SetHeadPowerStates", "SetHeadBrightness",    "SetLinearModeValue",
+    "ResetSequence",      "AddSelfRunningSignal", "AddTriggeredSignal",
+    "AddTriggerPoint",    "LoopBackTrigger",      "StartStopGenerator",
+    "Close"};
+static_assert(sizeof(DEVICE_CALL_NAMES) / sizeof(DEVICE_CALL_NAMES[0]) ==
+                  static_cast<size_t>(DeviceCall::Count),
+              "One name per DeviceCall");
+
+void checkCall(ViStatus err, const char* call_name) {
+  if (VI_SUCCESS != err) {
+    throw std::runtime_error(std::string("calibrateBatchCostModel(): ") +
+                             call_name + " failed.");
+  }
+}
+}  // namespace
+
+BatchCostModel::BatchCostModel()
+    : startup_delay_us(Constants::STARTUP_GUARD_US) {
+  call_us.fill(microseconds(Constants::TU_CALL_ESTIMATE_US));
+  (*this)[DeviceCall::SetHeadPowerStates] =
+      microseconds(Constants::LED_CALL_ESTIMATE_US);
+  (*this)[DeviceCall::SetHeadBrightness] =
+      microseconds(Constants::LED_CALL_ESTIMATE_US);
+  (*this)[DeviceCall::SetLinearModeValue] =
+      microseconds(Constants::LED_CALL_ESTIMATE_US);
+  (*this)[DeviceCall::Close] = microseconds(0);
+}
+
+microseconds BatchCostModel::estimateSetUpUs(const BatchSetUp& set_up) const {
+  long long n_self_running = static_cast<long long>(
+      set_up.n_added_signals - set_up.n_added_triggered_signals);
+  microseconds set_up_us =
+      (*this)[DeviceCall::StartStopGenerator] +
+      (*this)[DeviceCall::AddSelfRunningSignal] * n_self_running +
+      (*this)[DeviceCall::AddTriggeredSignal] *
+          static_cast<long long>(set_up.n_added_triggered_signals) +
+      (*this)[DeviceCall::AddTriggerPoint] *
+          static_cast<long long>(set_up.n_added_trigger_points);
+  if (set_up.reset) {
+    set_up_us += (*this)[DeviceCall::ResetSequence];
+  }
+  if (set_up.set_brightness) {
+    set_up_us += (*this)[DeviceCall::SetHeadBrightness];
+  }
+  return set_up_us;
+}
+
+microseconds BatchCostModel::estimateSetUpUs(size_t n_pulse_steps) const {
+  if (n_pulse_steps == 0) {
+    return microseconds(0);
+  }
+  return estimateSetUpUs(
+      BatchSetUp::full(SIGNALS_PER_PULSE_STEP * n_pulse_steps));
+}
+
+microseconds BatchCostModel::estimateBoundaryUs(const BatchSetUp& set_up,
+                                                bool after_pulse_batch) const {
+  microseconds boundary_us = estimateSetUpUs(set_up) + startup_delay_us;
+  if (after_pulse_batch) {
+    boundary_us += (*this)[DeviceCall::StartStopGenerator] +
+                   (*this)[DeviceCall::SetHeadPowerStates];
+  }
+  return boundary_us;
+}
+
+microseconds BatchCostModel::estimateBoundaryUs(size_t n_pulse_steps,
+                                                bool after_pulse_batch) const {
+  if (n_pulse_steps == 0) {
+    return microseconds(0);
+  }
+  return estimateBoundaryUs(
+      BatchSetUp::full(SIGNALS_PER_PULSE_STEP * n_pulse_steps),
+      after_pulse_batch);
+}
+
+void BatchCostModel::save(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::out | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open cost model file: " + filename);
+  }
+  file << "# Chrolis++ batch cost model, durations in microseconds\n";
+  for (size_t i = 0; i < call_us.size(); i++) {
+    file << DEVICE_CALL_NAMES[i] << ' ' << call_us[i].count() << '\n';
+  }
+  file << STARTUP_DELAY_NAME << ' ' << startup_delay_us.count() << '\n';
+  file << SIGNALS_PER_CHANNEL_NAME << ' ' << signals_per_channel << '\n';
+  if (!file) {
+    throw std::runtime_error("Could not write cost model file: " + filename);
+  }
+}
+
+BatchCostModel BatchCostModel::load(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open cost model file: " + filename);
+  }
+  BatchCostModel model;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string name;
+    long long value_us = -1;
+    if (!(fields >> name >> value_us) || value_us < 0) {
+      throw std::runtime_error("Malformed cost model entry in " + filename +
+                               ": " + line);
+    }
+    if (name == STARTUP_DELAY_NAME) {
+      model.startup_delay_us = microseconds(value_us);
+      continue;
+    }
+    if (name == SIGNALS_PER_CHANNEL_NAME) {
+      if (value_us == 0) {
+        throw std::runtime_error("Malformed cost model entry in " + filename +
+                                 ": " + line);
+      }
+      model.signals_per_channel = static_cast<size_t>(value_us);
+      continue;
+    }
+    const char* const* found = std::find_if(
+        std::begin(DEVICE_CALL_NAMES), std::end(DEVICE_CALL_NAMES),
+        [&name](const char* call_name) { return name == call_name; });
+    if (found == std::end(DEVICE_CALL_NAMES)) {
+      throw std::runtime_error("Unknown cost model entry in " + filename +
+                               ": " + line);
+    }
+    model.call_us[found - std::begin(DEVICE_CALL_NAMES)] =
+        microseconds(value_us);
+  }
+  return model;
+}
+
+BatchCostModel calibrateBatchCostModel(ChrolisDevice& device,
+                                       int repetitions) {
+  if (repetitions <= 0) {
+    throw std::invalid_argument(
+        "calibrateBatchCostModel(): repetitions must be positive.");
+  }
+  std::array<std::vector<long long>, static_cast<size_t>(DeviceCall::Count)>
+      samples;
+  auto measure = [&samples](DeviceCall call, const char* call_name,
+                            auto&& device_call) {
+    auto start = Timing::Clock::now();
+    ViStatus err = device_call();
+    samples[static_cast<size_t>(call)].push_back(
+        std::chrono::duration_cast<microseconds>(Timing::Clock::now() - start)
+            .count());
+    checkCall(err, call_name);
+  };
+  for (int i = 0; i < repetitions; i++) {
+    // Same calls as PulseChainBatch::setUpThisBatch() for a single step, but
+    // the generator is never started and the LEDs stay off
+    measure(DeviceCall::StartStopGenerator, "TU_StartStopGeneratorOutput_TU",
+            [&device] { return device.TU_StartStopGeneratorOutput_TU(false); });
+    measure(DeviceCall::ResetSequence, "TU_ResetSequence",
+            [&device] { return device.TU_ResetSequence(); });
+    for (ViUInt8 signal_nr : {1, 7}) {  // LED 1 and its breakout box output
+      measure(DeviceCall::AddSelfRunningSignal,
+              "TU_AddGeneratedSelfRunningSignal", [&device, signal_nr] {
+                return device.TU_AddGeneratedSelfRunningSignal(
+                    signal_nr, VI_FALSE, Constants::STARTUP_GUARD_US, 1000,
+                    1000, 1);
+              });
+    }
+    // A trigger chain adds triggered signals and trigger points instead. On
+    // LED 2, triggered by LED 1: a device that takes one signal per channel
+    // would reject a second one on LED 1 before it can be probed.
+    measure(DeviceCall::AddTriggeredSignal, "TU_AddGeneratedTriggeredSignal",
+            [&device] {
+              return device.TU_AddGeneratedTriggeredSignal(
+                  2, VI_FALSE, Constants::STARTUP_GUARD_US, 1000, 1000, 1);
+            });
+    measure(DeviceCall::AddTriggerPoint, "TU_AddTriggerPoint", [&device] {
+      return device.TU_AddTriggerPoint(1, VI_TRUE, 0, 1 << 1);
+    });
+    measure(DeviceCall::SetHeadBrightness, "setLED_HeadBrightness", [&device] {
+      return device.setLED_HeadBrightness(0, 0, 0, 0, 0, 0);
+    });
+    measure(DeviceCall::SetHeadPowerStates, "setLED_HeadPowerStates",
+            [&device] {
+              return device.setLED_HeadPowerStates(
+                  VI_FALSE, VI_FALSE, VI_FALSE, VI_FALSE, VI_FALSE, VI_FALSE);
+            });
+  }
+  checkCall(device.TU_ResetSequence(), "TU_ResetSequence");
+
+  BatchCostModel model;
+  for (size_t i = 0; i < samples.size(); i++) {
+    std::vector<long long>& call_samples = samples[i];
+    if (call_samples.empty()) {  // not used by the batches, keep the default
+      continue;
+    }
+    std::sort(call_samples.begin(), call_samples.end());
+    model.call_us[i] = microseconds(
+        call_samples[static_cast<size_t>(0.9 * (call_samples.size() - 1))]);
+  }
+  model.signals_per_channel = probeSignalsPerChannel(device);
+  return model;
+}
+
+size_t probeSignalsPerChannel(ChrolisDevice& device, size_t max_signals) {
+  checkCall(device.TU_StartStopGeneratorOutput_TU(false),
+            "TU_StartStopGeneratorOutput_TU");
+  checkCall(device.TU_ResetSequence(), "TU_ResetSequence");
+  size_t n_signals = 0;
+  bool accepted = true;
+  while (accepted && n_signals < max_signals) {
+    // One 1 ms pulse after the other, as consecutive steps of one LED
+    ViUInt32 start_delay_us = Constants::STARTUP_GUARD_US +
+                              2000 * static_cast<ViUInt32>(n_signals);
+    for (ViUInt8 signal_nr : {1, 7}) {  // LED 1 and its breakout box output
+      if (accepted) {
+        accepted = VI_SUCCESS == device.TU_AddGeneratedSelfRunningSignal(
+                                     signal_nr, VI_FALSE, start_delay_us,
+                                     1000, 1000, 1);
+      }
+    }
+    n_signals += accepted;
+  }
+  checkCall(device.TU_ResetSequence(), "TU_ResetSequence");
+  if (n_signals == 0) {
+    throw std::runtime_error(
+        "probeSignalsPerChannel(): no signal accepted by the timing unit.");
+  }
+  return n_signals;
+}
@@ -0,0 +1,83 @@
+#include "BatchGenerator.hpp"
+
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "BatchPartitioning.hpp"
+#include "LEDValidation.hpp"
+#include "StepMerging.hpp"
+
+BatchGenerator::BatchGenerator(StepSource source, ChrolisDevice* device_ptr,
+                               Logger* logger_ptr, const BatchCostModel& model,
+                               DeviceState* device_state)
+    : source(std::move(source)),
+      device_ptr(device_ptr),
+      logger_ptr(logger_ptr),
+      model(model),
+      device_state(device_state) {}
+
+bool BatchGenerator::readAhead(size_t n_steps) {
+  size_t n_read = 0;
+  while (n_read < n_steps && !source_done) {
+    std::optional<ProtocolStep> step = source();
+    if (!step.has_value()) {
+      source_done = true;
+      break;
+    }
+    n_steps_read++;
+    n_read++;
+    // The same checks as ProtocolPlanner::validateStep()
+    if (!LED_ValidateLEDIndex(step->led_index) ||
+        (step->n_pulses == 0 && step->brightness != 0) ||
+        !LED_ValidateBrightness(step->brightness)) {
+      std::string err_msg = "Invalid step " + std::to_string(n_steps_read) +
+                            " (id " + std::to_string(step->step_id) + ")";
+      logger_ptr->error(err_msg);
+      throw std::invalid_argument(err_msg);
+    }
+    if (!lookahead.empty() &&
+        stepsCompatibleForMerge(lookahead.back(), *step) ==
+            CompatibilityStatus::BothBreaks) {
+      ProtocolStep& last = lookahead.back();
+      last.setBreakDuration(last.getBreakDurationUs() +
+                            step->getBreakDurationUs());
+      continue;
+    }
+    lookahead.push_back(*step);
+  }
+  return n_read > 0;
+}
+
+GeneratedBatch BatchGenerator::next() {
+  if (lookahead.empty() && !readAhead(1)) {
+    return {};
+  }
+  BatchKind kind;
+  size_t end = greedyBatchEnd(lookahead, 0, model, kind);
+  // The end is only certain once the step after it was read (a break after a
+  // pulse chain, a further single pulse), read more until it is
+  while (end >= lookahead.size() && readAhead(lookahead.size())) {
+    end = greedyBatchEnd(lookahead, 0, model, kind);
+  }
+  GeneratedBatch generated;
+  generated.steps.assign(lookahead.begin(), lookahead.begin() + end);
+  lookahead.erase(lookahead.begin(), lookahead.begin() + end);
+  std::span<const ProtocolStep> steps(generated.steps);
+  generated.programs.reserve(ProgramArena::countSignalsBound(steps), 0);
+  uint32_t batch_id = next_batch_id++;
+  if (kind == BatchKind::Breaks) {
+    generated.batch.emplace(std::in_place_type<InitialBreakBatch>, batch_id,
+                            device_ptr, steps, logger_ptr);
+  } else if (kind == BatchKind::SinglePulses) {
+    generated.batch.emplace(std::in_place_type<SinglePulsesBatch>, batch_id,
+                            device_ptr, steps, logger_ptr,
+                            model[DeviceCall::SetHeadBrightness],
+                            generated.programs, device_state);
+  } else {
+    generated.batch.emplace(std::in_place_type<PulseChainBatch>, batch_id,
+                            device_ptr, steps, logger_ptr, generated.programs,
+                            device_state);
+  }
+  return generated;
+}
@@ -0,0 +1,304 @@
+#include "BatchPartitioning.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "constants.hpp"
+
+using std::chrono::microseconds;
+
+namespace {
+// Idle time before the batch starting at steps[first] (first > 0)
+microseconds idleBeforeUs(const std::vector<ProtocolStep>& steps,
+                          size_t first) {
+  return microseconds(steps[first - 1].time_between_pulses_us);
+}
+
+// Whether the batch before the one starting at steps[first] (first > 0) is a
+// PulseChainBatch. Only the first batch can be a batch of breaks (other than
+// the rest of a long break, whose generator still runs from the batch before).
+bool isAfterPulseBatch(const std::vector<ProtocolStep>& steps, size_t first) {
+  return first > 1 || !steps[0].isBreak();
+}
+
+/*
+Boundary time of a batch starting at steps[first] with n_pulse_steps pulse
+steps that is not hidden by the idle time at the end of the step before it.
+The first batch is set up before the protocol starts.
+*/
+microseconds exposedUs(const std::vector<ProtocolStep>& steps, size_t first,
+                       size_t n_pulse_steps, const BatchCostModel& model) {
+  if (first == 0) {
+    return microseconds(0);
+  }
+  BoundaryPrediction boundary = {
+      0, microseconds(0), idleBeforeUs(steps, first),
+      model.estimateBoundaryUs(n_pulse_steps,
+                               isAfterPulseBatch(steps, first))};
+  return boundary.getExposedUs();
+}
+
+size_t countLeds(const std::vector<ProtocolStep>& steps, size_t first,
+                 size_t end) {
+  int led_mask = 0;
+  for (size_t i = first; i < end; i++) {
+    if (!steps[i].isBreak()) {
+      led_mask |= (1 << steps[i].led_index);
+    }
+  }
+  size_t n_leds = 0;
+  for (; led_mask != 0; led_mask &= led_mask - 1) {
+    n_leds++;
+  }
+  return n_leds;
+}
+
+/*
+The LEDs the pulse steps of a PulseChainBatch use: every LED has one
+brightness (set for the whole batch) and up to signals_per_channel steps.
+*/
+class BatchLeds {
+ public:
+  explicit BatchLeds(size_t signals_per_channel)
+      : signals_per_channel(signals_per_channel) {}
+
+  bool canAdd(const ProtocolStep& step) const {
+    size_t n_steps = n_steps_per_led[step.led_index];
+    return n_steps == 0 || (n_steps < signals_per_channel &&
+                            brightness[step.led_index] == step.brightness);
+  }
+  void add(const ProtocolStep& step) {
+    n_steps_per_led[step.led_index]++;
+    brightness[step.led_index] = step.brightness;
+  }
+
+ private:
+  size_t signals_per_channel;
+  std::array<size_t, 6> n_steps_per_led = {0, 0, 0, 0, 0, 0};
+  std::array<ViUInt16, 6> brightness = {0, 0, 0, 0, 0, 0};
+};
+
+void greedyBatchStarts(const std::vector<ProtocolStep>& steps,
+                       const BatchCostModel& model, BatchPartition& partition) {
+  size_t cursor = 0;
+  while (cursor < steps.size()) {
+    BatchKind kind;
+    partition.batch_starts.push_back(cursor);
+    cursor = greedyBatchEnd(steps, cursor, model, kind);
+    partition.batch_kinds.push_back(kind);
+  }
+}
+
+/*
+Dynamic programming over the batch starts, from the last step backwards:
+best[i] is the cheapest partition of steps[i..] given that a batch starts at
+step i. A batch [i, j] is valid as long as its LEDs fit (see BatchLeds), so
+the inner loop stops after at most 6 x signals_per_channel pulse steps (and
+the breaks between them), and unless it is a batch of only breaks after the
+start of the protocol. The
+SinglePulses batch starting at step i, if any, is one more candidate. On a
+tie, hardware timing (fewer SinglePulses batches) goes before fewer batches.
+*/
+void optimalBatchStarts(const std::vector<ProtocolStep>& steps,
+                        const BatchCostModel& model,
+                        BatchPartition& partition) {
+  struct Cost {
+    microseconds exposed_us;
+    size_t n_single_pulses_batches;
+    size_t n_batches;
+    size_t next_start;
+    BatchKind kind;
+
+    bool operator<(const Cost& other) const {
+      if (exposed_us != other.exposed_us) {
+        return exposed_us < other.exposed_us;
+      }
+      if (n_single_pulses_batches != other.n_single_pulses_batches) {
+        return n_single_pulses_batches < other.n_single_pulses_batches;
+      }
+      return n_batches < other.n_batches;
+    }
+  };
+  size_t n_steps = steps.size();
+  std::vector<Cost> best(n_steps + 1);
+  best[n_steps] = {microseconds(0), 0, 0, n_steps, BatchKind::Breaks};
+  for (size_t i = n_steps; i-- > 0;) {
+    best[i] = {microseconds::max(), 0, SIZE_MAX, n_steps, BatchKind::Breaks};
+    size_t single_pulses_end =
+        steps[i].isBreak() ? i : singlePulsesEnd(steps, i, model);
+    if (single_pulses_end > i &&
+        best[single_pulses_end].n_batches != SIZE_MAX) {
+      const Cost& rest = best[single_pulses_end];
+      best[i] = {exposedUs(steps, i, countLeds(steps, i, single_pulses_end),
+                           model) +
+                     rest.exposed_us,
+                 1 + rest.n_single_pulses_batches, 1 + rest.n_batches,
+                 single_pulses_end, BatchKind::SinglePulses};
+    }
+    BatchLeds leds(model.signals_per_channel);
+    size_t n_pulse_steps = 0;
+    uint64_t start_delay_us = Constants::STARTUP_GUARD_US;
+    for (size_t j = i; j < n_steps; j++) {
+      const ProtocolStep& step = steps[j];
+      if (!step.isBreak()) {
+        if (!leds.canAdd(step) ||
+            start_delay_us > Constants::MAX_DEVICE_TIME_US) {
+          break;
+        }
+        leds.add(step);
+        n_pulse_steps++;
+      }
+      start_delay_us += step.getTotalDurationUs();
+      if ((i > 0 && n_pulse_steps == 0) || best[j + 1].n_batches == SIZE_MAX) {
+        continue;  // not a valid batch, or no valid partition of the rest
+      }
+      Cost candidate = {
+          exposedUs(steps, i, n_pulse_steps, model) + best[j + 1].exposed_us,
+          best[j + 1].n_single_pulses_batches, 1 + best[j + 1].n_batches,
+          j + 1, n_pulse_steps == 0 ? BatchKind::Breaks : BatchKind::PulseChain};
+      if (candidate < best[i]) {
+        best[i] = candidate;
+      }
+    }
+  }
+  for (size_t i = 0; i < n_steps; i = best[i].next_start) {
+    partition.batch_starts.push_back(i);
+    partition.batch_kinds.push_back(best[i].kind);
+  }
+}
+}  // namespace
+
+size_t greedyBatchEnd(const std::vector<ProtocolStep>& steps, size_t first,
+                      const BatchCostModel& model, BatchKind& kind) {
+  if (steps[first].isBreak()) {  // initial break batch
+    kind = BatchKind::Breaks;
+    size_t end = first + 1;
+    // the rest of a break longer than one step (see makeBreakSteps())
+    while (end < steps.size() && steps[end].isBreak()) {
+      end++;
+    }
+    return end;
+  }
+  size_t single_pulses_end = singlePulsesEnd(steps, first, model);
+  if (single_pulses_end > first) {
+    kind = BatchKind::SinglePulses;
+    return single_pulses_end;
+  }
+  kind = BatchKind::PulseChain;
+  BatchLeds leds(model.signals_per_channel);
+  uint64_t start_delay_us = Constants::STARTUP_GUARD_US;
+  size_t cursor = first;
+  while (cursor < steps.size()) {
+    const ProtocolStep& step = steps[cursor];
+    if (step.isBreak()) {  // a break ends the batch
+      return cursor + 1;
+    }
+    if (!leds.canAdd(step)) {  // LED already used up
+      break;
+    }
+    if (start_delay_us > Constants::MAX_DEVICE_TIME_US) {
+      break;  // starts too late for the timing unit
+    }
+    leds.add(step);
+    start_delay_us += step.getTotalDurationUs();
+    cursor++;
+  }
+  return cursor;
+}
+
+microseconds getMinSoftwareEdgeUs(const BatchCostModel& model) {
+  return 2 * model[DeviceCall::SetHeadBrightness];
+}
+
+size_t singlePulsesEnd(const std::vector<ProtocolStep>& steps, size_t first,
+                       const BatchCostModel& model) {
+  microseconds min_edge_us = getMinSoftwareEdgeUs(model);
+  microseconds reprogram_us = model.estimateBoundaryUs(1, true);
+  size_t end = first;  // after the breaks of the last pulse taken
+  BatchLeds leds(model.signals_per_channel);
+  bool beyond_pulse_chain = false;
+  // Start of steps[i] in the batch, the signal of an LED lasts until the end
+  // of its last pulse (see compileSinglePulsesProgram())
+  uint64_t time_us = Constants::STARTUP_GUARD_US;
+  size_t i = first;
+  while (i < steps.size()) {
+    const ProtocolStep& step = steps[i];
+    if (step.isBreak() || step.n_pulses != 1 ||
+        microseconds(step.pulse_width_us) < min_edge_us ||
+        time_us + step.pulse_width_us > Constants::MAX_DEVICE_TIME_US) {
+      break;
+    }
+    // Dark time until the next pulse, i.e. until the next on edge
+    microseconds gap_us(step.time_between_pulses_us);
+    size_t next = i + 1;
+    for (; next < steps.size() && steps[next].isBreak(); next++) {
+      gap_us += microseconds(steps[next].time_between_pulses_us);
+    }
+    if (gap_us.count() > 0 && gap_us < min_edge_us) {
+      break;
+    }
+    beyond_pulse_chain = beyond_pulse_chain || !leds.canAdd(step);
+    leds.add(step);
+    end = next;
+    time_us += step.pulse_width_us + gap_us.count();
+    if (gap_us >= reprogram_us) {
+      break;  // the next batch can be set up in the gap
+    }
+    i = next;
+  }
+  return beyond_pulse_chain ? end : first;
+}
+
+BatchPartition partitionBatches(const std::vector<ProtocolStep>& steps,
+                                BatchPlanning planning,
+                                const BatchCostModel& model) {
+  BatchPartition partition;
+  if (planning == BatchPlanning::Optimal) {
+    optimalBatchStarts(steps, model, partition);
+  } else {
+    greedyBatchStarts(steps, model, partition);
+  }
+  // The predictions follow the programmed state through the batches like
+  // PulseChainBatch does, e.g. a batch with the same signals as the one
+  // before it only costs stopping the generator. (The dynamic program assumes
+  // that every batch programs everything, the most a set up can take.)
+  DeviceState programmed;
+  BatchProgram program;  // of one batch after the other
+  microseconds planned_start_us(0);
+  partition.boundaries.reserve(partition.getBatchCount());
+  for (size_t i = 0; i < partition.getBatchCount(); i++) {
+    size_t first = partition.batch_starts[i];
+    size_t end = partition.getBatchEnd(i, steps.size());
+    microseconds batch_start_us = planned_start_us;
+    for (size_t i_step = first; i_step < end; i_step++) {
+      planned_start_us += microseconds(steps[i_step].getTotalDurationUs());
+    }
+    if (partition.batch_kinds[i] == BatchKind::Breaks) {
+      // the first batch, or the rest of a long break (Greedy)
+      continue;
+    }
+    std::span<const ProtocolStep> batch_steps(steps.data() + first,
+                                              end - first);
+    if (partition.batch_kinds[i] == BatchKind::SinglePulses) {
+      compileSinglePulsesProgram(batch_steps, program);
+    } else {
+      compileBatchProgram(batch_steps, program);
+    }
+    BatchSetUp set_up = programmed.diff(program);
+    programmed.setProgrammed(program);
+    if (i == 0) {  // set up before the protocol starts
+      continue;
+    }
+    BoundaryPrediction boundary = {
+        i, batch_start_us, idleBeforeUs(steps, first),
+        model.estimateBoundaryUs(set_up, isAfterPulseBatch(steps, first))};
+    if (!partition.boundaries.empty()) {
+      boundary.carried_over_us =
+          partition.boundaries.back().getPredictedLatenessUs();
+    }
+    partition.exposed_setup_us += boundary.getExposedUs();
+    partition.boundaries.push_back(boundary);
+  }
+  return partition;
+}
@@ -0,0 +1,243 @@
+#include "BatchSchedule.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <utility>
+
+namespace {
+bool sameStep(const ProtocolStep& step1, const ProtocolStep& step2) {
+  return step1.led_index == step2.led_index &&
+         step1.pulse_width_us == step2.pulse_width_us &&
+         step1.time_between_pulses_us == step2.time_between_pulses_us &&
+         step1.n_pulses == step2.n_pulses &&
+         step1.brightness == step2.brightness;
+}
+
+void combineHash(size_t& hash, size_t value) {
+  hash ^= std::hash<size_t>()(value) + 0x9e3779b97f4a7c15ULL + (hash << 6) +
+          (hash >> 2);
+}
+
+size_t hashBatch(const std::vector<ProtocolStep>& steps, size_t first,
+                 size_t end) {
+  size_t hash = end - first;
+  for (size_t i = first; i < end; i++) {
+    const ProtocolStep& step = steps[i];
+    combineHash(hash, step.led_index);
+    combineHash(hash, step.pulse_width_us);
+    combineHash(hash, step.time_between_pulses_us);
+    combineHash(hash, step.n_pulses);
+    combineHash(hash, step.brightness);
+  }
+  return hash;
+}
+
+/*
+For each of n items, the index of the first item equal to it (itself if
+there is none before it). The items are sorted by hash and only compared
+within a group of equal hashes, which takes a few allocations in all instead
+of some per item as a hash map of candidate lists would.
+*/
+template <typename Hash, typename Equal>
+std::vector<size_t> findFirstOccurrences(size_t n, Hash hash, Equal equal) {
+  std::vector<std::pair<size_t, size_t>> by_hash(n);  // hash, item
+  for (size_t i = 0; i < n; i++) {
+    by_hash[i] = {hash(i), i};
+  }
+  std::sort(by_hash.begin(), by_hash.end());
+  std::vector<size_t> first_of(n);
+  size_t group = 0;
+  while (group < n) {
+    size_t group_end = group + 1;
+    while (group_end < n && by_hash[group_end].first == by_hash[group].first) {
+      group_end++;
+    }
+    // In item order within the group, so the first items come first
+    for (size_t k = group; k < group_end; k++) {
+      size_t item = by_hash[k].second;
+      first_of[item] = item;
+      for (size_t j = group; j < k; j++) {
+        size_t earlier = by_hash[j].second;
+        if (first_of[earlier] == earlier && equal(earlier, item)) {
+          first_of[item] = earlier;
+          break;
+        }
+      }
+    }
+    group = group_end;
+  }
+  return first_of;
+}
+}  // namespace
+
+BatchSchedule scheduleBatches(const std::vector<ProtocolStep>& steps,
+                              const BatchPartition& partition,
+                              BatchExecution execution,
+                              const BatchCostModel& model,
+                              size_t max_block_batches) {
+  BatchSchedule schedule;
+  size_t n_batches = partition.getBatchCount();
+  auto sameBatch = [&steps, &partition](size_t i_batch1, size_t i_batch2) {
+    size_t first1 = partition.batch_starts[i_batch1];
+    size_t end1 = partition.getBatchEnd(i_batch1, steps.size());
+    size_t first2 = partition.batch_starts[i_batch2];
+    size_t end2 = partition.getBatchEnd(i_batch2, steps.size());
+    return partition.batch_kinds[i_batch1] == partition.batch_kinds[i_batch2] &&
+           end1 - first1 == end2 - first2 &&
+           std::equal(steps.begin() + first1, steps.begin() + end1,
+                      steps.begin() + first2, sameStep);
+  };
+  // Distinct batch of every batch of the partition (index of its first
+  // occurrence)
+  std::vector<size_t> first_of_batch = findFirstOccurrences(
+      n_batches,
+      [&steps, &partition](size_t i) {
+        return hashBatch(steps, partition.batch_starts[i],
+                         partition.getBatchEnd(i, steps.size()));
+      },
+      sameBatch);
+  // What is executed as one batch, in order
+  std::vector<ScheduledBatch> executed;
+  if (execution == BatchExecution::HardwareTrigger) {
+    // Next batch with the same steps, for the trigger leads
+    std::vector<size_t> next_same_batch(n_batches, n_batches);
+    std::vector<size_t> last_seen(n_batches, n_batches);
+    for (size_t i = n_batches; i-- > 0;) {
+      next_same_batch[i] = last_seen[first_of_batch[i]];
+      last_seen[first_of_batch[i]] = i;
+    }
+    executed = chainBatches(steps, partition, next_same_batch, model);
+  } else {
+    executed.reserve(n_batches);
+    for (size_t i = 0; i < n_batches; i++) {
+      executed.push_back({i, i + 1});
+    }
+  }
+  // Unique batch of every executed batch. A trigger chain is the same as
+  // another one if its batches and its trigger lead are.
+  std::vector<size_t> first_of_executed = findFirstOccurrences(
+      executed.size(),
+      [&executed, &first_of_batch](size_t i) {
+        const ScheduledBatch& batch = executed[i];
+        size_t hash = batch.trigger_lead_us;
+        for (size_t i_batch = batch.first_batch; i_batch < batch.end_batch;
+             i_batch++) {
+          combineHash(hash, first_of_batch[i_batch]);
+        }
+        return hash;
+      },
+      [&executed, &first_of_batch](size_t i1, size_t i2) {
+        const ScheduledBatch& batch1 = executed[i1];
+        const ScheduledBatch& batch2 = executed[i2];
+        return batch1.trigger_lead_us == batch2.trigger_lead_us &&
+               batch1.getBatchCount() == batch2.getBatchCount() &&
+               std::equal(first_of_batch.begin() + batch1.first_batch,
+                          first_of_batch.begin() + batch1.end_batch,
+                          first_of_batch.begin() + batch2.first_batch);
+      });
+  std::vector<size_t> unique_of_executed(executed.size());
+  for (size_t i = 0; i < executed.size(); i++) {
+    if (first_of_executed[i] == i) {
+      unique_of_executed[i] = schedule.unique_batches.size();
+      schedule.unique_batches.push_back(executed[i]);
+    } else {
+      unique_of_executed[i] = unique_of_executed[first_of_executed[i]];
+    }
+  }
+  // Repeated blocks, left to right
+  size_t n_executed = executed.size();
+  size_t i = 0;
+  while (i < n_executed) {
+    size_t best_length = 1;
+    size_t best_repetitions = 1;
+    for (size_t length = 1;
+         length <= max_block_batches && i + 2 * length <= n_executed;
+         length++) {
+      auto block_begin = unique_of_executed.begin() + i;
+      size_t repetitions = 1;
+      while (i + (repetitions + 1) * length <= n_executed &&
+             std::equal(block_begin, block_begin + length,
+                        block_begin + repetitions * length)) {
+        repetitions++;
+      }
+      if (repetitions > 1 &&
+          length * repetitions > best_length * best_repetitions) {
+        best_length = length;
+        best_repetitions = repetitions;
+      }
+    }
+    auto block_begin = unique_of_executed.begin() + i;
+    if (best_repetitions == 1 && !schedule.blocks.empty() &&
+        schedule.blocks.back().repetitions == 1) {
+      // Batches that do not repeat are collected in one block
+      schedule.blocks.back().batches.push_back(*block_begin);
+    } else {
+      schedule.blocks.push_back(
+          {std::vector<size_t>(block_begin, block_begin + best_length),
+           best_repetitions});
+    }
+    i += best_length * best_repetitions;
+  }
+  return schedule;
+}
+
+void predictScheduledBoundaries(
+    const std::vector<ProtocolStep>& steps, const BatchSchedule& schedule,
+    const std::vector<const BatchProgramView*>& programs,
+    const BatchCostModel& model, BatchPartition& partition) {
+  using std::chrono::microseconds;
+  DeviceState programmed;
+  size_t i_batch = 0;  // first batch of the partition executed next
+  for (const auto& block : schedule.blocks) {
+    for (size_t i_repetition = 0; i_repetition < block.repetitions;
+         i_repetition++) {
+      for (size_t i_unique : block.batches) {
+        const BatchProgramView* program = programs[i_unique];
+        if (program != nullptr) {
+          BatchSetUp set_up = programmed.diff(*program);
+          programmed.setProgrammed(*program);
+          // Every batch after the first one has a boundary, batch i at i - 1
+          if (i_batch > 0) {
+            size_t first_step = partition.batch_starts[i_batch];
+            partition.boundaries[i_batch - 1].needed_us =
+                model.estimateBoundaryUs(
+                    set_up, first_step > 1 || !steps[0].isBreak()) -
+                model.startup_delay_us +
+                microseconds(program->startup_delay_us);
+          }
+        }
+        size_t n_batches = schedule.unique_batches[i_unique].getBatchCount();
+        for (size_t k = 1; k < n_batches; k++) {  // started by the device
+          partition.boundaries[i_batch + k - 1].needed_us = microseconds(0);
+          partition.boundaries[i_batch + k - 1].available_us = microseconds(0);
+        }
+        i_batch += n_batches;
+      }
+    }
+  }
+  partition.exposed_setup_us = microseconds(0);
+  for (size_t i = 0; i < partition.boundaries.size(); i++) {
+    BoundaryPrediction& boundary = partition.boundaries[i];
+    boundary.carried_over_us =
+        i > 0 ? partition.boundaries[i - 1].getPredictedLatenessUs()
+              : microseconds(0);
+    partition.exposed_setup_us += boundary.getExposedUs();
+  }
+}
+
+std::string dumpBatchSchedule(const BatchSchedule& schedule,
+                              const std::string& prefix) {
+  std::string dump;
+  char number[32];
+  for (const auto& block : schedule.blocks) {
+    std::snprintf(number, sizeof(number), "%zu x batches", block.repetitions);
+    dump += prefix + number;
+    for (size_t i_unique : block.batches) {
+      std::snprintf(number, sizeof(number), " %zu", i_unique + 1);
+      dump += number;
+    }
+    dump += '\n';
+  }
+  return dump;
+}
@@ -0,0 +1,68 @@
+#include "BatchTelemetry.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+void appendPercentiles(std::string& summary, const char* name,
+                       std::vector<long long> values) {
+  std::sort(values.begin(), values.end());
+  auto percentile = [&values](double p) {
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+  };
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "%-18s min %9lld  p50 %9lld  p90 %9lld  p99 %9lld  max %9lld "
+                "us\n",
+                name, values.front(), percentile(0.5), percentile(0.9),
+                percentile(0.99), values.back());
+  summary += line;
+}
+}  // namespace
+
+void writeBatchTelemetryCsv(const std::vector<BatchTelemetry>& telemetry,
+                            const std::string& filename) {
+  std::ofstream file(filename, std::ios::out | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open telemetry file: " + filename);
+  }
+  file << "batch_id,planned_start_us,actual_start_us,lateness_us,"
+          "setup_duration_us,execute_duration_us,sleep_overshoot_us\n";
+  for (const auto& record : telemetry) {
+    file << record.batch_id << ',' << record.planned_start_us.count() << ','
+         << record.actual_start_us.count() << ','
+         << record.getLatenessUs().count() << ','
+         << record.setup_duration_us.count() << ','
+         << record.execute_duration_us.count() << ','
+         << record.sleep_overshoot_us.count() << '\n';
+  }
+  if (!file) {
+    throw std::runtime_error("Could not write telemetry file: " + filename);
+  }
+}
+
+std::string summarizeBatchTelemetry(
+    const std::vector<BatchTelemetry>& telemetry) {
+  if (telemetry.empty()) {
+    return "No batch telemetry recorded.\n";
+  }
+  std::vector<long long> lateness;
+  std::vector<long long> setup;
+  std::vector<long long> execute;
+  std::vector<long long> overshoot;
+  for (const auto& record : telemetry) {
+    lateness.push_back(record.getLatenessUs().count());
+    setup.push_back(record.setup_duration_us.count());
+    execute.push_back(record.execute_duration_us.count());
+    overshoot.push_back(record.sleep_overshoot_us.count());
+  }
+  std::string summary =
+      "Batch timing over " + std::to_string(telemetry.size()) + " batches:\n";
+  appendPercentiles(summary, "start lateness", std::move(lateness));
+  appendPercentiles(summary, "set up duration", std::move(setup));
+  appendPercentiles(summary, "execute duration", std::move(execute));
+  appendPercentiles(summary, "sleep overshoot", std::move(overshoot));
+  return summary;
+}
@@ -0,0 +1,215 @@
+#include "BinaryLog.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t MAX_VARINT_SIZE = 10;  // 64 bits in 7-bit groups
+// Event payload: 4 fields of up to 32 bits, status and n_args, the args
+constexpr size_t MAX_EVENT_SIZE =
+    (4 + LogEventData::MAX_ARGS) * 5 + MAX_VARINT_SIZE + 1;
+
+// Fixed-size little-endian encoding for the file header
+template <typename T>
+char* put(char* out, T value) {
+  auto bits = static_cast<std::make_unsigned_t<T>>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+  }
+  return out + sizeof(T);
+}
+
+template <typename T>
+const char* get(const char* in, T& value) {
+  std::make_unsigned_t<T> bits = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    bits |= static_cast<std::make_unsigned_t<T>>(
+                static_cast<unsigned char>(in[i]))
+            << (8 * i);
+  }
+  value = static_cast<T>(bits);
+  return in + sizeof(T);
+}
+
+uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+char* putVarint(char* out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<char>(value);
+  return out;
+}
+
+// Decode a varint from [cursor, end), advancing cursor
+uint64_t getVarint(const char*& cursor, const char* end) {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (cursor == end) {
+      throw std::runtime_error("Truncated record in binary log.");
+    }
+    auto byte = static_cast<unsigned char>(*cursor++);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Malformed varint in binary log.");
+}
+
+uint32_t getVarint32(const char*& cursor, const char* end) {
+  uint64_t value = getVarint(cursor, end);
+  if (value > UINT32_MAX) {
+    throw std::runtime_error("Malformed event record in binary log.");
+  }
+  return static_cast<uint32_t>(value);
+}
+
+// Read a varint from the stream. Returns false at the end of the stream if no
+// byte could be read; throws if the stream ends inside the varint.
+bool readVarint(std::istream& in, uint64_t& value) {
+  char buffer[MAX_VARINT_SIZE];
+  for (size_t i = 0; i < MAX_VARINT_SIZE; i++) {
+    if (!in.get(buffer[i])) {
+      if (i == 0) {
+        return false;
+      }
+      throw std::runtime_error("Truncated record header in binary log.");
+    }
+    if (!(static_cast<unsigned char>(buffer[i]) & 0x80)) {
+      const char* cursor = buffer;
+      value = getVarint(cursor, buffer + i + 1);
+      return true;
+    }
+  }
+  throw std::runtime_error("Malformed varint in binary log.");
+}
+}  // namespace
+
+BinaryLog::Writer::Writer(std::ostream& out, const Header& header)
+    : out(out), last_ns(header.steady_clock_ns) {
+  char buffer[HEADER_SIZE];
+  std::memcpy(buffer, MAGIC, sizeof(MAGIC));
+  char* cursor = put(buffer + sizeof(MAGIC), header.version);
+  cursor = put(cursor, uint32_t(0));
+  cursor = put(cursor, header.wall_clock_ns);
+  put(cursor, header.steady_clock_ns);
+  out.write(buffer, sizeof(buffer));
+}
+
+void BinaryLog::Writer::writeRecord(int64_t steady_ns, RecordKind kind,
+                                    LogType type, const char* payload,
+                                    size_t size) {
+  char buffer[1 + 2 * MAX_VARINT_SIZE];
+  buffer[0] = static_cast<char>(static_cast<uint8_t>(kind) |
+                                (static_cast<uint8_t>(type) << 4));
+  char* cursor = putVarint(buffer + 1, zigzag(steady_ns - last_ns));
+  cursor = putVarint(cursor, size);
+  out.write(buffer, cursor - buffer);
+  out.write(payload, static_cast<std::streamsize>(size));
+  last_ns = steady_ns;
+}
+
+void BinaryLog::Writer::writeText(int64_t steady_ns, LogType type,
+                                  std::string_view text) {
+  writeRecord(steady_ns, RecordKind::Text, type, text.data(), text.size());
+}
+
+void BinaryLog::Writer::writeEvent(int64_t steady_ns, LogType type,
+                                   const LogEventData& event) {
+  size_t n_args = event.n_args < LogEventData::MAX_ARGS
+                      ? event.n_args
+                      : LogEventData::MAX_ARGS;
+  char buffer[MAX_EVENT_SIZE];
+  char* cursor = putVarint(buffer, static_cast<uint16_t>(event.event));
+  cursor = putVarint(cursor, event.batch_id);
+  // NO_STEP (all bits set) wraps around to 0, a single byte
+  cursor = putVarint(cursor, static_cast<uint32_t>(event.step_id + 1));
+  cursor = putVarint(cursor, zigzag(event.status));
+  cursor = putVarint(cursor, n_args);
+  for (size_t i = 0; i < n_args; i++) {
+    cursor = putVarint(cursor, event.args[i]);
+  }
+  writeRecord(steady_ns, RecordKind::Event, type, buffer,
+              static_cast<size_t>(cursor - buffer));
+}
+
+BinaryLog::Reader::Reader(std::istream& in) : in(in), header(), last_ns(0) {
+  char buffer[HEADER_SIZE];
+  if (!in.read(buffer, sizeof(buffer)) ||
+      std::memcmp(buffer, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("Not a Chrolispp binary log.");
+  }
+  const char* cursor = get(buffer + sizeof(MAGIC), header.version);
+  uint32_t reserved;
+  cursor = get(cursor, reserved);
+  cursor = get(cursor, header.wall_clock_ns);
+  get(cursor, header.steady_clock_ns);
+  if (header.version != VERSION) {
+    throw std::runtime_error("Unsupported binary log version " +
+                             std::to_string(header.version) + ".");
+  }
+  last_ns = header.steady_clock_ns;
+}
+
+bool BinaryLog::Reader::next(Entry& entry) {
+  char kind_and_type;
+  if (!in.get(kind_and_type)) {
+    return false;
+  }
+  uint64_t delta_ns;
+  uint64_t size;
+  if (!readVarint(in, delta_ns) || !readVarint(in, size)) {
+    throw std::runtime_error("Truncated record header in binary log.");
+  }
+  last_ns += unzigzag(delta_ns);
+  entry.steady_ns = last_ns;
+  entry.kind = static_cast<RecordKind>(kind_and_type & 0x0F);
+  entry.type =
+      static_cast<LogType>((static_cast<unsigned char>(kind_and_type) >> 4));
+  if (entry.kind == RecordKind::Event && size > MAX_EVENT_SIZE) {
+    throw std::runtime_error("Malformed event record in binary log.");
+  }
+  std::string payload(size, '\0');
+  if (!in.read(payload.data(), static_cast<std::streamsize>(size))) {
+    throw std::runtime_error("Truncated record in binary log.");
+  }
+  if (entry.kind == RecordKind::Text) {
+    entry.text = std::move(payload);
+    return true;
+  }
+  if (entry.kind != RecordKind::Event) {
+    throw std::runtime_error("Malformed record in binary log.");
+  }
+  const char* cursor = payload.data();
+  const char* end = cursor + payload.size();
+  LogEventData& event = entry.event;
+  event = LogEventData{};
+  event.event = static_cast<LogEvent>(getVarint32(cursor, end));
+  event.batch_id = getVarint32(cursor, end);
+  event.step_id = getVarint32(cursor, end) - 1;
+  event.status = static_cast<int32_t>(unzigzag(getVarint(cursor, end)));
+  uint32_t n_args = getVarint32(cursor, end);
+  if (n_args > LogEventData::MAX_ARGS) {
+    throw std::runtime_error("Malformed event record in binary log.");
+  }
+  event.n_args = static_cast<uint8_t>(n_args);
+  for (uint8_t i = 0; i < event.n_args; i++) {
+    event.args[i] = getVarint32(cursor, end);
+  }
+  if (cursor != end) {
+    throw std::runtime_error("Malformed event record in binary log.");
+  }
+  entry.text.clear();
+  return true;
+}
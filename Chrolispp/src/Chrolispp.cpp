@@ -63,7 +63,6 @@ step_cursor: 3
 //  TODO: show error message if wrong arduino COM Port specified
 //  FIXME: waiting too long to open a file might crash the software.
 //  FIXME: "Press y + enter to startprotocol  mode, or q then enter to quit."
-//  TODO: move logging into async (start new thread) to readuce latency?
 //  TODO: add Arduino as a communications queue (each queue element should be
 //  executed immediately... so in best case, queue will be always directly
 //  emptied).
@@ -75,19 +74,27 @@ step_cursor: 3
 #include <stdio.h>
 
 #include <csignal>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include "ArduinoCommands.hpp"
+#include "BatchCostModel.hpp"
+#include "BinaryLog.hpp"
 #include "COMFunctions.hpp"
 #include "LEDFunctions.hpp"
 #include "Logger.hpp"
+#include "MultiTrackProtocol.hpp"
 #include "ProtocolPlanner.hpp"
 #include "ProtocolStep.hpp"
+#include "SerialArduinoLink.hpp"
 #include "TL6WL.h"
+#include "TL6WLDevice.hpp"
 #include "Timing.hpp"
 #include "Utils.hpp"
 #include "version.hpp"
@@ -97,14 +104,14 @@ constexpr bool USE_BOB =
     true;  // whether to use the breakout board for timing signals
 
 struct CleanupContext {
-  ViSession instr;
+  ChrolisDevice* device_ptr;
   HANDLE h_Serial;
   std::unique_ptr<Logger>* logger;
 };
 
 CleanupContext cleanupContext;
 
-static ViStatus cleanup(ViSession instr, HANDLE h_Serial,
+static ViStatus cleanup(ChrolisDevice* device_ptr, HANDLE h_Serial,
                         std::unique_ptr<Logger>* logger) {
   ViStatus err;
   Logger* logger_ptr = logger->get();
@@ -112,11 +119,11 @@ static ViStatus cleanup(ViSession instr, HANDLE h_Serial,
   std::cout << "Cleaning up...";
   // set all LEDs to 0, close LED connection and logger.
   std::cout << "Turning off LEDs and closing connection." << std::endl;
-  TL6WL_TU_StartStopGeneratorOutput_TU(
-      instr, VI_FALSE);  // Stop the internal timer in case it is running
-  TL6WL_setLED_HeadPowerStates(instr, VI_FALSE, VI_FALSE, VI_FALSE, VI_FALSE,
-                               VI_FALSE, VI_FALSE);
-  err = TL6WL_close(instr);
+  device_ptr->TU_StartStopGeneratorOutput_TU(
+      VI_FALSE);  // Stop the internal timer in case it is running
+  device_ptr->setLED_HeadPowerStates(VI_FALSE, VI_FALSE, VI_FALSE, VI_FALSE,
+                                     VI_FALSE, VI_FALSE);
+  err = device_ptr->close();
   // Send 1 to Arduino to turn off pulse
   if (h_Serial != INVALID_HANDLE_VALUE) {
     sendCommandToArduino(h_Serial, RESET);
@@ -130,7 +137,7 @@ static ViStatus cleanup(ViSession instr, HANDLE h_Serial,
 
 static void signalHandler(int signal) {
   if (signal == SIGINT) {
-    cleanup(cleanupContext.instr, cleanupContext.h_Serial,
+    cleanup(cleanupContext.device_ptr, cleanupContext.h_Serial,
             cleanupContext.logger);
     std::cout << "Interrupted." << std::endl;
     std::exit(0);
@@ -363,13 +370,27 @@ int main() {
   }
   std::string modeString = keyPressMode ? "key-press" : "protocol ";
   std::vector<ProtocolStep> protocolSteps;
+  // A CSV with 7 or 8 columns is a multi-track protocol (overlapping trains)
+  bool multiTrack = false;
+  MultiTrackProtocol multiTrackProtocol;
   if (!keyPressMode) {
     if (!isCSVFile(fpath)) {
       std::cerr << "The selected file is not a CSV file." << std::endl;
       return -1;
     }
-    protocolSteps = readProtocolCSV(fpath);
-    if (protocolSteps.size() == 0) {
+    multiTrack = isMultiTrackCSV(fpath);
+    if (multiTrack) {
+      try {
+        multiTrackProtocol = readMultiTrackCSV(fpath);
+      } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+      }
+    } else {
+      protocolSteps = readProtocolCSV(fpath);
+    }
+    if (protocolSteps.size() == 0 &&
+        multiTrackProtocol.getTrainCount() == 0) {
       std::cerr << "No protocol steps found in the CSV file." << std::endl;
       return -1;
     }
@@ -383,14 +404,29 @@ int main() {
   }
   // Set up logging
   std::unique_ptr<Logger> logger;  // for accessing the logger outside try
+  // Log files named *.chrlog get the compact binary format
+  bool binary_log = fpath_log.ends_with(BinaryLog::FILE_EXTENSION);
   try {
-    logger = std::make_unique<Logger>(fpath_log);
+    logger = std::make_unique<Logger>(
+        fpath_log, binary_log ? LogFormat::Binary : LogFormat::Text);
     // Print log file path
     std::cout << "Starting log file " << fpath_log << std::endl;
     // TODO: add logging calls, check if info and error can be differentiated!
     logger->info("Logging started. Code version: " + std::string(VERSION_STR));
     // write mode (key-press or protocol mode) into log file
     logger->info("Mode: " + modeString);
+    // Optional minimum log level, e.g. CHROLISPP_LOG_LEVEL=info drops traces
+    const char* log_level = std::getenv("CHROLISPP_LOG_LEVEL");
+    LogType min_level;
+    if (log_level != nullptr) {
+      if (parseLogType(log_level, min_level)) {
+        logger->setMinLevel(min_level);
+        logger->infof("Minimum log level: %s", logTypeString(min_level));
+      } else {
+        logger->warningf("Unknown CHROLISPP_LOG_LEVEL \"%s\", logging all.",
+                         log_level);
+      }
+    }
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
     return 1;
@@ -403,11 +439,13 @@ int main() {
     oss << "Arduino firmware version: " << +firmwareVersion;
     logger->info(oss.str());
   }
+  TL6WLDevice device(instr);
+  SerialArduinoLink arduino_link(h_Serial);
   std::unique_ptr<ProtocolPlanner> protocolPlanner;
   if (!keyPressMode) {
     logger->info("Protocol file: " + fpath);
     // Sanity checking the protocol steps
-    if (protocolSteps.empty()) {
+    if (protocolSteps.empty() && !multiTrack) {
       logger->error(
           "Protocol steps are empty. Might be due to bad initialization of the "
           "protocolSteps variable.");
@@ -458,18 +496,87 @@ int main() {
       // Print step for user to review
       step.printStep();
     }
-    if (arduinoFound) {
+    // Optional batch planning mode, CHROLISPP_BATCH_PLANNING=optimal
+    const char* batch_planning = std::getenv("CHROLISPP_BATCH_PLANNING");
+    BatchPlanning planning = BatchPlanning::Greedy;
+    if (batch_planning != nullptr &&
+        std::string_view(batch_planning) == "optimal") {
+      planning = BatchPlanning::Optimal;
+    }
+    // Optional measured batch cost model, CHROLISPP_COST_MODEL=<file>: loaded
+    // if the file exists, otherwise measured on the device and saved there
+    BatchCostModel cost_model;
+    const char* cost_model_path = std::getenv("CHROLISPP_COST_MODEL");
+    if (cost_model_path != nullptr) {
+      try {
+        if (std::filesystem::exists(cost_model_path)) {
+          cost_model = BatchCostModel::load(cost_model_path);
+          logger->infof("Batch cost model loaded from %s", cost_model_path);
+        } else {
+          std::cout << "Calibrating batch cost model..." << std::endl;
+          cost_model = calibrateBatchCostModel(device);
+          cost_model.save(cost_model_path);
+          logger->infof("Batch cost model calibrated, saved to %s",
+                        cost_model_path);
+        }
+      } catch (const std::runtime_error& e) {
+        logger->warningf("%s Using the default batch cost model.", e.what());
+        std::cerr << e.what() << " Using the default batch cost model."
+                  << std::endl;
+      }
+    }
+    // Optional batch execution mode, CHROLISPP_BATCH_EXECUTION=trigger
+    const char* batch_execution = std::getenv("CHROLISPP_BATCH_EXECUTION");
+    BatchExecution execution = BatchExecution::Host;
+    if (batch_execution != nullptr &&
+        std::string_view(batch_execution) == "trigger") {
+      execution = BatchExecution::HardwareTrigger;
+    }
+    if (multiTrack) {
+      // The trains are checked by the planner
+      if (arduinoFound) {
+        logger->warning("Arduino not used for a multi-track protocol.");
+        std::cout << "Arduino not used for a multi-track protocol."
+                  << std::endl;
+      }
+      protocolPlanner = std::make_unique<ProtocolPlanner>(
+          &device, multiTrackProtocol, logger.get(), cost_model);
+    } else if (arduinoFound) {
       protocolPlanner = std::make_unique<ProtocolPlanner>(
-          instr, protocolSteps, logger.get(), h_Serial);
+          &device, protocolSteps, logger.get(), &arduino_link, planning,
+          cost_model, execution);
     } else {
       protocolPlanner = std::make_unique<ProtocolPlanner>(
-          instr, protocolSteps, logger.get(), std::nullopt);
+          &device, protocolSteps, logger.get(), nullptr, planning, cost_model,
+          execution);
+    }
+  }
+  // Files written next to the log file are named after it
+  std::string fpath_log_base = fpath_log;
+  std::string_view log_extension =
+      binary_log ? BinaryLog::FILE_EXTENSION : std::string_view(".log");
+  size_t extension_pos = fpath_log_base.rfind(log_extension);
+  if (extension_pos != std::string::npos) {
+    fpath_log_base.erase(extension_pos);
+  }
+  if (protocolPlanner) {
+    // Log and print protocol
+    std::string protocol_text = protocolPlanner->toString("", "\t", "\t\t");
+    std::cout << protocol_text << std::endl;
+    logger->multiLineInfo(protocol_text);
+    // Batch starts the cost model predicts to be late, before the user starts
+    std::string late_starts = protocolPlanner->summarizePredictedLateStarts();
+    std::cout << late_starts;
+    logger->multiLineInfo(late_starts);
+    // What every batch programs into the device, for reviewing and diffing
+    std::string fpath_programs = fpath_log_base + "_programs.txt";
+    try {
+      protocolPlanner->writeBatchPrograms(fpath_programs);
+      logger->info("Batch programs written to " + fpath_programs);
+    } catch (const std::runtime_error& e) {
+      logger->error(e.what());
     }
   }
-  // Log and print protocol
-  std::cout << protocolPlanner->toChars("", "\t", "\t\t") << std::endl;
-
-  logger->multiLineInfo(protocolPlanner->toChars("", "\t", "\t\t"));
   // Wait for user to press space to start the protocol or key-press mode, or q
   // to quit.
   std::cout << "\nPress y + enter to start" << modeString
@@ -487,7 +594,7 @@ int main() {
     std::cout << "Starting " << modeString << " mode." << std::endl;
   }
 
-  logger->trace("Bitness is " + std::string(bitness));
+  logger->tracef("Bitness is %s", bitness);
   printf("This is start of Thorlabs CHROLIS TL6WL logging output [%s]!\n\n",
          bitness);
 
@@ -495,7 +602,7 @@ int main() {
 
   // Start thread to listen for escape key
   cleanupContext.h_Serial = h_Serial;
-  cleanupContext.instr = instr;
+  cleanupContext.device_ptr = &device;
   cleanupContext.logger = &logger;
 
   // Update the assignment to match the new type
@@ -512,12 +619,12 @@ int main() {
 
     // always start with stopping an eventually running timing unit (TU)
 
-    err = TL6WL_TU_StartStopGeneratorOutput_TU(instr, false);
+    err = device.TU_StartStopGeneratorOutput_TU(false);
 
     // for a new sequence always clear the current sequence of the timing unit
     // (TU)
 
-    err = TL6WL_TU_ResetSequence(instr);
+    err = device.TU_ResetSequence();
 
     ViUInt8 sigNr1 = 2;               // LED2
     ViBoolean activeLow1 = 0;         // this is positive logic (not active low)
@@ -533,24 +640,24 @@ int main() {
     ViUInt32 inactiveTimeus2 = 1000000;  // this is 1s
     ViUInt32 repetitionCount2 = 3;       // number of repetitions
     std::cout << "Setting up demo run" << std::endl;
-    TL6WL_setLED_HeadBrightness(instr, 100, 100, 100, 100, 100, 100);
-
-    TL6WL_TU_AddGeneratedSelfRunningSignal(instr, sigNr1, activeLow1,
-                                           startDelayus1, activeTimeus1,
-                                           inactiveTimeus1, repetitionCount1);
-    TL6WL_TU_AddGeneratedSelfRunningSignal(instr, 7, activeLow1, startDelayus1,
-                                           activeTimeus1, inactiveTimeus1,
-                                           repetitionCount1);
-    TL6WL_TU_AddGeneratedSelfRunningSignal(instr, sigNr2, activeLow2,
-                                           startDelayus2, activeTimeus2,
-                                           inactiveTimeus2, repetitionCount2);
+    device.setLED_HeadBrightness(100, 100, 100, 100, 100, 100);
+
+    device.TU_AddGeneratedSelfRunningSignal(sigNr1, activeLow1, startDelayus1,
+                                            activeTimeus1, inactiveTimeus1,
+                                            repetitionCount1);
+    device.TU_AddGeneratedSelfRunningSignal(7, activeLow1, startDelayus1,
+                                            activeTimeus1, inactiveTimeus1,
+                                            repetitionCount1);
+    device.TU_AddGeneratedSelfRunningSignal(sigNr2, activeLow2, startDelayus2,
+                                            activeTimeus2, inactiveTimeus2,
+                                            repetitionCount2);
 
     // start the sequence (this is the software trigger)
     std::cout << "Set up power states" << std::endl;
-    TL6WL_setLED_HeadPowerStates(instr, VI_FALSE, VI_TRUE, VI_FALSE, VI_TRUE,
-                                 VI_FALSE, VI_FALSE);
+    device.setLED_HeadPowerStates(VI_FALSE, VI_TRUE, VI_FALSE, VI_TRUE,
+                                  VI_FALSE, VI_FALSE);
 
-    err = TL6WL_TU_StartStopGeneratorOutput_TU(instr, true);
+    err = device.TU_StartStopGeneratorOutput_TU(true);
     if (VI_SUCCESS != err) {
       printf(
           " TL6WL_TU_StartStopGeneratorOutput_TU  :\n    Error Code = "
@@ -569,10 +676,10 @@ int main() {
         if (ch == 'S' || ch == 's') {
           std::cout << "LED 0: Stimulating for 4 seconds." << std::endl;
           logger->protocol("LED 0: Stimulating for 4 seconds.");
-          // LED_PulseNTimesWithArduino(instr, 0, 4000, 0, 1, 100, h_Serial,
+          // LED_PulseNTimesWithArduino(&device, 0, 4000, 0, 1, 100, h_Serial,
           //                            dac_resolution_bits);
           ViUInt16 brightness = 1000;  // 100% brightness
-          LED_PulseNTimes(instr, 0, 4000, 1, 1, brightness, USE_BOB);
+          LED_PulseNTimes(&device, 0, 4000, 1, 1, brightness, USE_BOB);
           logger->protocol("LED 0: Done.");
         } else if (ch == 'Q' || ch == 'q') {
           // TODO: test this quit method. If works, then sigint can be limited
@@ -593,13 +700,22 @@ int main() {
     } catch (const std::runtime_error& e) {
       std::cerr << "Runtime error during protocolPlanner::executeProtocol(): "
                 << e.what() << std::endl;
-      err = cleanup(instr, h_Serial, &logger);
+      err = cleanup(&device, h_Serial, &logger);
       return -1;
     }
+    // Batch timing telemetry next to the log file
+    std::string fpath_telemetry = fpath_log_base + "_telemetry.csv";
+    try {
+      protocolPlanner->writeTelemetryCsv(fpath_telemetry);
+      logger->info("Batch telemetry written to " + fpath_telemetry);
+    } catch (const std::runtime_error& e) {
+      logger->error(e.what());
+      std::cerr << e.what() << std::endl;
+    }
   }
 
   printf("\nClose Device\n");
-  err = cleanup(instr, h_Serial, &logger);
+  err = cleanup(&device, h_Serial, &logger);
   if (VI_SUCCESS != err) {
     sprintf_s(err_buffer, "TL6WL_close() : Error Code = %#.8lX", err);
     logger->error(err_buffer);
@@ -0,0 +1,200 @@
+#include "DeviceState.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "constants.hpp"
+
+namespace {
+// The partitioning keeps the batches short enough for the timing unit
+void checkDeviceTime(uint64_t time_us, const ProtocolStep& step) {
+  if (time_us > Constants::MAX_DEVICE_TIME_US) {
+    throw std::logic_error("Step id " + std::to_string(step.step_id) +
+                           " starts too late in its batch for the 32-bit "
+                           "timing unit.");
+  }
+}
+
+// The empty program of BatchProgram(), keeping the capacity of the vectors
+void clearProgram(BatchProgram& program) {
+  program.signals.clear();
+  program.signal_step_ids.clear();
+  program.trigger_points.clear();
+  program.startup_delay_us = Constants::STARTUP_GUARD_US;
+  program.brightness.fill(0);
+  program.power_states.fill(VI_FALSE);
+}
+}  // namespace
+
+BatchProgram compileBatchProgram(std::span<const ProtocolStep> steps) {
+  BatchProgram program;
+  compileBatchProgram(steps, program);
+  return program;
+}
+
+void compileBatchProgram(std::span<const ProtocolStep> steps,
+                         BatchProgram& program) {
+  clearProgram(program);
+  // Need a guard right in the beginning, otherwise the first pulse may be
+  // skipped if it is too short (e.g. 5 us)
+  uint64_t duration_so_far_us = Constants::STARTUP_GUARD_US;
+  for (const auto& step : steps) {
+    if (step.isBreak()) {
+      // a break does not use its LED, must not overwrite its brightness
+      duration_so_far_us += step.getTotalDurationUs();
+      continue;
+    }
+    checkDeviceTime(duration_so_far_us, step);
+    program.brightness[step.led_index] = step.brightness;
+    program.power_states[step.led_index] = VI_TRUE;
+    // LED signal, then the breakout box signal of the same LED
+    for (ViUInt8 signal_nr : {static_cast<ViUInt8>(step.led_index + 1),
+                              static_cast<ViUInt8>(step.led_index + 1 + 6)}) {
+      program.signals.push_back({signal_nr, VI_FALSE,
+                                 static_cast<ViUInt32>(duration_so_far_us),
+                                 step.pulse_width_us,
+                                 step.time_between_pulses_us,
+                                 step.n_pulses});
+      program.signal_step_ids.push_back(step.step_id);
+    }
+    duration_so_far_us += step.getTotalDurationUs();
+  }
+}
+
+BatchProgram compileSinglePulsesProgram(std::span<const ProtocolStep> steps) {
+  BatchProgram program;
+  compileSinglePulsesProgram(steps, program);
+  return program;
+}
+
+void compileSinglePulsesProgram(std::span<const ProtocolStep> steps,
+                                BatchProgram& program) {
+  clearProgram(program);
+  uint64_t busy_us = 0;  // end of the last pulse
+  uint64_t duration_so_far_us = 0;
+  for (const auto& step : steps) {
+    if (!step.isBreak()) {
+      program.power_states[step.led_index] = VI_TRUE;
+      busy_us = duration_so_far_us + step.pulse_width_us;
+      checkDeviceTime(program.startup_delay_us + busy_us, step);
+    }
+    duration_so_far_us += step.getTotalDurationUs();
+  }
+  for (ViUInt8 led_index = 0; led_index < 6; led_index++) {
+    if (!program.power_states[led_index]) {
+      continue;
+    }
+    program.signals.push_back(
+        {static_cast<ViUInt8>(led_index + 1), VI_FALSE, 0,
+         static_cast<ViUInt32>(program.startup_delay_us + busy_us), 0, 1});
+    // the first step of the LED
+    auto step = std::find_if(steps.begin(), steps.end(),
+                             [led_index](const ProtocolStep& s) {
+                               return !s.isBreak() && s.led_index == led_index;
+                             });
+    program.signal_step_ids.push_back(step->step_id);
+  }
+}
+
+std::string dumpBatchProgram(const BatchProgramView& program,
+                             const std::string& prefix) {
+  std::string dump;
+  char line[160];
+  for (size_t i = 0; i < program.signals.size(); i++) {
+    const GeneratorSignal& signal = program.signals[i];
+    std::snprintf(line, sizeof(line),
+                  "signal %2u active_low %u start_delay_us %u active_us %u "
+                  "inactive_us %u repetitions %u step %u%s\n",
+                  signal.signal_nr, signal.active_low, signal.start_delay_us,
+                  signal.active_us, signal.inactive_us, signal.repetitions,
+                  program.signal_step_ids[i],
+                  signal.triggered ? " triggered" : "");
+    dump += prefix + line;
+  }
+  for (const auto& trigger_point : program.trigger_points) {
+    std::snprintf(line, sizeof(line),
+                  "trigger_point signal %2u starts_low %u edge_count %u "
+                  "signals 0x%03x\n",
+                  trigger_point.signal_nr, trigger_point.starts_low,
+                  trigger_point.edge_count,
+                  static_cast<uint16_t>(trigger_point.affected_signal_bitmask));
+    dump += prefix + line;
+  }
+  const std::array<ViUInt16, 6>& brightness = program.brightness;
+  std::snprintf(line, sizeof(line), "brightness %u %u %u %u %u %u\n",
+                brightness[0], brightness[1], brightness[2], brightness[3],
+                brightness[4], brightness[5]);
+  dump += prefix + line;
+  const std::array<ViBoolean, 6>& power_states = program.power_states;
+  std::snprintf(line, sizeof(line), "power_states %u %u %u %u %u %u\n",
+                power_states[0], power_states[1], power_states[2],
+                power_states[3], power_states[4], power_states[5]);
+  dump += prefix + line;
+  std::snprintf(line, sizeof(line), "startup_delay_us %u\n",
+                program.startup_delay_us);
+  dump += prefix + line;
+  return dump;
+}
+
+namespace {
+// Whether the programmed entries are the start of the program's ones
+template <typename T>
+bool isPrefix(const std::optional<std::vector<T>>& programmed,
+              std::span<const T> program) {
+  return programmed.has_value() && programmed->size() <= program.size() &&
+         std::equal(programmed->begin(), programmed->end(), program.begin());
+}
+
+size_t countTriggered(std::span<const GeneratorSignal> signals) {
+  return std::count_if(signals.begin(), signals.end(),
+                       [](const GeneratorSignal& signal) {
+                         return signal.triggered;
+                       });
+}
+
+// Replace the programmed entries, keeping the capacity
+template <typename T>
+void assignProgrammed(std::optional<std::vector<T>>& programmed,
+                      std::span<const T> program) {
+  if (!programmed.has_value()) {
+    programmed.emplace();
+  }
+  programmed->assign(program.begin(), program.end());
+}
+}  // namespace
+
+BatchSetUp BatchSetUp::full(const BatchProgramView& program) {
+  BatchSetUp set_up = full(program.signals.size());
+  set_up.n_added_triggered_signals = countTriggered(program.signals);
+  set_up.n_added_trigger_points = program.trigger_points.size();
+  return set_up;
+}
+
+BatchSetUp DeviceState::diff(const BatchProgramView& program) const {
+  BatchSetUp set_up = BatchSetUp::full(program);
+  // Trigger points are added after all signals, so signals can only be
+  // added while no trigger point is programmed
+  if (isPrefix(signals, program.signals) &&
+      isPrefix(trigger_points, program.trigger_points) &&
+      (trigger_points->empty() ||
+       signals->size() == program.signals.size())) {
+    set_up.reset = false;
+    set_up.n_added_signals = program.signals.size() - signals->size();
+    set_up.n_added_triggered_signals =
+        countTriggered(program.signals.subspan(signals->size()));
+    set_up.n_added_trigger_points =
+        program.trigger_points.size() - trigger_points->size();
+  }
+  set_up.set_brightness =
+      !brightness.has_value() || *brightness != program.brightness;
+  return set_up;
+}
+
+void DeviceState::setProgrammed(const BatchProgramView& program) {
+  assignProgrammed(signals, program.signals);
+  assignProgrammed(trigger_points, program.trigger_points);
+  brightness = program.brightness;
+}
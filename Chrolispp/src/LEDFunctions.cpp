@@ -1,6 +1,7 @@
 
 #include "LEDFunctions.hpp"
 
+#include <cmath>
 #include <exception>
 #include <iostream>
 #include <string>
@@ -10,16 +11,6 @@
 
 const char DATA_LIGHT_OFF[] = "1";
 
-bool LED_ValidateLEDIndex(ViUInt16 led_index) {
-  /* Validate LED index. Returns true if valid, false if invalid.
-  Valid indices are 0-5 (6 LEDs).
-*/
-  if (led_index < 0 || led_index > 5) {
-    return false;
-  }
-  return true;
-}
-
 bool LED_HandleBreak(ViUInt32 time_between_pulses_ms, ViUInt32 brightness) {
   // a break is defined by 0 brightness. Then the time_between_pulses_ms is
   // considered. Other logical definitions of break should be unified in the
@@ -34,48 +25,6 @@ bool LED_HandleBreak(ViUInt32 time_between_pulses_ms, ViUInt32 brightness) {
   return false;
 }
 
-bool LED_ValidateBrightness(ViUInt16& brightness) {
-  /* Validate brightness value. If out of range, bring into range (negative
-   * values to 0 [i.e. break], >1000 values to 1000 [i.e. 100.0%]). Returns true
-   * if brightness was in range, false if it was out of range and had to be
-   * changed.
-   */
-  if (brightness > 1000) {
-    std::cout << "Brightness > 100.0%: " << std::to_string(brightness)
-              << "... Using value 1000 (100.0%)" << std::endl;
-    brightness = 1000;
-    return false;
-  }
-  return true;
-}
-
-bool LED_ValidateParams(ViUInt16 led_index, ViUInt32 n_pulses,
-                        ViUInt16& brightness) {
-  // DEPRECATED. Use ProtocolPlanner::validateStep instead.
-  /* Validate parameters for LED pulsing functions. Returns true if protocol
-    should proceed, false if no action should be taken. Raises exception if LED
-    index is invalid. If necessary, brings LED power into valid range (negative
-    values to 0 [i.e. break], >1000 values to 1000 [i.e. 100.0%]). Checks the
-    following:
-    1. If n_pulses is 0, return false (no action).
-    2. If led_index is out of range (not 0-5), raise out_of_range exception.
-    3. If brightness is out of range (not 0-1000), warn user and bring into
-    range, then proceed with check.
-    4. Otherwise, return true (proceed with protocol).
-  */
-  if (n_pulses == 0) {  // if 0 pulses (and not a break, i.e. pulse_width_ms !=
-                        // 0), do not do anything.
-    std::cout           // TODO: handle this more elegantly, pre-check input?
-        << "0 pulses and pulse duration != 0, not a valid step..." << std::endl;
-    return false;
-  }
-  if (!LED_ValidateLEDIndex(led_index)) {
-    throw std::out_of_range("LED index invalid: " + std::to_string(led_index));
-  }
-  LED_ValidateBrightness(brightness);
-  return true;
-}
-
 bool LED_isBreak(ViUInt32 pulse_width_ms, ViUInt32 time_between_pulses_ms,
                  ViUInt32 brightness) {
   // DEPRECATED, use isBreak() in ProtocolPlanner.cpp instead.
@@ -96,24 +45,24 @@ use_bob: whether to use breakout board to output the same signal on a TTL
 output. As the LED and the BOB signal use same internal timer, they should be
 synchronized, but cannot be guaranteed by this software.
 */
-ViStatus LED_ConfigureSingleStep(ViSession instr, ViUInt16 led_index,
+ViStatus LED_ConfigureSingleStep(ChrolisDevice* device_ptr, ViUInt16 led_index,
                                  ViUInt32 start_delay_us,
                                  ViUInt32 pulse_width_ms,
                                  ViUInt32 time_between_pulses_ms,
                                  ViUInt32 n_pulses, ViUInt16 brightness,
                                  bool use_bob) {
   ViStatus err;  // TODO: add error handling
-  err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-      instr, led_index + 1, VI_FALSE, start_delay_us, pulse_width_ms * 1000,
+  err = device_ptr->TU_AddGeneratedSelfRunningSignal(
+      led_index + 1, VI_FALSE, start_delay_us, pulse_width_ms * 1000,
       time_between_pulses_ms * 1000, n_pulses);
   if (use_bob) {
     // Also set up corresponding TTL output channel for getting output timing
     // signal (digital, i.e. no LED brightness info!) channels 7-12 are the
     // output channels
     // led_index + 1 + 6
-    err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-        instr, 6 + led_index + 1, VI_FALSE, start_delay_us,
-        pulse_width_ms * 1000, time_between_pulses_ms * 1000, n_pulses);
+    err = device_ptr->TU_AddGeneratedSelfRunningSignal(
+        6 + led_index + 1, VI_FALSE, start_delay_us, pulse_width_ms * 1000,
+        time_between_pulses_ms * 1000, n_pulses);
   }
   return err;
 }
@@ -128,7 +77,8 @@ order of the vectors, with no (intended) delay between them (i.e. the start time
 of step i+1 is the end time of step i). The function resets any previous
 configuration on the device.
 */
-ViStatus LED_ConfigureBatch(ViSession instr, std::vector<ViUInt16>& led_indices,
+ViStatus LED_ConfigureBatch(ChrolisDevice* device_ptr,
+                            std::vector<ViUInt16>& led_indices,
                             std::vector<ViUInt32>& pulse_widths_ms,
                             std::vector<ViUInt32>& times_between_pulses_ms,
                             std::vector<ViUInt32>& ns_pulses,
@@ -138,7 +88,7 @@ ViStatus LED_ConfigureBatch(ViSession instr, std::vector<ViUInt16>& led_indices,
       0b000000;  // bitmask of which LEDs are already used in this batch
   size_t size = led_indices.size();  // assuming all vectors have the same size
   ViStatus err;
-  err = TL6WL_TU_ResetSequence(instr);
+  err = device_ptr->TU_ResetSequence();
   int total_duration_us = 0;
   // TODO: add error handling
   for (size_t i = 0; i < size; ++i) {
@@ -151,7 +101,7 @@ ViStatus LED_ConfigureBatch(ViSession instr, std::vector<ViUInt16>& led_indices,
     LED_ValidateParams(led_index, n_pulses, brightness);
     LED_ValidateBrightness(brightness);
 
-    err = LED_ConfigureSingleStep(instr, led_index, total_duration_us,
+    err = LED_ConfigureSingleStep(device_ptr, led_index, total_duration_us,
                                   pulse_width_ms, time_between_pulses_ms,
                                   n_pulses, brightness, bob);
     if (err != VI_SUCCESS) {
@@ -163,14 +113,14 @@ ViStatus LED_ConfigureBatch(ViSession instr, std::vector<ViUInt16>& led_indices,
   return err;
 }
 
-ViStatus LED_DoSequence(ViSession instr, ViUInt16 led_index,
+ViStatus LED_DoSequence(ChrolisDevice* device_ptr, ViUInt16 led_index,
                         ViUInt32 pulse_width_ms,
                         ViUInt32 time_between_pulses_ms, ViUInt32 n_pulses,
                         ViInt16 brightness, bool use_bob) {
   /* Perform the LED sequence WITHOUT performing any parameter validation (use
    * LED_PulseNTimes or LED_PulseNTimesWithArduino instead).
    * Parameters:
-   *    instr: ViSession handle to the TL6WL device.
+   *    device_ptr: the TL6WL device (or a simulated one).
    *    led_index: 0-5 for the 6 LEDs.
    *    pulse_width_ms: LED on time within one cycle in milliseconds.
    *        time_between_pulses_ms: Time between the end of one pulse and the
@@ -189,32 +139,32 @@ ViStatus LED_DoSequence(ViSession instr, ViUInt16 led_index,
                              VI_FALSE, VI_FALSE, VI_FALSE};
   led_brightnesses[led_index] = brightness;
   led_states[led_index] = VI_TRUE;
-  err = TL6WL_TU_ResetSequence(instr);
-  err = TL6WL_setLED_HeadBrightness(instr, led_brightnesses[0], led_brightnesses[1],
-                              led_brightnesses[2], led_brightnesses[3],
-                              led_brightnesses[4], led_brightnesses[5]);
+  err = device_ptr->TU_ResetSequence();
+  err = device_ptr->setLED_HeadBrightness(
+      led_brightnesses[0], led_brightnesses[1], led_brightnesses[2],
+      led_brightnesses[3], led_brightnesses[4], led_brightnesses[5]);
   // led_index is 0-indexing (0-5), need 1-6; function takes us values, so ms
   // * 1000
   // TODO: add error handling, see (example code)
   // https://github.com/Thorlabs/Light_Sources_Examples/blob/main/C%2B%2B/C_Chrolis/CHROLIS_CSample/CHROLIS_TimingUnit_CppSample.cpp
   ViUInt32 delay_duration_us = Constants::STARTUP_GUARD_US;  // Startup guard to avoid first spike being cut off.
-  err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-      instr, led_index + 1, VI_FALSE, delay_duration_us, pulse_width_ms * 1000,
-	  time_between_pulses_ms * 1000, n_pulses); 
+  err = device_ptr->TU_AddGeneratedSelfRunningSignal(
+      led_index + 1, VI_FALSE, delay_duration_us, pulse_width_ms * 1000,
+      time_between_pulses_ms * 1000, n_pulses);
   if (use_bob) {
     // Also set up corresponding TTL output channel for getting output timing
     // signal (digital, i.e. no LED brightness info!) channels 7-12 are the
     // output channels
     // led_index + 1 + 6
-    err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-        instr, 7, VI_FALSE, delay_duration_us, pulse_width_ms * 1000,
+    err = device_ptr->TU_AddGeneratedSelfRunningSignal(
+        7, VI_FALSE, delay_duration_us, pulse_width_ms * 1000,
         time_between_pulses_ms * 1000, n_pulses);
   }
   // Official suggestion is to start generator and only then power on LED. Hence the need for guard time above.
-  err = TL6WL_TU_StartStopGeneratorOutput_TU(instr, true);
-  TL6WL_setLED_HeadPowerStates(instr, led_states[0], led_states[1],
-                               led_states[2], led_states[3], led_states[4],
-                               led_states[5]);
+  err = device_ptr->TU_StartStopGeneratorOutput_TU(true);
+  device_ptr->setLED_HeadPowerStates(led_states[0], led_states[1],
+                                     led_states[2], led_states[3],
+                                     led_states[4], led_states[5]);
   Sleep(n_pulses *
         (pulse_width_ms +
          time_between_pulses_ms) + delay_duration_us);  // TODO: more sophisticated waiting, maybe
@@ -222,14 +172,14 @@ ViStatus LED_DoSequence(ViSession instr, ViUInt16 led_index,
   return err;
 }
 
-void LED_PulseNTimes(ViSession instr, ViUInt16 led_index,
+void LED_PulseNTimes(ChrolisDevice* device_ptr, ViUInt16 led_index,
                      ViUInt32 pulse_width_ms, ViUInt32 time_between_pulses_ms,
                      ViUInt32 n_pulses, ViUInt16& brightness, bool use_bob) {
   /* Pulse the specified LED n times with the given parameters. One such
    * sequence of N pulses consists of [LED on, LED off] N times. The value of
    * brightness may be overwritten if it is out of range.
    * Parameters:
-   *    instr: ViSession handle to the TL6WL device.
+   *    device_ptr: the TL6WL device (or a simulated one).
    *    led_index: 0-5 for the 6 LEDs.
    *    pulse_width_ms: LED on time within one cycle in milliseconds.
    *        time_between_pulses_ms: Time between the end of one pulse and the
@@ -259,8 +209,8 @@ void LED_PulseNTimes(ViSession instr, ViUInt16 led_index,
     std::cout << "LED_ValidateParams: " << e.what() << std::endl;
     return;
   }
-  err = LED_DoSequence(instr, led_index, pulse_width_ms, time_between_pulses_ms,
-                       n_pulses, brightness, use_bob);
+  err = LED_DoSequence(device_ptr, led_index, pulse_width_ms,
+                       time_between_pulses_ms, n_pulses, brightness, use_bob);
   if (VI_SUCCESS != err) {
     printf(" LED_DoSequenceWithBOB  :\n    Error Code = %#.8lX\n", err);
   } else {
@@ -268,7 +218,7 @@ void LED_PulseNTimes(ViSession instr, ViUInt16 led_index,
   }
 }
 
-void LED_PulseNTimesWithArduino(ViSession instr, ViUInt16 led_index,
+void LED_PulseNTimesWithArduino(ChrolisDevice* device_ptr, ViUInt16 led_index,
                                 ViUInt32 pulse_width_ms,
                                 ViUInt32 time_between_pulses_ms,
                                 ViUInt32 n_pulses, ViUInt16& brightness,
@@ -346,8 +296,8 @@ void LED_PulseNTimesWithArduino(ViSession instr, ViUInt16 led_index,
     }
   }
 
-  err = LED_DoSequence(instr, led_index, pulse_width_ms, time_between_pulses_ms,
-                       n_pulses, brightness, use_bob);
+  err = LED_DoSequence(device_ptr, led_index, pulse_width_ms,
+                       time_between_pulses_ms, n_pulses, brightness, use_bob);
   // Write the "off" command to the Arduino
   if (brightness_remapped >= 0) {
     if (!WriteFile(h_Serial, DATA_LIGHT_OFF, sizeof(DATA_LIGHT_OFF),
@@ -362,34 +312,3 @@ void LED_PulseNTimesWithArduino(ViSession instr, ViUInt16 led_index,
     printf("Successful LED sequence\n");
   }
 }
-
-std::string readBoxStatusWarnings(ViUInt32 boxStatus) {
-  int bit0, bit1, bit2, bit3, bit4, bit5, bit6;
-  if (bit0 = (boxStatus & 0x01)) {
-    return "Box is open";
-  } else if (bit1 = (boxStatus & 0x02)) {
-    return "LLG not connected";
-  } else if (bit2 = (boxStatus & 0x04)) {
-    return "Interlock is open";
-  }
-
-  else if (bit3 = (boxStatus & 0x08)) {
-    return "Using default adjustment";
-  } else if (bit4 = (boxStatus & 0x10)) {
-    return "Box overheated";
-  }
-
-  else if (bit5 = (boxStatus & 0x20)) {
-    return "LED overheated";
-  } else if (bit6 = (boxStatus & 0x40)) {
-    return "Box setup invalid";
-  }
-  // If LED or Box overheated, abort protocol
-  if (bit4 || bit5) {
-    throw led_machine_error("Box or LED overheated. Protocol aborted.");
-  }
-  // If everything all right, do not return any warnings
-  return "";
-}
-
-
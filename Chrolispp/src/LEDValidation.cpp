@@ -0,0 +1,86 @@
+#include "LEDValidation.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+bool LED_ValidateLEDIndex(ViUInt16 led_index) {
+  /* Validate LED index. Returns true if valid, false if invalid.
+  Valid indices are 0-5 (6 LEDs).
+*/
+  if (led_index < 0 || led_index > 5) {
+    return false;
+  }
+  return true;
+}
+
+bool LED_ValidateBrightness(ViUInt16& brightness) {
+  /* Validate brightness value. If out of range, bring into range (negative
+   * values to 0 [i.e. break], >1000 values to 1000 [i.e. 100.0%]). Returns true
+   * if brightness was in range, false if it was out of range and had to be
+   * changed.
+   */
+  if (brightness > 1000) {
+    std::cout << "Brightness > 100.0%: " << std::to_string(brightness)
+              << "... Using value 1000 (100.0%)" << std::endl;
+    brightness = 1000;
+    return false;
+  }
+  return true;
+}
+
+bool LED_ValidateParams(ViUInt16 led_index, ViUInt32 n_pulses,
+                        ViUInt16& brightness) {
+  // DEPRECATED. Use ProtocolPlanner::validateStep instead.
+  /* Validate parameters for LED pulsing functions. Returns true if protocol
+    should proceed, false if no action should be taken. Raises exception if LED
+    index is invalid. If necessary, brings LED power into valid range (negative
+    values to 0 [i.e. break], >1000 values to 1000 [i.e. 100.0%]). Checks the
+    following:
+    1. If n_pulses is 0, return false (no action).
+    2. If led_index is out of range (not 0-5), raise out_of_range exception.
+    3. If brightness is out of range (not 0-1000), warn user and bring into
+    range, then proceed with check.
+    4. Otherwise, return true (proceed with protocol).
+  */
+  if (n_pulses == 0) {  // if 0 pulses (and not a break, i.e. pulse_width_ms !=
+                        // 0), do not do anything.
+    std::cout           // TODO: handle this more elegantly, pre-check input?
+        << "0 pulses and pulse duration != 0, not a valid step..." << std::endl;
+    return false;
+  }
+  if (!LED_ValidateLEDIndex(led_index)) {
+    throw std::out_of_range("LED index invalid: " + std::to_string(led_index));
+  }
+  LED_ValidateBrightness(brightness);
+  return true;
+}
+
+std::string readBoxStatusWarnings(ViUInt32 boxStatus) {
+  int bit0, bit1, bit2, bit3, bit4, bit5, bit6;
+  if (bit0 = (boxStatus & 0x01)) {
+    return "Box is open";
+  } else if (bit1 = (boxStatus & 0x02)) {
+    return "LLG not connected";
+  } else if (bit2 = (boxStatus & 0x04)) {
+    return "Interlock is open";
+  }
+
+  else if (bit3 = (boxStatus & 0x08)) {
+    return "Using default adjustment";
+  } else if (bit4 = (boxStatus & 0x10)) {
+    return "Box overheated";
+  }
+
+  else if (bit5 = (boxStatus & 0x20)) {
+    return "LED overheated";
+  } else if (bit6 = (boxStatus & 0x40)) {
+    return "Box setup invalid";
+  }
+  // If LED or Box overheated, abort protocol
+  if (bit4 || bit5) {
+    throw led_machine_error("Box or LED overheated. Protocol aborted.");
+  }
+  // If everything all right, do not return any warnings
+  return "";
+}
@@ -0,0 +1,114 @@
+#include "LogRecords.hpp"
+
+#include <cctype>
+#include <cstdio>
+
+LogEventData LogEventData::make(LogEvent event, uint32_t batch_id,
+                                uint32_t step_id, int32_t status,
+                                std::initializer_list<uint32_t> args) {
+  LogEventData data{};
+  data.event = event;
+  data.batch_id = batch_id;
+  data.step_id = step_id;
+  data.status = status;
+  for (uint32_t arg : args) {
+    if (data.n_args == MAX_ARGS) {
+      break;
+    }
+    data.args[data.n_args++] = arg;
+  }
+  return data;
+}
+
+const char* logTypeString(LogType type) {
+  switch (type) {
+    case LogType::Trace:
+      return "[TRACE]";
+    case LogType::Error:
+      return "[ERROR]";
+    case LogType::Info:
+      return "[INFO]";
+    case LogType::Protocol:
+      return "[PROTOCOL]";
+    case LogType::Warning:
+      return "[WARNING]";
+  }
+  return "[UNKNOWN]";
+}
+
+bool parseLogType(std::string_view name, LogType& type) {
+  constexpr LogType types[] = {LogType::Trace, LogType::Error, LogType::Info,
+                               LogType::Protocol, LogType::Warning};
+  for (LogType candidate : types) {
+    // Compare without the brackets of "[TRACE]"
+    std::string_view candidate_name = logTypeString(candidate);
+    candidate_name = candidate_name.substr(1, candidate_name.size() - 2);
+    if (candidate_name.size() != name.size()) {
+      continue;
+    }
+    bool equal = true;
+    for (size_t i = 0; i < name.size() && equal; i++) {
+      equal = std::toupper(static_cast<unsigned char>(name[i])) ==
+              candidate_name[i];
+    }
+    if (equal) {
+      type = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* logEventName(LogEvent event) {
+  switch (event) {
+    case LogEvent::SetHeadPowerStates:
+      return "setLED_HeadPowerStates";
+    case LogEvent::SetHeadBrightness:
+      return "setLED_HeadBrightness";
+    case LogEvent::SetLinearModeValue:
+      return "setLED_LinearModeValue";
+    case LogEvent::ResetSequence:
+      return "TU_ResetSequence";
+    case LogEvent::AddSelfRunningSignal:
+      return "TU_AddGeneratedSelfRunningSignal";
+    case LogEvent::StartStopGenerator:
+      return "TU_StartStopGeneratorOutput_TU";
+    case LogEvent::Close:
+      return "close";
+    case LogEvent::BatchLate:
+      return "BatchLate";
+    case LogEvent::AddTriggeredSignal:
+      return "TU_AddGeneratedTriggeredSignal";
+    case LogEvent::AddTriggerPoint:
+      return "TU_AddTriggerPoint";
+    case LogEvent::LoopBackTrigger:
+      return "TU_LoopBackTrigger";
+    case LogEvent::Count:
+      break;
+  }
+  return "UnknownEvent";
+}
+
+std::string renderLogEvent(const LogEventData& data) {
+  char buffer[256];
+  int length = 0;
+  if (data.event == LogEvent::BatchLate) {
+    length = std::snprintf(buffer, sizeof(buffer),
+                           "Batch %u started %u us late.", data.batch_id,
+                           data.n_args > 0 ? data.args[0] : 0);
+    return std::string(buffer, length);
+  }
+  length = std::snprintf(buffer, sizeof(buffer), "%s(", logEventName(data.event));
+  for (uint8_t i = 0; i < data.n_args && i < LogEventData::MAX_ARGS; i++) {
+    length += std::snprintf(buffer + length, sizeof(buffer) - length,
+                            i == 0 ? "%u" : ", %u", data.args[i]);
+  }
+  length += std::snprintf(buffer + length, sizeof(buffer) - length,
+                          ") = %d (batch %u", data.status, data.batch_id);
+  if (data.step_id != LogEventData::NO_STEP) {
+    length += std::snprintf(buffer + length, sizeof(buffer) - length,
+                            ", step %u", data.step_id);
+  }
+  length += std::snprintf(buffer + length, sizeof(buffer) - length, ")");
+  return std::string(buffer, length);
+}
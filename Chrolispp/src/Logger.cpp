@@ -1,99 +1,302 @@
 #include "Logger.hpp"
-// TODO: I think right now, all access is synchronous, so no need for mutexes.
-// But if ever the possibility of async logging arises, need to implement a
-// parallel-compatible (concurrent) queue and a separate writing
-Logger::Logger(const std::string& filename) {
-  logFile.open(filename, std::ios::out | std::ios::app);
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// How often the writer thread drains the ring buffer without being asked to
+constexpr std::chrono::milliseconds WRITER_PERIOD(50);
+
+size_t roundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+int64_t ticksToNs(int64_t ticks) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::duration(ticks))
+      .count();
+}
+}  // namespace
+
+Logger::Logger(const std::string& filename, LogFormat format,
+               size_t ring_capacity, size_t high_water_mark)
+    : ring_mask(roundUpToPowerOfTwo(ring_capacity < 2 ? 2 : ring_capacity) -
+                1),
+      high_water_mark(high_water_mark == 0 ? (ring_mask + 1) / 2
+                                           : high_water_mark) {
+  if (format == LogFormat::Binary) {
+    logFile.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  } else {
+    logFile.open(filename, std::ios::out | std::ios::app);
+  }
   if (!logFile.is_open()) {
     throw std::runtime_error("Could not open log file: " + filename);
   }
+  if (format == LogFormat::Binary) {
+    BinaryLog::Header header;
+    header.version = BinaryLog::VERSION;
+    header.wall_clock_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            timestamp_formatter.getWallEpoch().time_since_epoch())
+            .count();
+    header.steady_clock_ns = ticksToNs(
+        timestamp_formatter.getSteadyEpoch().time_since_epoch().count());
+    binary_writer = std::make_unique<BinaryLog::Writer>(logFile, header);
+  }
+  ring = std::make_unique<LogRecord[]>(ring_mask + 1);
+  writer = std::thread(&Logger::writerLoop, this);
 }
 
 Logger::~Logger() {
-  flush();  // ensure all buffered messages are written
+  {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    stop_requested = true;
+  }
+  writer_wakeup.notify_one();
+  writer.join();  // the writer drains everything before it stops
   if (logFile.is_open()) {
     logFile.close();
   }
 }
 
-void Logger::log(LogType type, const std::string& message) {
-  buffer.push_back({type, getTimestamp(), message});
+bool Logger::hasRoom(size_t n_records, uint64_t current_head) {
+  size_t capacity = ring_mask + 1;
+  if (current_head + n_records - cached_tail > capacity) {
+    cached_tail = tail.load(std::memory_order_acquire);
+  }
+  return current_head + n_records - cached_tail <= capacity;
+}
+
+bool Logger::reserve(size_t n_records, uint64_t& current_head) {
+  current_head = head.load(std::memory_order_relaxed);
+  if (hasRoom(n_records, current_head)) {
+    return true;
+  }
+  if (busy.load(std::memory_order_relaxed) || n_records > ring_mask + 1) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // Nothing is time critical outside a busy window: let the writer drain
+  std::unique_lock<std::mutex> lock(writer_mutex);
+  while (!hasRoom(n_records, current_head)) {
+    waiting_for_room.store(true);
+    writer_wakeup.notify_one();
+    room_available.wait(lock);
+  }
+  return true;
+}
+
+void Logger::log(LogType type, std::string_view message) {
+  if (!isEnabled(type)) {
+    return;
+  }
+  int64_t ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+  size_t n_records =
+      message.empty() ? 1
+                      : (message.size() + LogRecord::TEXT_CAPACITY - 1) /
+                            LogRecord::TEXT_CAPACITY;
+  uint64_t current_head;
+  if (!reserve(n_records, current_head)) {
+    return;
+  }
+  for (size_t i = 0; i < n_records; i++) {
+    LogRecord& record = ring[(current_head + i) & ring_mask];
+    size_t offset = i * LogRecord::TEXT_CAPACITY;
+    size_t length = message.size() - offset < LogRecord::TEXT_CAPACITY
+                        ? message.size() - offset
+                        : LogRecord::TEXT_CAPACITY;
+    record.ticks = ticks;
+    record.type = type;
+    record.flags = (i + 1 < n_records) ? LogRecord::CONTINUED : 0;
+    record.length = static_cast<uint16_t>(length);
+    if (length > 0) {
+      std::memcpy(record.text, message.data() + offset, length);
+    }
+  }
+  // Publish all records of the message at once
+  head.store(current_head + n_records, std::memory_order_release);
+}
+
+void Logger::logEvent(LogType type, LogEvent event, uint32_t batch_id,
+                      uint32_t step_id, int32_t status,
+                      std::initializer_list<uint32_t> args) {
+  int64_t ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+  uint64_t current_head;
+  if (!reserve(1, current_head)) {
+    return;
+  }
+  LogRecord& record = ring[current_head & ring_mask];
+  LogEventData data =
+      LogEventData::make(event, batch_id, step_id, status, args);
+  record.ticks = ticks;
+  record.type = type;
+  record.flags = LogRecord::EVENT;
+  record.length = static_cast<uint16_t>(sizeof(data));
+  std::memcpy(record.text, &data, sizeof(data));
+  head.store(current_head + 1, std::memory_order_release);
 }
 
-void Logger::trace(const std::string& message) { log(LogType::Trace, message); }
-void Logger::error(const std::string& message) { log(LogType::Error, message); }
-void Logger::info(const std::string& message) { log(LogType::Info, message); }
-void Logger::protocol(const std::string& message) {
+void Logger::error(std::string_view message) { log(LogType::Error, message); }
+void Logger::info(std::string_view message) { log(LogType::Info, message); }
+void Logger::protocol(std::string_view message) {
   log(LogType::Protocol, message);
 }
 
-void Logger::warning(const std::string& message) {
+void Logger::warning(std::string_view message) {
   log(LogType::Warning, message);
 }
 
-void Logger::multiLineInfo(char* msg) {
-  std::istringstream stream(msg);
-  std::string line;
+void Logger::multiLineInfo(std::string_view text) {
+  while (!text.empty()) {
+    size_t end = text.find('\n');
+    info(text.substr(0, end));  // Each line gets its own timestamp
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+  }
+}
 
-  while (std::getline(stream, line)) {
-    info(line);  // Each line gets its own timestamp
+void Logger::multiLineProtocol(std::string_view text) {
+  while (!text.empty()) {
+    size_t end = text.find('\n');
+    protocol(text.substr(0, end));  // Each line gets its own timestamp
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
   }
 }
 
-void Logger::multiLineProtocol(char* msg) {
-  std::istringstream stream(msg);
-  std::string line;
+void Logger::flush() {
+  if (busy.load(std::memory_order_relaxed)) {
+    throw std::logic_error("Logger::flush() called inside a busy window.");
+  }
+  std::unique_lock<std::mutex> lock(writer_mutex);
+  uint64_t request = ++flush_requests;
+  writer_wakeup.notify_one();
+  flush_done.wait(lock, [this, request] { return flushes_done >= request; });
+}
 
-  while (std::getline(stream, line)) {
-    protocol(line);  // Each line gets its own timestamp
+void Logger::beginBusyWindow() {
+  busy.store(true);
+  // Wait for the writer to finish the line it may be writing; it checks the
+  // busy flag before the next one.
+  while (writer_active.load()) {
   }
 }
 
-std::string Logger::format(const LogMessage& msg) {
-  std::string typeStr;
-  switch (msg.type) {
-    case LogType::Trace:
-      typeStr = "[TRACE]";
-      break;
-    case LogType::Error:
-      typeStr = "[ERROR]";
-      break;
-    case LogType::Info:
-      typeStr = "[INFO]";
-      break;
-    case LogType::Protocol:
-      typeStr = "[PROTOCOL]";
-      break;
-    case LogType::Warning:
-      typeStr = "[WARNING]";
-      break;
+void Logger::endBusyWindow() {
+  busy.store(false);
+  size_t fill = static_cast<size_t>(head.load(std::memory_order_relaxed) -
+                                    tail.load(std::memory_order_relaxed));
+  if (fill >= high_water_mark) {
+    writer_wakeup.notify_one();
+  }
+}
+
+bool Logger::enterWrite(bool ignore_busy) {
+  writer_active.store(true);
+  if (!ignore_busy && busy.load()) {
+    writer_active.store(false);
+    return false;
   }
-  std::ostringstream oss;
-  oss << msg.timestamp << "\t" << typeStr << "\t" << msg.message;
-  return oss.str();
+  return true;
 }
-std::string Logger::getTimestamp() {
-  auto now = std::chrono::system_clock::now();
-  std::time_t now_time = std::chrono::system_clock::to_time_t(now);
-  std::tm now_tm;
-  localtime_s(&now_tm, &now_time);
 
-  char buffer[30];
-  std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &now_tm);
+void Logger::writerLoop() {
+  std::unique_lock<std::mutex> lock(writer_mutex);
+  for (;;) {
+    writer_wakeup.wait_for(lock, WRITER_PERIOD, [this] {
+      return stop_requested || waiting_for_room.load() ||
+             (flush_requests > flushes_done && !busy.load());
+    });
+    bool stopping = stop_requested;
+    // Everything logged before these requests is visible to drain()
+    uint64_t requests = flush_requests;
+    lock.unlock();
+    // Only the final drain ignores busy windows, nothing is time critical
+    // when the logger is destroyed.
+    bool complete = drain(stopping);
+    lock.lock();
+    if (complete) {
+      flushes_done = requests;
+      flush_done.notify_all();
+    }
+    if (waiting_for_room.exchange(false)) {
+      room_available.notify_one();
+    }
+    if (stopping) {
+      return;
+    }
+  }
+}
 
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now.time_since_epoch()) %
-            1000;
-  char timestamp[40];
-  std::snprintf(timestamp, sizeof(timestamp), "%s.%03d", buffer,
-                static_cast<int>(ms.count()));
+bool Logger::drain(bool ignore_busy) {
+  uint64_t current_tail = tail.load(std::memory_order_relaxed);
+  uint64_t current_head = head.load(std::memory_order_acquire);
+  std::string message;
+  bool complete = true;
+  // One message (possibly several records) at a time, so that a busy window
+  // never waits for more than one line.
+  while (current_tail != current_head) {
+    if (!enterWrite(ignore_busy)) {
+      complete = false;
+      break;
+    }
+    uint64_t message_tail = current_tail;
+    if (ring[message_tail & ring_mask].flags & LogRecord::EVENT) {
+      const LogRecord& record = ring[message_tail & ring_mask];
+      LogEventData data;
+      std::memcpy(&data, record.text, sizeof(data));
+      writeEvent(record.type, record.ticks, data);
+      message_tail++;
+    } else {
+      for (;;) {
+        const LogRecord& record = ring[message_tail & ring_mask];
+        message.append(record.text, record.length);
+        message_tail++;
+        if (!(record.flags & LogRecord::CONTINUED)) {
+          writeLine(record.type, record.ticks, message);
+          break;
+        }
+      }
+    }
+    leaveWrite();
+    message.clear();
+    current_tail = message_tail;
+    // Release the slots right away, the producer may be waiting for room
+    tail.store(current_tail, std::memory_order_release);
+  }
+  if (!enterWrite(ignore_busy)) {
+    return false;
+  }
+  uint64_t dropped_now = dropped.load(std::memory_order_relaxed);
+  if (dropped_now != dropped_reported) {
+    writeLine(LogType::Warning,
+              std::chrono::steady_clock::now().time_since_epoch().count(),
+              "Logger: " + std::to_string(dropped_now - dropped_reported) +
+                  " message(s) dropped, ring buffer full.");
+    dropped_reported = dropped_now;
+  }
+  logFile.flush();
+  leaveWrite();
+  return complete;
+}
 
-  return timestamp;
+void Logger::writeLine(LogType type, int64_t ticks, std::string_view message) {
+  if (binary_writer) {
+    binary_writer->writeText(ticksToNs(ticks), type, message);
+    return;
+  }
+  char timestamp[TimestampFormatter::LENGTH];
+  logFile.write(timestamp, timestamp_formatter.format(ticks, timestamp));
+  logFile << '\t' << logTypeString(type) << '\t' << message << '\n';
 }
 
-void Logger::flush() {
-  for (const auto& msg : buffer) {
-    logFile << format(msg) << std::endl;
+void Logger::writeEvent(LogType type, int64_t ticks, const LogEventData& data) {
+  if (binary_writer) {
+    binary_writer->writeEvent(ticksToNs(ticks), type, data);
+    return;
   }
-  buffer.clear();
-}
\ No newline at end of file
+  writeLine(type, ticks, renderLogEvent(data));
+}
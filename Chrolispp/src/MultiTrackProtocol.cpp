@@ -0,0 +1,245 @@
+#include "MultiTrackProtocol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "LEDValidation.hpp"
+#include "constants.hpp"
+
+namespace {
+std::string trainName(size_t i_track, size_t i_train) {
+  return "track " + std::to_string(i_track + 1) + ", train " +
+         std::to_string(i_train + 1);
+}
+
+void validateTrain(const TrackPulseTrain& train, size_t i_track,
+                   size_t i_train) {
+  if (!LED_ValidateLEDIndex(train.led_index)) {
+    throw std::invalid_argument("Invalid LED index in " +
+                                trainName(i_track, i_train));
+  }
+  if (train.brightness > 1000) {
+    throw std::invalid_argument("Invalid brightness in " +
+                                trainName(i_track, i_train));
+  }
+  if (train.n_pulses == 0 || train.pulse_width_us == 0) {
+    throw std::invalid_argument("No pulses in " + trainName(i_track, i_train));
+  }
+}
+
+struct OrderedTrain {
+  const TrackPulseTrain* train;
+  size_t i_track;
+  size_t i_train;
+};
+
+// The trains in order of their start (in track order on a tie), checked
+std::vector<OrderedTrain> orderTrains(const MultiTrackProtocol& protocol) {
+  std::vector<OrderedTrain> trains;
+  trains.reserve(protocol.getTrainCount());
+  for (size_t i_track = 0; i_track < protocol.tracks.size(); i_track++) {
+    const std::vector<TrackPulseTrain>& track = protocol.tracks[i_track];
+    for (size_t i_train = 0; i_train < track.size(); i_train++) {
+      validateTrain(track[i_train], i_track, i_train);
+      if (i_train > 0 &&
+          track[i_train].start_us < track[i_train - 1].getEndUs()) {
+        throw std::invalid_argument(trainName(i_track, i_train) +
+                                    " starts before the train before it "
+                                    "ends.");
+      }
+      trains.push_back({&track[i_train], i_track, i_train});
+    }
+  }
+  if (trains.empty()) {
+    throw std::invalid_argument("No pulse trains in the protocol.");
+  }
+  std::stable_sort(trains.begin(), trains.end(),
+                   [](const OrderedTrain& a, const OrderedTrain& b) {
+                     return a.train->start_us < b.train->start_us;
+                   });
+  // Trains of one LED in other tracks
+  std::array<const OrderedTrain*, 6> last_of_led = {};
+  for (const auto& ordered : trains) {
+    const OrderedTrain*& last = last_of_led[ordered.train->led_index];
+    if (last != nullptr &&
+        ordered.train->start_us < last->train->getLastEdgeUs()) {
+      throw std::invalid_argument(
+          trainName(ordered.i_track, ordered.i_train) + " and " +
+          trainName(last->i_track, last->i_train) + " overlap on LED " +
+          std::to_string(ordered.train->led_index) + ".");
+    }
+    last = &ordered;
+  }
+  return trains;
+}
+}  // namespace
+
+size_t MultiTrackProtocol::getTrainCount() const {
+  size_t n_trains = 0;
+  for (const auto& track : tracks) {
+    n_trains += track.size();
+  }
+  return n_trains;
+}
+
+uint64_t MultiTrackProtocol::getDurationUs() const {
+  uint64_t duration_us = 0;
+  for (const auto& track : tracks) {
+    for (const auto& train : track) {
+      duration_us = std::max(duration_us, train.getEndUs());
+    }
+  }
+  return duration_us;
+}
+
+std::vector<TrackSegment> compileTrackSegments(
+    const MultiTrackProtocol& protocol, const BatchCostModel& model) {
+  std::vector<OrderedTrain> trains = orderTrains(protocol);
+  std::vector<TrackSegment> segments;
+  // Trains per LED of the current segment
+  std::array<size_t, 6> n_trains_per_led = {};
+  uint32_t step_id = 1;
+  for (const auto& ordered : trains) {
+    const TrackPulseTrain& train = *ordered.train;
+    size_t n_trains = n_trains_per_led[train.led_index];
+    bool fits = !segments.empty() &&
+                (n_trains == 0 ||
+                 (n_trains < model.signals_per_channel &&
+                  segments.back().program.brightness[train.led_index] ==
+                      train.brightness)) &&
+                Constants::STARTUP_GUARD_US +
+                        (train.start_us - segments.back().start_us) <=
+                    Constants::MAX_DEVICE_TIME_US;
+    if (!fits) {
+      if (!segments.empty()) {
+        if (train.start_us < segments.back().busy_end_us) {
+          throw std::invalid_argument(
+              trainName(ordered.i_track, ordered.i_train) +
+              " overlaps trains that cannot be programmed with it: more "
+              "trains of LED " + std::to_string(train.led_index) +
+              " than the timing unit takes, another brightness, or a start "
+              "delay longer than 32-bit us.");
+        }
+        segments.back().end_us = train.start_us;
+      }
+      segments.push_back({{}, {}, train.start_us, train.start_us, 0});
+      n_trains_per_led.fill(0);
+    }
+    TrackSegment& segment = segments.back();
+    BatchProgram& program = segment.program;
+    program.brightness[train.led_index] = train.brightness;
+    program.power_states[train.led_index] = VI_TRUE;
+    ViUInt32 start_delay_us = static_cast<ViUInt32>(
+        Constants::STARTUP_GUARD_US + (train.start_us - segment.start_us));
+    // LED signal, then the breakout box signal of the same LED
+    for (ViUInt8 signal_nr : {static_cast<ViUInt8>(train.led_index + 1),
+                              static_cast<ViUInt8>(train.led_index + 1 + 6)}) {
+      program.signals.push_back({signal_nr, VI_FALSE, start_delay_us,
+                                 train.pulse_width_us,
+                                 train.time_between_pulses_us,
+                                 train.n_pulses});
+      program.signal_step_ids.push_back(step_id);
+    }
+    segment.steps.emplace_back(step_id, train.led_index, train.pulse_width_us,
+                               train.time_between_pulses_us, train.n_pulses,
+                               train.brightness, true);
+    segment.busy_end_us =
+        std::max(segment.busy_end_us, train.getLastEdgeUs());
+    n_trains_per_led[train.led_index]++;
+    step_id++;
+  }
+  segments.back().end_us =
+      std::max(protocol.getDurationUs(), segments.back().busy_end_us);
+  return segments;
+}
+
+MultiTrackProtocol readMultiTrackCSV(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open protocol file: " + filename);
+  }
+  MultiTrackProtocol protocol;
+  std::map<long long, size_t> track_of_number;  // CSV track number, track index
+  std::string line;
+  size_t i_line = 0;
+  while (std::getline(file, line)) {
+    i_line++;
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+    std::stringstream ss(line);
+    std::vector<long long> row;
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+      try {
+        row.push_back(std::stoll(value));
+      } catch (const std::exception&) {
+        throw std::runtime_error("Invalid integer in line " +
+                                 std::to_string(i_line) + ": " + value);
+      }
+    }
+    if (row.size() != 7 && row.size() != 8) {
+      throw std::runtime_error("Expected 7 or 8 columns in line " +
+                               std::to_string(i_line) + ", got " +
+                               std::to_string(row.size()));
+    }
+    for (long long column : row) {
+      if (column < 0) {
+        throw std::runtime_error("Negative value in line " +
+                                 std::to_string(i_line));
+      }
+    }
+    // Checked before the casts below, so that a value does not wrap into range
+    if (row[2] > UINT16_MAX ||
+        !LED_ValidateLEDIndex(static_cast<ViUInt16>(row[2]))) {
+      throw std::runtime_error("Invalid LED index in line " +
+                               std::to_string(i_line));
+    }
+    if (row[6] > 1000) {
+      throw std::runtime_error("Invalid brightness in line " +
+                               std::to_string(i_line));
+    }
+    long long to_us = row.size() == 8 && row[7] != 0 ? 1 : 1000;
+    if (row[1] > INT64_MAX / to_us) {
+      throw std::runtime_error("Start time does not fit 64 bits in line " +
+                               std::to_string(i_line));
+    }
+    // The times of the pulses are programmed as they are, the start is not
+    if (row[3] > Constants::MAX_DEVICE_TIME_US / to_us ||
+        row[4] > Constants::MAX_DEVICE_TIME_US / to_us ||
+        row[5] > Constants::MAX_DEVICE_TIME_US) {
+      throw std::runtime_error(
+          "Pulse width, time between pulses (in us) or number of pulses does "
+          "not fit 32 bits in line " + std::to_string(i_line));
+    }
+    auto inserted =
+        track_of_number.emplace(row[0], protocol.tracks.size());
+    if (inserted.second) {
+      protocol.tracks.emplace_back();
+    }
+    protocol.tracks[inserted.first->second].push_back(
+        {static_cast<ViUInt16>(row[2]), static_cast<uint64_t>(row[1] * to_us),
+         static_cast<ViUInt32>(row[3] * to_us),
+         static_cast<ViUInt32>(row[4] * to_us), static_cast<ViUInt32>(row[5]),
+         static_cast<ViUInt16>(row[6])});
+  }
+  return protocol;
+}
+
+bool isMultiTrackCSV(const std::string& filename) {
+  std::ifstream file(filename);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+    size_t n_columns = std::count(line.begin(), line.end(), ',') + 1;
+    return n_columns == 7 || n_columns == 8;
+  }
+  return false;
+}
@@ -0,0 +1,56 @@
+#include "ProgramArena.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+// Append values to entries (with room for them), return the appended range
+template <typename T>
+std::span<const T> append(std::vector<T>& entries, std::span<const T> values) {
+  size_t first = entries.size();
+  entries.insert(entries.end(), values.begin(), values.end());
+  return std::span<const T>(entries.data() + first, values.size());
+}
+}  // namespace
+
+size_t ProgramArena::countSignalsBound(std::span<const ProtocolStep> steps) {
+  return 2 * static_cast<size_t>(std::count_if(
+                 steps.begin(), steps.end(),
+                 [](const ProtocolStep& step) { return !step.isBreak(); }));
+}
+
+void ProgramArena::reserve(size_t n_signals, size_t n_trigger_points) {
+  if (!signals.empty() || !trigger_points.empty()) {
+    throw std::logic_error("ProgramArena: reserve() after add().");
+  }
+  signals.reserve(n_signals);
+  signal_step_ids.reserve(n_signals);
+  trigger_points.reserve(n_trigger_points);
+}
+
+BatchProgramView ProgramArena::add(const BatchProgramView& program) {
+  BatchProgramView stored = program;
+  // Checked before anything is appended, so that nothing moves
+  if (signals.capacity() - signals.size() < program.signals.size() ||
+      trigger_points.capacity() - trigger_points.size() <
+          program.trigger_points.size()) {
+    throw std::logic_error(
+        "ProgramArena: program does not fit the reserved capacity.");
+  }
+  stored.signals = append(signals, program.signals);
+  stored.signal_step_ids = append(signal_step_ids, program.signal_step_ids);
+  stored.trigger_points = append(trigger_points, program.trigger_points);
+  return stored;
+}
+
+BatchProgramView ProgramArena::addBatchProgram(
+    std::span<const ProtocolStep> steps) {
+  compileBatchProgram(steps, compiled);
+  return add(compiled);
+}
+
+BatchProgramView ProgramArena::addSinglePulsesProgram(
+    std::span<const ProtocolStep> steps) {
+  compileSinglePulsesProgram(steps, compiled);
+  return add(compiled);
+}
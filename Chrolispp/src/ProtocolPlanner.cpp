@@ -1,25 +1,33 @@
 #include "ProtocolPlanner.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <format>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string_view>
 
 #include "ArduinoCommands.hpp"
+#include "BatchGenerator.hpp"
+#include "BatchTelemetry.hpp"
 #include "InitialBreakBatch.hpp"
-#include "LEDFunctions.hpp"
+#include "LEDValidation.hpp"
 #include "Logger.hpp"
 #include "PulseChainBatch.hpp"
-#include "TL6WL.h"
+#include "SinglePulsesBatch.hpp"
+#include "StepMerging.hpp"
 #include "Timing.hpp"
 #include "constants.hpp"
 #include "DurationAndUnit.hpp"
 
 static void logError(Logger& logger_ptr, std::string_view func_name,
                      uint32_t err, bool verbose = true) {
-  std::string err_msg =
-      std::format("{}(): Error Code = {:#08X}", func_name, err);
+  char err_msg[128];
+  std::snprintf(err_msg, sizeof(err_msg), "%.*s(): Error Code = %#08X",
+                static_cast<int>(func_name.size()), func_name.data(), err);
   logger_ptr.error(err_msg);
   if (verbose) {
     // also print the error code
@@ -27,20 +35,23 @@ static void logError(Logger& logger_ptr, std::string_view func_name,
   }
 }
 // Constructor implementation
-ProtocolPlanner::ProtocolPlanner(ViSession instr,
+ProtocolPlanner::ProtocolPlanner(ChrolisDevice* device_ptr,
                                  std::vector<ProtocolStep> protocolSteps,
                                  Logger* logger_ptr,
-                                 std::optional<HANDLE> h_Serial = std::nullopt)
-    : instr(instr),
+                                 ArduinoLink* arduino_ptr,
+                                 BatchPlanning planning,
+                                 const BatchCostModel& cost_model,
+                                 BatchExecution execution)
+    : device_ptr(device_ptr),
       steps(std::move(protocolSteps)),
-      logger_ptr(logger_ptr) {
-  // TODO: for each different wavelength, one can already program the LED
-  // machine with calculated delays. If multiple steps with the same
-  // wavelength
-  // exist, these might be set up as different steps with delays in the
-  // beginning (test this), or one has to be smart and do it with sleep()
-  // and
-  // reprogramming the LED machine in between.
+      logger_ptr(logger_ptr),
+      planning_(planning),
+      batch_cost_model_(cost_model),
+      execution_(execution) {
+  // Steps of one wavelength share a batch (as signals with different start
+  // delays) if the cost model says the timing unit takes several signals per
+  // channel, see probeSignalsPerChannel(). Otherwise the LED machine is
+  // reprogrammed in between, or the host times them (SinglePulsesBatch).
   if (steps.empty()) {
     logger_ptr->error("No protocol steps provided.");
     throw std::invalid_argument("No protocol steps provided.");
@@ -82,7 +93,25 @@ ProtocolPlanner::ProtocolPlanner(ViSession instr,
     i_step++;
   }
   // Merge compatible steps to remove redundant steps
-  mergeSteps(steps);
+  MergeReport merge_report =
+      mergeSteps(steps, planning_ == BatchPlanning::Optimal);
+  std::string merge_summary = summarizeMergeReport(merge_report);
+  logger_ptr->info(merge_summary);
+  std::cout << merge_summary << std::endl;
+  for (const auto& merged : merge_report.merged_steps) {
+    const ProtocolStep& step = steps[merged.index];
+    if (step.isBreak()) {
+      logger_ptr->tracef("Merged %zu steps into break (id %u) of %u us.",
+                         merged.n_absorbed, step.step_id,
+                         step.getBreakDurationUs());
+    } else {
+      logger_ptr->tracef(
+          "Merged %zu steps into step id %u: LED %u, brightness %u, pulse "
+          "width %u us, time between pulses %u us, number of pulses %u.",
+          merged.n_absorbed, step.step_id, step.led_index, step.brightness,
+          step.pulse_width_us, step.time_between_pulses_us, step.n_pulses);
+    }
+  }
   n_steps = static_cast<size_t>(steps.size());
   // Produce batches (groups of steps that can be programmed at once) from list
   // of steps
@@ -90,15 +119,16 @@ ProtocolPlanner::ProtocolPlanner(ViSession instr,
   if (batches.empty()) {
     throw std::runtime_error("No batches created from protocol steps.");
   }
+  // Preallocate so that recording telemetry never allocates during the run
+  telemetry_.reserve(batch_schedule_.getExecutedBatchCount());
   batches_loaded = true;
   // If using Arduino, create Arduino data packets
-  if (h_Serial) {
+  if (arduino_ptr != nullptr) {
     useArduino_ = true;
-    h_Serial_ = h_Serial.value();
+    arduino_ptr_ = arduino_ptr;
     logger_ptr->trace("Sending RESET to Arduino.");
     std::cout << "Sending RESET to Arduino." << std::endl;
-    sendCommandToArduino(h_Serial_,
-                         RESET);  // Reset before writing steps
+    arduino_ptr_->sendCommand(RESET);  // Reset before writing steps
     std::cout << "Creating Arduino data packets..." << std::endl;
     createArduinoDataPackets(Constants::DAC_RESOLUTION_BITS);
     std::cout << "Sending data packets to Arduino..." << std::endl;
@@ -107,209 +137,275 @@ ProtocolPlanner::ProtocolPlanner(ViSession instr,
   }
 }
 
-enum class CompatibilityStatus : int {
-  Incompatible = 0,
-  BothBreaks = 1,
-  CompatibleSameShape = 2,
-  CompatibleGaplessAndBreak = 3,
-  CompatibleGaplessAndSingle = 4
-};
+ProtocolPlanner::ProtocolPlanner(ChrolisDevice* device_ptr,
+                                 const MultiTrackProtocol& protocol,
+                                 Logger* logger_ptr,
+                                 const BatchCostModel& cost_model)
+    : device_ptr(device_ptr),
+      logger_ptr(logger_ptr),
+      planning_(BatchPlanning::Greedy),
+      batch_cost_model_(cost_model),
+      execution_(BatchExecution::Host) {
+  std::vector<TrackSegment> segments;
+  try {
+    segments = compileTrackSegments(protocol, batch_cost_model_);
+  } catch (const std::invalid_argument& e) {
+    logger_ptr->error(e.what());
+    throw;
+  }
+  batches = translateTracksToBatches(std::move(segments));
+  n_steps = steps.size();
+  telemetry_.reserve(batch_schedule_.getExecutedBatchCount());
+  batches_loaded = true;
+}
+
+ProtocolPlanner::ProtocolPlanner(ChrolisDevice* device_ptr,
+                                 StepSource step_source, Logger* logger_ptr,
+                                 const BatchCostModel& cost_model)
+    : device_ptr(device_ptr),
+      n_steps(0),
+      logger_ptr(logger_ptr),
+      planning_(BatchPlanning::Greedy),
+      batch_cost_model_(cost_model),
+      execution_(BatchExecution::Host),
+      step_source_(std::move(step_source)) {
+  if (!step_source_) {
+    logger_ptr->error("No step source provided.");
+    throw std::invalid_argument("No step source provided.");
+  }
+  logger_ptr->info(
+      "Batches are generated from the step source during the protocol.");
+  batches_loaded = true;
+}
+
 /*
-Check if two steps (it is assumed that step2 follows step1 directly) are
-compatible and return:
-- Incompatible if not compatible,
-- BothBreaks if both are breaks (0
-brightness) i.e. compatible,
-- 2 if both compatible non-breaks: both have same
-led index, brightness, pulse width, time between pulses
-- 3 if step1 is a gapless single pulse (i.e. time between pulses = 0 ms) and
-  step2 is a break (0 brightness) or a compatible single pulse
-    (same led_index, brightness; n_pulses=1). In these cases, the break/time
-between pulses is the time between pulses of the merged segment, and the pulse
-width is the sum of the two pulse widths.
-- 4 if step1 is a gapless single pulse, and step2 is a single pulse with the
-same index, brightness. Could add the pulse_width_ms values.
-Priorities (highest to lowest):
-1. CompatibleGaplessAndBreak
-2. CompatibleGaplessAndSingle
-3. CompatibleSameShape
-4. BothBreaks
+Given the list of steps, translate it into a sequence of batches (groups of
+steps that can be programmed at once, definition in ProtocolBatch.hpp). The
+batch boundaries are chosen by partitionBatches() according to planning_.
+Repeated batches are folded by scheduleBatches(): only one batch is created
+per unique batch, the blocks of batch_schedule_ say in which order and how
+often they are executed. With BatchExecution::HardwareTrigger, a trigger chain
+becomes one PulseChainBatch with the program of compileTriggerChain().
+The batches refer to their range of steps, which are not copied.
 */
-// TODO (low priority): make more elaborate partitioning where breaks can also
-// be split up if it is more advantageous (e.g. 300 ms pulse -> 300 ms break ->
-// 300 ms pulse -> 500 ms break will not become 300msp-300msb, 300msp-500msb but
-// 300msp-300msb x2 + 200msb
-static CompatibilityStatus stepsCompatibleForMerge(const ProtocolStep& step1,
-                                                   const ProtocolStep& step2) {
-  if (step1.isBreak() && step2.isBreak()) {
-    return CompatibilityStatus::BothBreaks;
-  }
-  if (step1.isGaplessSinglePulse()) {
-    if (step2.isBreak()) {
-      return CompatibilityStatus::CompatibleGaplessAndBreak;
-    } else if ((step1.led_index == step2.led_index) &&
-               (step1.brightness == step2.brightness) &&
-               (step2.n_pulses == 1)) {
-      return CompatibilityStatus::CompatibleGaplessAndSingle;
+std::vector<Batch> ProtocolPlanner::translateToBatches() {
+  std::vector<Batch> batches;
+  if (steps.empty()) {  // return empty vector if no steps
+    return batches;
+  }
+  batch_partition_ = partitionBatches(steps, planning_, batch_cost_model_);
+  const BatchPartition& partition = batch_partition_;
+  batch_schedule_ =
+      scheduleBatches(steps, partition, execution_, batch_cost_model_);
+  batches.reserve(batch_schedule_.unique_batches.size());
+  // The steps of unique batch i
+  auto getBatchSteps = [this, &partition](size_t i_unique) {
+    const ScheduledBatch& scheduled = batch_schedule_.unique_batches[i_unique];
+    size_t first = partition.batch_starts[scheduled.first_batch];
+    size_t end = partition.getBatchEnd(scheduled.end_batch - 1, steps.size());
+    return std::span<const ProtocolStep>(steps.data() + first, end - first);
+  };
+  size_t n_signals = 0;
+  size_t n_trigger_points = 0;
+  for (size_t i_unique = 0; i_unique < batch_schedule_.unique_batches.size();
+       i_unique++) {
+    const ScheduledBatch& scheduled = batch_schedule_.unique_batches[i_unique];
+    n_signals += ProgramArena::countSignalsBound(getBatchSteps(i_unique));
+    if (scheduled.isTriggerChain()) {
+      n_trigger_points += scheduled.getBatchCount();
     }
   }
-  if ((step1.led_index == step2.led_index) &&
-      (step1.brightness == step2.brightness) &&
-      (step1.pulse_width_us == step2.pulse_width_us) &&
-      (step1.time_between_pulses_us == step2.time_between_pulses_us)) {
-    return CompatibilityStatus::CompatibleSameShape;
+  programs_.reserve(n_signals, n_trigger_points);
+  for (size_t i_unique = 0; i_unique < batch_schedule_.unique_batches.size();
+       i_unique++) {
+    const ScheduledBatch& scheduled = batch_schedule_.unique_batches[i_unique];
+    std::span<const ProtocolStep> batch_steps = getBatchSteps(i_unique);
+    uint32_t batch_id = static_cast<uint32_t>(i_unique + 1);
+    BatchKind kind = partition.batch_kinds[scheduled.first_batch];
+    if (kind == BatchKind::Breaks) {
+      batches.emplace_back(std::in_place_type<InitialBreakBatch>, batch_id,
+                           device_ptr, batch_steps, logger_ptr);
+    } else if (kind == BatchKind::SinglePulses) {
+      batches.emplace_back(
+          std::in_place_type<SinglePulsesBatch>, batch_id, device_ptr,
+          batch_steps, logger_ptr,
+          batch_cost_model_[DeviceCall::SetHeadBrightness], programs_,
+          &device_state_);
+    } else if (scheduled.isTriggerChain()) {
+      batches.emplace_back(
+          std::in_place_type<PulseChainBatch>, batch_id, device_ptr,
+          batch_steps, logger_ptr,
+          programs_.add(compileTriggerChain(steps, partition, scheduled)),
+          &device_state_);
+    } else {
+      batches.emplace_back(std::in_place_type<PulseChainBatch>, batch_id,
+                           device_ptr, batch_steps, logger_ptr, programs_,
+                           &device_state_);
+    }
   }
-  return CompatibilityStatus::Incompatible;
-}
-
-/*Merge possible consecutive breaks or consecutive compatible steps (same
- * led index, brightness, pulse width, time between pulses)*/
-void ProtocolPlanner::mergeSteps(std::vector<ProtocolStep>& protocolSteps) {
-  // TODO: how should step id behave? Right now, first step of merged steps
-  // gives the id. i.e. if steps 2, 3, 4 are merged, the steps would be
-  // 1,2,3,4,5 -> 1,2,5
-  size_t i = 0;
-  while (i < protocolSteps.size() - 1) {
-    ProtocolStep& current = protocolSteps[i];
-    ProtocolStep& next = protocolSteps[i + 1];
-    CompatibilityStatus compatibility_value =
-        stepsCompatibleForMerge(current, next);
-    switch (compatibility_value) {
-      case CompatibilityStatus::Incompatible: {
-        // Not compatible, do nothing
-        i++;
-        continue;
-      }
-      case CompatibilityStatus::BothBreaks: {
-        // Both are breaks, merge into current, erase next
-        ViInt32 current_break_us = current.getBreakDurationUs();
-        ViInt32 next_break_us = next.getBreakDurationUs();
-        current.setBreakDuration(current_break_us + next_break_us);
-		DurationAndUnit current_break_dau = findDurationAndUnit(current_break_us);
-		DurationAndUnit next_break_dau = findDurationAndUnit(next_break_us);
-		DurationAndUnit merged_break_dau = findDurationAndUnit(current_break_us + next_break_us);
-        std::string merge_msg =
-            std::format("Merge consecutive breaks: {} {} + {} {} = {} {}",
-                        current_break_dau.duration, current_break_dau.unit, 
-                next_break_dau.duration, next_break_dau.unit, 
-                merged_break_dau.duration, 
-                merged_break_dau.unit);
-        logger_ptr->trace(merge_msg);
-        std::cout << merge_msg << std::endl;
-        protocolSteps.erase(protocolSteps.begin() + i + 1);
-        // Don't increment i but check again with same current in case of
-        // multiple matches
-        continue;
-      }
-      case CompatibilityStatus::CompatibleSameShape: {
-		  DurationAndUnit pulse_width_dau = findDurationAndUnit(current.pulse_width_us);
-		  DurationAndUnit time_between_pulses_dau = findDurationAndUnit(current.time_between_pulses_us);
-        std::string merge_msg = std::format(
-            "Merge compatible steps: LED {}, brightness {}, pulse width {} "
-            "{}, time between pulses {} {}, number of pulses {} + {} = {}",
-			current.led_index, current.brightness, pulse_width_dau.duration, pulse_width_dau.unit,
-            time_between_pulses_dau.duration, time_between_pulses_dau.unit, current.n_pulses, next.n_pulses,
-            current.n_pulses + next.n_pulses);
-        logger_ptr->trace(merge_msg);
-        std::cout << merge_msg << std::endl;
-        // Both are compatible non-breaks, merge into current, erase next
-        current.n_pulses += next.n_pulses;
-        protocolSteps.erase(protocolSteps.begin() + i + 1);
-        // Don't increment i but check again with same current in case of
-        // multiple matches
-        continue;
-      }
-      case CompatibilityStatus::CompatibleGaplessAndBreak: {
-        // current is gapless single pulse, next is break or compatible single
-        // pulse, merge into current, erase next
-        ViInt32 next_break_duration_us;
-        if (next.isBreak()) {
-          next_break_duration_us = next.getBreakDurationUs();
-        } else {
-          next_break_duration_us = next.time_between_pulses_us;
-        }
-		bool any_is_us_mode = current.is_us_mode || next.is_us_mode;
-		std::string unit_str = any_is_us_mode ? "us" : "ms";
-        DurationAndUnit new_pulse_width_dau = findDurationAndUnit(current.pulse_width_us + next.pulse_width_us);
-        DurationAndUnit new_time_between_pulses_dau = findDurationAndUnit(current.time_between_pulses_us + next_break_duration_us);
-
-        std::string merge_msg = std::format(
-            "Merge gapless single pulse with {}: LED {}, brightness {}, "
-            "new pulse width {} {}, new time between pulses {} {}",
-            next.isBreak() ? "break" : "compatible single pulse",
-            current.led_index, current.brightness,
-            new_pulse_width_dau.duration,
-            new_pulse_width_dau.unit,
-            new_time_between_pulses_dau.duration,
-            new_time_between_pulses_dau.unit);
-        logger_ptr->trace(merge_msg);
-        std::cout << merge_msg << std::endl;
-        current.pulse_width_us += next.pulse_width_us;  // +0 if next is break
-        current.time_between_pulses_us += next_break_duration_us;
-        protocolSteps.erase(protocolSteps.begin() + i + 1);
-        // Don't increment i but check again with same current in case of
-        // multiple matches
-        continue;
-      }
-      case CompatibilityStatus::CompatibleGaplessAndSingle: {
-        // current is gapless single pulse, next is compatible single pulse,
-        // merge into current, erase next
-		  DurationAndUnit new_pulse_width_dau = findDurationAndUnit(current.pulse_width_us + next.pulse_width_us);
-		  DurationAndUnit new_time_between_pulses_dau = findDurationAndUnit(current.time_between_pulses_us + next.time_between_pulses_us);
-
-        std::string merge_msg = std::format(
-            "Merge gapless single pulse with compatible single pulse: LED {}, "
-            "brightness {}, new pulse width {} {}, time between pulses {} {}, "
-            "number of pulses stays 1",
-            current.led_index, current.brightness,
-            new_pulse_width_dau.duration,
-			new_pulse_width_dau.unit,
-            new_time_between_pulses_dau.duration, new_time_between_pulses_dau.unit);
-        logger_ptr->trace(merge_msg);
-        std::cout << merge_msg << std::endl;
-        current.pulse_width_us += next.pulse_width_us;
-        current.time_between_pulses_us +=
-            next.time_between_pulses_us;  // should be 0 +
-                                          // next.time_between_pulses_ms
-        current.n_pulses = 1;
-        // time between pulses remains the same
-        protocolSteps.erase(protocolSteps.begin() + i + 1);
-        // Don't increment i but check again with same current in case of
-        // multiple matches
-        continue;
-      }
-      default: {  // Should not happen
-        throw std::logic_error(
-            "Unexpected compatibility value: " +
-            std::to_string(static_cast<int>(compatibility_value)));
-      }
+  if (execution_ == BatchExecution::HardwareTrigger) {
+    std::vector<const BatchProgramView*> programs;
+    programs.reserve(batches.size());
+    for (const auto& batch : batches) {
+      programs.push_back(batch.getProgram());
     }
+    predictScheduledBoundaries(steps, batch_schedule_, programs,
+                               batch_cost_model_, batch_partition_);
+  }
+  char summary[192];
+  std::snprintf(summary, sizeof(summary),
+                "Batch planning %s: %zu batches, %zu batch starts predicted "
+                "late, estimated %lld us of set up not hidden by breaks.",
+                planning_ == BatchPlanning::Optimal ? "optimal" : "greedy",
+                partition.getBatchCount(), partition.getPredictedLateCount(),
+                static_cast<long long>(partition.exposed_setup_us.count()));
+  logger_ptr->info(summary);
+  std::cout << summary << std::endl;
+  std::snprintf(summary, sizeof(summary),
+                "Batch schedule: %zu unique batches in %zu blocks.",
+                batch_schedule_.unique_batches.size(),
+                batch_schedule_.blocks.size());
+  logger_ptr->info(summary);
+  std::cout << summary << std::endl;
+  if (execution_ == BatchExecution::HardwareTrigger) {
+    std::snprintf(summary, sizeof(summary),
+                  "Batch execution by hardware trigger: %zu of %zu batches "
+                  "started by the host, the others by trigger points.",
+                  batch_schedule_.getExecutedBatchCount(),
+                  partition.getBatchCount());
+    logger_ptr->info(summary);
+    std::cout << summary << std::endl;
   }
+  return batches;
 }
+
 /*
-Given the list of steps, translate it into a sequence of batches (groups of
-steps that can be programmed at once, definition in ProtocolBatch.hpp).
+The segments of a multi-track protocol as batches executed once each, in
+order. The partition (one batch per segment, over the trains as steps) only
+serves the predictions: the idle time before a segment is the dark time
+after the last pulse of the segment before it, not the trailing time between
+pulses of its last step.
 */
-std::vector<std::unique_ptr<ProtocolBatch>>
-ProtocolPlanner::translateToBatches() {
-  if (steps.empty()) {  // return empty vector if no steps
-    return std::vector<std::unique_ptr<ProtocolBatch>>();
-  }
-  // Start with first step in steps as beginning of batch 1.
-  // Loop over subsequent steps until a step is not compatible with the rest
-  // in the definition of a batch.
-  std::vector<std::unique_ptr<ProtocolBatch>> batches;
-  int step_cursor = 0;
-  unsigned short batch_id = 1;
-  while (step_cursor < n_steps) {
-    std::unique_ptr<ProtocolBatch> next_batch =
-        getNextBatch(batch_id, step_cursor);
-    batches.push_back(std::move(next_batch));
-    batch_id++;
+std::vector<Batch> ProtocolPlanner::translateTracksToBatches(
+    std::vector<TrackSegment> segments) {
+  using std::chrono::microseconds;
+  std::vector<Batch> batches;
+  batches.reserve(segments.size() + 1);
+  batch_partition_ = BatchPartition();
+  batch_schedule_ = BatchSchedule();
+  batch_schedule_.blocks.push_back({{}, 1});
+  auto addBatch = [this, &batches](Batch batch, size_t first_step,
+                                   BatchKind kind) {
+    size_t i_batch = batches.size();
+    batch_partition_.batch_starts.push_back(first_step);
+    batch_partition_.batch_kinds.push_back(kind);
+    batch_schedule_.unique_batches.push_back({i_batch, i_batch + 1});
+    batch_schedule_.blocks[0].batches.push_back(i_batch);
+    batches.push_back(std::move(batch));
+  };
+  // All steps first, the batches refer to ranges of them
+  steps = makeBreakSteps(0, segments[0].start_us);
+  size_t n_initial_breaks = steps.size();
+  for (const auto& segment : segments) {
+    steps.insert(steps.end(), segment.steps.begin(), segment.steps.end());
+  }
+  std::span<const ProtocolStep> all_steps(steps);
+  size_t first_step = 0;
+  if (n_initial_breaks > 0) {
+    addBatch(Batch(std::in_place_type<InitialBreakBatch>, 1, device_ptr,
+                   all_steps.first(n_initial_breaks), logger_ptr),
+             0, BatchKind::Breaks);
+    first_step = n_initial_breaks;
+  }
+  size_t n_signals = 0;
+  size_t n_trigger_points = 0;
+  for (const auto& segment : segments) {
+    n_signals += segment.program.signals.size();
+    n_trigger_points += segment.program.trigger_points.size();
+  }
+  programs_.reserve(n_signals, n_trigger_points);
+  uint64_t idle_since_us = 0;  // end of the last pulse so far
+  DeviceState programmed;
+  for (auto& segment : segments) {
+    BatchSetUp set_up = programmed.diff(segment.program);
+    programmed.setProgrammed(segment.program);
+    if (!batches.empty()) {  // the first batch is set up before the start
+      BoundaryPrediction boundary = {
+          batches.size(), microseconds(segment.start_us),
+          microseconds(segment.start_us - idle_since_us),
+          batch_cost_model_.estimateBoundaryUs(set_up, idle_since_us > 0)};
+      if (!batch_partition_.boundaries.empty()) {
+        boundary.carried_over_us =
+            batch_partition_.boundaries.back().getPredictedLatenessUs();
+      }
+      batch_partition_.exposed_setup_us += boundary.getExposedUs();
+      batch_partition_.boundaries.push_back(boundary);
+    }
+    idle_since_us = segment.busy_end_us;
+    uint32_t batch_id = static_cast<uint32_t>(batches.size() + 1);
+    size_t n_segment_steps = segment.steps.size();
+    addBatch(Batch(std::in_place_type<PulseChainBatch>, batch_id, device_ptr,
+                   all_steps.subspan(first_step, n_segment_steps), logger_ptr,
+                   programs_.add(segment.program),
+                   microseconds(segment.busy_end_us - segment.start_us),
+                   microseconds(segment.end_us - segment.start_us),
+                   &device_state_),
+             first_step, BatchKind::PulseChain);
+    first_step += n_segment_steps;
   }
+  char summary[192];
+  std::snprintf(summary, sizeof(summary),
+                "Multi-track protocol: %zu pulse trains in %zu batches, %zu "
+                "batch starts predicted late, estimated %lld us of set up not "
+                "hidden by dark time.",
+                steps.size() - n_initial_breaks,
+                batches.size(), batch_partition_.getPredictedLateCount(),
+                static_cast<long long>(
+                    batch_partition_.exposed_setup_us.count()));
+  logger_ptr->info(summary);
+  std::cout << summary << std::endl;
   return batches;
 }
 
+std::string ProtocolPlanner::summarizePredictedLateStarts(
+    size_t max_lines) const {
+  size_t n_late = batch_partition_.getPredictedLateCount();
+  if (n_late == 0) {
+    return "No late batch starts predicted.\n";
+  }
+  char line[192];
+  std::snprintf(line, sizeof(line),
+                "%zu of %zu batch starts predicted late (set up does not fit "
+                "in the dark time before the batch):\n",
+                n_late, batch_partition_.getBatchCount());
+  std::string summary = line;
+  size_t n_lines = 0;
+  for (const auto& boundary : batch_partition_.boundaries) {
+    long long late_us = boundary.getPredictedLatenessUs().count();
+    if (late_us == 0) {
+      continue;
+    }
+    if (n_lines == max_lines) {
+      std::snprintf(line, sizeof(line), "\t... and %zu more\n",
+                    n_late - max_lines);
+      summary += line;
+      break;
+    }
+    std::snprintf(
+        line, sizeof(line),
+        "\tBatch start %zu at %.3f ms: needs %lld us, %lld us dark time "
+        "before it, %lld us late (%lld us carried over from the batch "
+        "before)\n",
+        boundary.i_batch + 1, boundary.planned_start_us.count() / 1000.0,
+        static_cast<long long>(boundary.needed_us.count()),
+        static_cast<long long>(boundary.available_us.count()), late_us,
+        static_cast<long long>(boundary.carried_over_us.count()));
+    summary += line;
+    n_lines++;
+  }
+  return summary;
+}
+
 /*
 Check if the step parameters are valid.
 Returns the following:
@@ -338,97 +434,15 @@ ValidationResult ProtocolPlanner::validateStep(ProtocolStep& step) {
   return VALID_STEP;
 }
 
-/*
-Given the current state of the class, assuming the current batch starts with
-the class variable current_step_index, find the whole current batch and return
-it with the specified index as batch index. See batch definition in
-ProtocolBatch.hpp.
-*/
-std::unique_ptr<ProtocolBatch> ProtocolPlanner::getNextBatch(
-    unsigned short batch_id, int& step_cursor) {
-  bool next_batch_found = false;
-  bool initial_break_type = false;
-  int i_current_candidate =
-      step_cursor;  // start with first step of current batch
-  int batch_end = -1;
-  int led_mask = 0b000000;  // to track which LEDs are used in current batch
-                            // for pulse chains
-  // loop over steps until end of current batch found or end of steps
-  while (!next_batch_found && (i_current_candidate < n_steps)) {
-    ProtocolStep& current = steps[i_current_candidate];
-    // If current step is break: end current batch with this break
-    if (current.isBreak()) {
-      if (i_current_candidate == step_cursor) {
-        // If this is first step of current batch, set batch type to initial
-        // break
-        initial_break_type = true;
-      }
-      batch_end = i_current_candidate;
-      break;  // Quit while loop
-    }
-    // Current step is a chain of pulses (n_pulses >= 1).
-    // If batch type is chained pulses, check if LED index is already
-    // used in this batch
-    if (led_mask & (1 << current.led_index)) {
-      // LED already used in this batch, so end of current batch
-      batch_end = i_current_candidate - 1;
-      break;
-    } else {
-      // LED not yet used in this batch, add to mask and continue
-      led_mask |= (1 << current.led_index);
-    }
-    i_current_candidate++;
-  }
-  // Create batch object with correct type
-  // Take (unique pointers to) subset of steps from current_step_index to
-  // batch_end (inclusive) if batch_end == -1, change it to last element
-  if (batch_end == -1) {
-      batch_end = n_steps - 1;
-  }
-  else if (batch_end < step_cursor) {
-    // Print batch end and step cursor
-    std::logic_error(
-        "Error determining end of batch: batch_end <= step_cursor. "
-        "Batch_id: " +
-        std::to_string(batch_id) + ", batch_end: " + std::to_string(batch_end) +
-        ", step_cursor: " + std::to_string(step_cursor));
-    logger_ptr->error(
-        "Error determining end of batch: batch_end <= step_cursor. "
-        "Batch_id: " +
-        std::to_string(batch_id) + ", batch_end: " + std::to_string(batch_end) +
-        ", step_cursor: " + std::to_string(step_cursor));
-  }
-  // Take reference to subset of steps from current_step_index to batch_end
-  // (inclusive)
-  std::vector<ProtocolStep> batch_steps;
-  batch_steps.insert(batch_steps.end(), steps.begin() + step_cursor,
-                     steps.begin() + batch_end + 1);
-  // Update current_step_index
-  if (batch_end != -1) {
-    step_cursor = batch_end + 1;  // start of next batch.
-  } else {
-    step_cursor = n_steps;  // end of steps reached
-    // return std::make_unique();
-  }
-  // Create and return batch object
-  if (initial_break_type) {
-    return std::make_unique<InitialBreakBatch>(
-        batch_id, instr, std::move(batch_steps), logger_ptr);
-  } else {
-    return std::make_unique<PulseChainBatch>(
-        batch_id, instr, std::move(batch_steps), logger_ptr);
-  }
-}
-
 void ProtocolPlanner::setUpDevice() {
   ViStatus err;
   std::string err_msg;
   try {
     // Set all LED brightness to 0%
-    err = TL6WL_setLED_HeadBrightness(instr, 0, 0, 0, 0, 0, 0);
+    err = device_ptr->setLED_HeadBrightness(0, 0, 0, 0, 0, 0);
     if (VI_SUCCESS != err) {
       logError(*logger_ptr, "TL6WL_setLED_HeadBrightness", err);
-      err = TL6WL_close(instr);
+      err = device_ptr->close();
       if (VI_SUCCESS != err) {
         logError(*logger_ptr, "TL6WL_close", err);
         throw std::runtime_error(
@@ -437,7 +451,7 @@ void ProtocolPlanner::setUpDevice() {
     } else {
       logger_ptr->trace("TL6WL_setLED_HeadBrightness() successful");
     }
-    err = TL6WL_setLED_LinearModeValue(instr, 0);
+    err = device_ptr->setLED_LinearModeValue(0);
     if (VI_SUCCESS != err) {
       logError(*logger_ptr, "TL6WL_setLED_LinearModeValue", err);
     }
@@ -454,9 +468,13 @@ void ProtocolPlanner::setUpDevice() {
 /*
 Execute the protocol (all batches). The batches must be loaded previously
 (batches = translateToBatches(); in constructor) and the device is required to
-have been set up (setUpDevice()).
+have been set up (setUpDevice()). With a step source, the batches are made by
+a BatchGenerator while the protocol runs: the next batch is made after the
+current one is executed, only these two are alive at any time.
 */
 void ProtocolPlanner::executeProtocol() {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
   if (!batches_loaded) {
     throw std::runtime_error("Batches were not loaded. ");
   }
@@ -464,64 +482,115 @@ void ProtocolPlanner::executeProtocol() {
     throw std::runtime_error(
         "Device not set up. Call setUpDevice() before execute().");
   }
-  if (batches.size() == 0) {
+  if (batches.size() == 0 && !step_source_) {
     throw std::runtime_error("No batches to execute.");
   }
   try {
     if (useArduino_) {
-      uint8_t response = sendCommandToArduino(h_Serial_, EXECUTE);
-      logger_ptr->trace("Sent execute to Arduino. Received " + std::to_string(response));
+      uint8_t response = arduino_ptr_->sendCommand(EXECUTE);
+      logger_ptr->tracef("Sent execute to Arduino. Received %u", response);
+    }
+    // The batches in execution order, nullptr after the last one: the
+    // batches of every block, repetitions times (the same batch may follow
+    // itself, its set up then finds nothing to reprogram), or the generated
+    // ones, of which the one before the current one is released
+    const std::vector<BatchBlock>& blocks = batch_schedule_.blocks;
+    size_t i_block = 0;
+    size_t i_repetition = 0;
+    size_t i_in_block = 0;
+    std::optional<BatchGenerator> generator;
+    if (step_source_) {
+      generator.emplace(std::move(step_source_), device_ptr, logger_ptr,
+                        batch_cost_model_, &device_state_);
     }
-    if (batches.size() == 1) {
-      ProtocolBatch& batch = *batches[0];
-      batch.setUpThisBatch();
-      batches_loaded = false;
-      batch.execute();
-      // If total duration > busy duration, sleep for (total - busy)
-      std::chrono::microseconds total_duration_us = batch.getTotalDurationUs();
-      std::chrono::microseconds busy_duration_us = batch.getBusyDurationUs();
-      if (total_duration_us > busy_duration_us) {
-		  // Convert to next millisecond for sleep precision
-          std::chrono::milliseconds sleep_duration_ms = 
-              std::chrono::duration_cast<std::chrono::milliseconds>(
-				  total_duration_us - busy_duration_us + std::chrono::microseconds(999));
-        logger_ptr->trace(
-            "Remaining time: " +
-            std::to_string((total_duration_us - busy_duration_us).count()) +
-            " us. Sleeping for rounded up duration: " + std::to_string(sleep_duration_ms.count()) + " ms.");
-        Timing::precise_sleep_for(sleep_duration_ms);
+    std::array<GeneratedBatch, 2> generated;
+    size_t n_generated = 0;
+    auto next_batch_to_execute = [&]() -> Batch* {
+      if (generator.has_value()) {
+        GeneratedBatch& slot = generated[n_generated++ % generated.size()];
+        slot = generator->next();
+        return slot.batch ? &*slot.batch : nullptr;
       }
-    } else if (batches.size() > 1) {
-      // Set up first batch
-      batches[0]->setUpThisBatch();
-      batches_loaded = false;  // Block from restarting
-      // *** Time critical part starts here ***
-      // Execute first batch
-      batches[0]->execute();
-      for (size_t i_batch = 0; i_batch + 1 < batches.size(); ++i_batch) {
-        // Set up next batch
-        batches[i_batch]->setUpNextBatch(*batches[i_batch + 1]);
-        // Execute next batch
-        batches[i_batch + 1]->execute();
+      if (i_block == blocks.size()) {
+        return nullptr;
       }
-      // Sleep for (total - busy) duration of last step
-      // if total duration > busy duration
-      std::chrono::microseconds total_duration_us =
-          batches[batches.size() - 1]->getTotalDurationUs();
-      std::chrono::microseconds busy_duration_us =
-          batches[batches.size() - 1]->getBusyDurationUs();
-
-      if (total_duration_us > busy_duration_us) {
-          std::chrono::milliseconds duration_to_sleep_ms =
-              std::chrono::duration_cast<std::chrono::milliseconds>(
-                  total_duration_us - busy_duration_us + std::chrono::microseconds(999));
-        logger_ptr->trace(
-            "Sleeping for remaining time: " +
-            std::to_string((total_duration_us - busy_duration_us).count()) +
-            " us, rounded to " );
-        Timing::precise_sleep_for(duration_to_sleep_ms);
+      const BatchBlock& block = blocks[i_block];
+      Batch* batch = &batches[block.batches[i_in_block]];
+      if (++i_in_block == block.batches.size()) {
+        i_in_block = 0;
+        if (++i_repetition == block.repetitions) {
+          i_repetition = 0;
+          i_block++;
+        }
+      }
+      return batch;
+    };
+    // Set up first batch
+    Batch* previous_batch = next_batch_to_execute();
+    if (previous_batch == nullptr) {
+      throw std::runtime_error("No batches to execute.");
+    }
+    auto setup_start = Timing::Clock::now();
+    previous_batch->setUpThisBatch();
+    microseconds setup_duration_us =
+        duration_cast<microseconds>(Timing::Clock::now() - setup_start);
+    batches_loaded = false;  // Block from restarting
+    telemetry_.clear();
+    // *** Time critical part starts here ***
+    // All batch starts are absolute deadlines counted from this epoch, so
+    // the timing error of one batch never carries over to the next.
+    Timing::Clock::time_point epoch = Timing::Clock::now();
+    // Planned start of the first step, the first batch starts its own startup
+    // delay ahead
+    Timing::Clock::time_point protocol_start =
+        epoch + previous_batch->getStartupDelayUs();
+    // Execute first batch. The logger does no file I/O while a batch is busy.
+    microseconds execute_duration_us(0);
+    {
+      Logger::BusyWindow busy_window(*logger_ptr);
+      execute_duration_us = previous_batch->execute();
+    }
+    telemetry_.push_back({previous_batch->getBatchId(), microseconds(0),
+                          microseconds(0), setup_duration_us,
+                          execute_duration_us, microseconds(0)});
+    microseconds planned_start_us = previous_batch->getTotalDurationUs();
+    while (Batch* next_batch_ptr = next_batch_to_execute()) {
+      Batch& next_batch = *next_batch_ptr;
+      Timing::Clock::time_point deadline =
+          protocol_start + planned_start_us - next_batch.getStartupDelayUs();
+      // Set up next batch, wait for its deadline
+      setup_start = Timing::Clock::now();
+      setup_duration_us = previous_batch->setUpNextBatch(next_batch, deadline);
+      Timing::Clock::time_point actual_start = Timing::Clock::now();
+      // Execute next batch
+      {
+        Logger::BusyWindow busy_window(*logger_ptr);
+        execute_duration_us = next_batch.execute();
+      }
+      // Only waited for the deadline if the set up finished before it
+      microseconds sleep_overshoot_us(0);
+      if (setup_start + setup_duration_us < deadline) {
+        sleep_overshoot_us =
+            duration_cast<microseconds>(actual_start - deadline);
       }
+      telemetry_.push_back(
+          {next_batch.getBatchId(), planned_start_us,
+           duration_cast<microseconds>(actual_start - deadline) +
+               planned_start_us,
+           setup_duration_us, execute_duration_us, sleep_overshoot_us});
+      microseconds lateness_us = telemetry_.back().getLatenessUs();
+      if (lateness_us.count() > Constants::LATE_START_TOLERANCE_US) {
+        logger_ptr->event(LogType::Warning, LogEvent::BatchLate,
+                          next_batch.getBatchId(), LogEventData::NO_STEP, 0,
+                          {static_cast<uint32_t>(lateness_us.count())});
+      }
+      planned_start_us += next_batch.getTotalDurationUs();
+      previous_batch = &next_batch;
     }
+    // Wait for the planned end of the protocol (the remaining break of the
+    // last batch)
+    logger_ptr->trace("Sleeping until planned end of protocol.");
+    Timing::precise_sleep_until(protocol_start + planned_start_us);
   } catch (const std::exception& e) {
     shutDownDevice();
     const char* err_str = e.what();
@@ -534,7 +603,55 @@ void ProtocolPlanner::executeProtocol() {
   }
   logger_ptr->flush();
   shutDownDevice();
+  // Report the timing of the run, now that nothing is time critical anymore
+  std::string summary = summarizeBatchTelemetry(telemetry_);
+  std::cout << summary;
+  logger_ptr->multiLineInfo(summary);
+  logger_ptr->flush();
+}
+
+/*
+Write the timing record of every batch of the last executeProtocol() run as
+CSV, see BatchTelemetry.
+*/
+void ProtocolPlanner::writeTelemetryCsv(const std::string& filename) const {
+  writeBatchTelemetryCsv(telemetry_, filename);
+}
+
+std::string ProtocolPlanner::dumpBatchPrograms() const {
+  std::string dump;
+  char header[96];
+  std::snprintf(header, sizeof(header),
+                "Unique batches: %zu (%zu batch starts)\n", batches.size(),
+                batch_schedule_.getExecutedBatchCount());
+  dump += header;
+  for (const auto& batch : batches) {
+    const BatchProgramView* program = batch.getProgram();
+    std::snprintf(header, sizeof(header), "%s %u%s\n",
+                  batch.getBatchType().c_str(), batch.getBatchId(),
+                  program == nullptr ? ": nothing to program" : "");
+    dump += header;
+    if (program != nullptr) {
+      dump += dumpBatchProgram(*program, "\t");
+    }
+  }
+  dump += "Schedule:\n";
+  dump += dumpBatchSchedule(batch_schedule_, "\t");
+  return dump;
+}
+
+void ProtocolPlanner::writeBatchPrograms(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::out | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open batch program file: " + filename);
+  }
+  file << dumpBatchPrograms();
+  if (!file) {
+    throw std::runtime_error("Could not write batch program file: " +
+                             filename);
+  }
 }
+
 void ProtocolPlanner::shutDownDevice() {
   ViStatus err;
   std::string err_msg;
@@ -542,25 +659,25 @@ void ProtocolPlanner::shutDownDevice() {
     // Turn off device
     logger_ptr->trace("shutDownDevice()");
     if (useArduino_) {
-      sendCommandToArduino(h_Serial_, RESET);
+      arduino_ptr_->sendCommand(RESET);
       logger_ptr->trace("Sent RESET command to Arduino.");
     }
 
-    err = TL6WL_setLED_HeadPowerStates(instr, VI_FALSE, VI_FALSE, VI_FALSE,
-                                       VI_FALSE, VI_FALSE, VI_FALSE);
+    err = device_ptr->setLED_HeadPowerStates(VI_FALSE, VI_FALSE, VI_FALSE,
+                                             VI_FALSE, VI_FALSE, VI_FALSE);
     if (VI_SUCCESS != err) {  // Handle failure to turn off LEDs
       logError(*logger_ptr, "TL6WL_setLED_HeadPowerStates", err);
     } else {
       logger_ptr->trace("TL6WL_setLED_HeadPowerStates() successful");
     }
     // Set all brightnesses to 0
-    err = TL6WL_setLED_LinearModeValue(instr, 0);
+    err = device_ptr->setLED_LinearModeValue(0);
     if (VI_SUCCESS != err) {  // Handle failure to turn off device
       logError(*logger_ptr, "TL6WL_setLED_LinearModeValue", err);
     } else {
       logger_ptr->trace("TL6WL_setLED_LinearModeValue() successful");
     }
-    err = TL6WL_close(instr);
+    err = device_ptr->close();
     if (VI_SUCCESS != err) {  // Handle failure to close device communication
       logError(*logger_ptr, "TL6WL_close", err);
       throw std::runtime_error(
@@ -579,53 +696,46 @@ void ProtocolPlanner::shutDownDevice() {
   }
 }
 
-/*
-Return the protocol planner as a string (char array). The caller is
-responsible for deleting the returned char array. prefix: prefix for the first
-line (describing the whole protocol), e.g. "\t" batch_level_prefix: prefix for
-each batch line only, e.g. "\t\t" step_level_prefix: prefix for each step
-level line, e.g. "\t\t\t"
-*/
-char* ProtocolPlanner::toChars(const std::string& prefix,
-                               const std::string& batch_level_prefix,
-                               const std::string& step_level_prefix) {
-  // Get all the toChars() functions of the constituent batches, return single
-  // chars separated by \n
-  // TODO: implement the toChars() functions, add a (global constant)
-  // BATCH_TOCHARS_BUFFERSIZE. Then use this in the implementations, and here
-  // define the bufferSize accordingly as a multiple
-  //
-  // Calculate the required buffer size
-  const int bufferSize =
-      Constants::PROTOCOL_PLANNER_HEADER_CHARS_BUFFERSIZE + prefix.length() +
-      batches.size() * (Constants::BATCH_HEADER_CHARS_BUFFERSIZE +
-                        batch_level_prefix.length()) +
-      steps.size() * (Constants::STEP_CHARS_BUFFERSIZE +
-                      step_level_prefix.length());  // +1 \t for batch level, +2
-                                                    // for \t\t at step level
-  char* pPlannerChars = new char[bufferSize];
+void ProtocolPlanner::appendHeaderTo(std::string& out,
+                                     const std::string& prefix) const {
+  char line[128];
+  std::snprintf(line, sizeof(line),
+                "Protocol with %zu unique batch(es) in %zu block(s), %zu "
+                "step(s):\n",
+                batches.size(), batch_schedule_.blocks.size(), n_steps);
+  out += prefix;
+  out += line;
+}
 
-  std::snprintf(pPlannerChars, bufferSize,
-                "%sProtocol with %zu batch(es), %zu step(s):\n", prefix.c_str(),
-                batches.size(), n_steps);
+void ProtocolPlanner::writeTo(std::ostream& out, const std::string& prefix,
+                              const std::string& batch_level_prefix,
+                              const std::string& step_level_prefix) const {
+  // Written whenever this much text is rendered, to keep the buffer small
+  constexpr size_t CHUNK_BYTES = 64 * 1024;
+  std::string text;
+  text.reserve(2 * CHUNK_BYTES);
+  appendHeaderTo(text, prefix);
+  for (const auto& batch : batches) {
+    batch.appendTo(text, batch_level_prefix, step_level_prefix);
+    text += '\n';
+    if (text.size() >= CHUNK_BYTES) {
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      text.clear();
+    }
+  }
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
 
-  // Loop over batches, use their toChars() functions
-  for (auto& batch : batches) {
-    char* batchChars = batch->toChars(batch_level_prefix, step_level_prefix);
-    // Use strncat_s if available, otherwise use strncat with bounds checking
-#ifdef _MSC_VER  // Check if compiling with Microsoft Visual Studio
-    strncat_s(pPlannerChars, bufferSize, batchChars,
-              bufferSize - std::strlen(pPlannerChars) - 1);
-    strncat_s(pPlannerChars, bufferSize, "\n",
-              bufferSize - std::strlen(pPlannerChars) - 1);
-#else
-    strncat(plannerChars, batchChars,
-            bufferSize - std::strlen(plannerChars) - 1);
-    strncat(plannerChars, "\n", bufferSize - std::strlen(plannerChars) - 1);
-#endif
-    delete[] batchChars;
-  }
-  return pPlannerChars;
+std::string ProtocolPlanner::toString(
+    const std::string& prefix, const std::string& batch_level_prefix,
+    const std::string& step_level_prefix) const {
+  std::string text;
+  appendHeaderTo(text, prefix);
+  for (const auto& batch : batches) {
+    batch.appendTo(text, batch_level_prefix, step_level_prefix);
+    text += '\n';
+  }
+  return text;
 }
 
 void ProtocolPlanner::createArduinoDataPackets(int dac_resolution_bits) {
@@ -638,7 +748,7 @@ void ProtocolPlanner::createArduinoDataPackets(int dac_resolution_bits) {
     return;
   }
   for (auto& step : steps) {
-    long step_duration_us = 0;
+    uint64_t step_duration_us = 0;
     if (step.isBreak()) {
       step_duration_us = step.getBreakDurationUs();
     } else {
@@ -652,14 +762,15 @@ void ProtocolPlanner::createArduinoDataPackets(int dac_resolution_bits) {
   }
   // Log created packets (with number of packets and list of durations in ms or
   // us)
-  logger_ptr->trace("ProtocolPlanner::createArduinoDataPackets(): created " +
-                    std::to_string(arduino_data_packets_.size()) +
-                    " packets. Durations:");
+  logger_ptr->tracef(
+      "ProtocolPlanner::createArduinoDataPackets(): created %zu packets. "
+      "Durations:",
+      arduino_data_packets_.size());
   int i_step = 1;
   for (const auto& packet : arduino_data_packets_) {
-    logger_ptr->trace(" \tStep " + std::to_string(i_step) +
-                      " duration: " + std::to_string(packet.stepDuration) +
-                      (packet.isMicroseconds ? " us." : " ms."));
+    logger_ptr->tracef(" \tStep %d duration: %u %s.", i_step,
+                       packet.stepDuration,
+                       packet.isMicroseconds ? "us" : "ms");
     i_step++;
   }
 }
@@ -673,8 +784,8 @@ void ProtocolPlanner::sendDataPacketsToArduino(int dac_resolution_bits) {
         "ProtocolPlanner::sendDataPacketsToArduino(): sending packets.");
     for (auto& packet : arduino_data_packets_) {
       try {
-        uint8_t crc = sendDataPacketToArduino(h_Serial_, packet,
-                                              dac_resolution_bits);
+        uint8_t crc =
+            arduino_ptr_->sendDataPacket(packet, dac_resolution_bits);
         if (crc != packet.crc) {
           std::string err_msg =
               "CRC mismatch when sending packet to Arduino. "
@@ -1,7 +1,10 @@
 #include "ProtocolStep.hpp"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>  // Include for strcpy
 #include <iostream>
+#include <stdexcept>
 
 #include "constants.hpp"
 #include "DurationAndUnit.hpp"
@@ -16,11 +19,15 @@
 /// <param name="n_pulses">The number of pulses</param>
 /// <param name="brightness">The brightness (0-1000; 0=0.0%, 123 = 12.3%, 1000=100.0%)</param>
 /// <param name="is_us_mode">Whether the step time characteristics are defined in units of us. (If false: ms.)</param>
-ProtocolStep::ProtocolStep(unsigned short step_id, ViUInt16 led_index,
+ProtocolStep::ProtocolStep(uint32_t step_id, ViUInt16 led_index,
                            ViUInt32 pulse_width,
                            ViUInt32 time_between_pulses, ViUInt32 n_pulses,
                            ViUInt16 brightness, bool is_us_mode=false)
     : step_id(step_id) {
+  // 64-bit until checked, e.g. a break of 2 h in ms is more than 32-bit us
+  uint64_t to_us = is_us_mode ? 1 : 1000;
+  uint64_t pulse_width_us = pulse_width * to_us;
+  uint64_t time_between_pulses_us = time_between_pulses * to_us;
   if (brightness ==
       0) {  // Unify break notation: either pulse_width 0, or brightness = 0; in
             // latter case, pulse duration also adds to break. To avoid handling
@@ -28,8 +35,8 @@ ProtocolStep::ProtocolStep(unsigned short step_id, ViUInt16 led_index,
             // always has 0 pulse_width_ms, and have 0 brightness. Also, ignore
             // n_pulses, make the break only once. To make it more obvious, set
             // n_pulses to 1 if break is detected.
-    time_between_pulses += pulse_width;
-    pulse_width = 0;
+    time_between_pulses_us += pulse_width_us;
+    pulse_width_us = 0;
     n_pulses = 1;
     led_index = 0;  // TODO: if break detected, make led_index invalid?
   } else if (pulse_width == 0) {
@@ -41,8 +48,14 @@ ProtocolStep::ProtocolStep(unsigned short step_id, ViUInt16 led_index,
   // is taken as the multiplier (i.e. the total pulse duration is n_pulses *
   // pulse_width_ms). I.e. 2 pulses of 100 ms with no break is the same as 1
   // pulse of 200 ms.
-  if (time_between_pulses == 0) {
-    pulse_width *= n_pulses;
+  if (time_between_pulses_us == 0) {
+    // saturated so that it cannot overflow, too long for the device anyway
+    bool saturated =
+        n_pulses > 1 &&
+        pulse_width_us > Constants::MAX_DEVICE_TIME_US / n_pulses;
+    pulse_width_us =
+        saturated ? static_cast<uint64_t>(Constants::MAX_DEVICE_TIME_US) + 1
+                  : pulse_width_us * n_pulses;
     n_pulses = 1;
   }
   this->led_index = led_index;
@@ -50,18 +63,23 @@ ProtocolStep::ProtocolStep(unsigned short step_id, ViUInt16 led_index,
   this->brightness = brightness;
   this->n_pulses = n_pulses;
   this->is_us_mode = is_us_mode;
-  if (is_us_mode) {
-      // in us mode, pulse width and time between pulses should be multiples of 5us
-      if (pulse_width % 5 != 0 || time_between_pulses % 5 != 0) {
-          throw std::invalid_argument("In us mode, pulse width and time between pulses must be multiples of 5 us.");
-	  }
-      this->pulse_width_us = pulse_width;
-      this->time_between_pulses_us = time_between_pulses;
+  // in us mode, pulse width and time between pulses should be multiples of 5us
+  if (is_us_mode &&
+      (pulse_width_us % 5 != 0 || time_between_pulses_us % 5 != 0)) {
+    throw std::invalid_argument(
+        "In us mode, pulse width and time between pulses must be multiples of "
+        "5 us.");
   }
-  else { // ms mode, convert to us
-      this->pulse_width_us = pulse_width * 1000;
-	  this->time_between_pulses_us = time_between_pulses * 1000;
+  if (pulse_width_us > Constants::MAX_DEVICE_TIME_US ||
+      time_between_pulses_us > Constants::MAX_DEVICE_TIME_US) {
+    throw std::invalid_argument(
+        "Step " + std::to_string(step_id) +
+        ": pulse width and time between pulses must be at most " +
+        std::to_string(Constants::MAX_DEVICE_TIME_US) +
+        " us, longer breaks must be split into several steps.");
   }
+  this->pulse_width_us = static_cast<ViUInt32>(pulse_width_us);
+  this->time_between_pulses_us = static_cast<ViUInt32>(time_between_pulses_us);
 }
 
 /*
@@ -78,18 +96,13 @@ bool ProtocolStep::isGaplessSinglePulse() const {
 bool ProtocolStep::isBreak() const { return (brightness == 0); }
 ViUInt32 ProtocolStep::getBreakDurationUs() const {
   if (isBreak()) {
-    if(is_us_mode) {  // time_between_pulses already us
-        return time_between_pulses_us;
-    }
-    else { // convert ms to us
-        return time_between_pulses_us * 1000;
-	}
+    return time_between_pulses_us;  // converted to us in the constructor
   } else {
     throw std::logic_error(
         "getBreakDuration() called on non-break ProtocolStep.");
   }
 }
-void ProtocolStep::setBreakDuration(int break_duration_us) {
+void ProtocolStep::setBreakDuration(ViUInt32 break_duration_us) {
   if (isBreak()) {
     time_between_pulses_us = break_duration_us;
   } else {
@@ -121,41 +134,53 @@ void ProtocolStep::printStep() {
   }
 }
 
-char* ProtocolStep::toChars(const std::string& prefix) {
-  // Calculate the required buffer size
-  const int bufferSize = Constants::STEP_CHARS_BUFFERSIZE;
-  char* stepChars = new char[bufferSize];
-
-  // Format the string into the buffer
+void ProtocolStep::appendTo(std::string& out,
+                            const std::string& prefix) const {
+  char line[Constants::STEP_CHARS_BUFFERSIZE];
   if (pulse_width_us == 0) {
-	  DurationAndUnit time_between_dau = findDurationAndUnit(time_between_pulses_us);
-    std::snprintf(stepChars, bufferSize,
-                  "%sStep (id %hu) Break, duration: %d %s", prefix.c_str(),
-                  step_id, time_between_dau.duration, time_between_dau.unit.c_str());
+    DurationAndUnit time_between_dau =
+        findDurationAndUnit(time_between_pulses_us);
+    std::snprintf(line, sizeof(line), "Step (id %u) Break, duration: %u %s",
+                  step_id, time_between_dau.duration,
+                  time_between_dau.unit.c_str());
   } else if (brightness == 0) {
-	  DurationAndUnit total_break_dau = findDurationAndUnit(pulse_width_us + time_between_pulses_us);
-    std::snprintf(stepChars, bufferSize, "%sBreak (id %hu), duration: %d %s",
-                  prefix.c_str(), step_id,
-                  total_break_dau.duration, total_break_dau.unit.c_str());
+    DurationAndUnit total_break_dau =
+        findDurationAndUnit(pulse_width_us + time_between_pulses_us);
+    std::snprintf(line, sizeof(line), "Break (id %u), duration: %u %s",
+                  step_id, total_break_dau.duration,
+                  total_break_dau.unit.c_str());
   } else {
-	  DurationAndUnit pulse_width_dau = findDurationAndUnit(pulse_width_us);
-	  DurationAndUnit time_between_dau = findDurationAndUnit(time_between_pulses_us);
-    std::snprintf(
-        stepChars, bufferSize,
-        "%sStep (id %hu): LED index: %d, Pulse width: %d %s, Time between "
-        "pulses: %d %s, "
-        "Number of pulses: %d, Brightness: %d",
-        prefix.c_str(), step_id, led_index, pulse_width_dau.duration, pulse_width_dau.unit.c_str(),
-        time_between_dau.duration, time_between_dau.unit.c_str(), n_pulses, brightness);
+    DurationAndUnit pulse_width_dau = findDurationAndUnit(pulse_width_us);
+    DurationAndUnit time_between_dau =
+        findDurationAndUnit(time_between_pulses_us);
+    std::snprintf(line, sizeof(line),
+                  "Step (id %u): LED index: %d, Pulse width: %u %s, Time "
+                  "between pulses: %u %s, Number of pulses: %u, Brightness: "
+                  "%d",
+                  step_id, led_index, pulse_width_dau.duration,
+                  pulse_width_dau.unit.c_str(), time_between_dau.duration,
+                  time_between_dau.unit.c_str(), n_pulses, brightness);
+  }
+  out += prefix;
+  out += line;
+}
+
+uint64_t ProtocolStep::getTotalDurationUs() const {
+  if (isBreak()) {
+    return time_between_pulses_us;
   }
-  return stepChars;
+  return static_cast<uint64_t>(n_pulses) *
+         (static_cast<uint64_t>(pulse_width_us) + time_between_pulses_us);
 }
 
-ViUInt32 ProtocolStep::getTotalDurationUs() const {
-    if (isBreak()) {
-        return time_between_pulses_us;
-    }
-    else {
-        return n_pulses * (pulse_width_us + time_between_pulses_us);
-    }
-}
\ No newline at end of file
+std::vector<ProtocolStep> makeBreakSteps(uint32_t step_id,
+                                         uint64_t break_duration_us) {
+  std::vector<ProtocolStep> breaks;
+  while (break_duration_us > 0) {
+    ViUInt32 step_us = static_cast<ViUInt32>(std::min<uint64_t>(
+        break_duration_us, Constants::MAX_BREAK_STEP_US));
+    breaks.emplace_back(step_id, 0, 0, step_us, 1, 0, true);
+    break_duration_us -= step_us;
+  }
+  return breaks;
+}
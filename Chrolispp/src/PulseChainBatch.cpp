@@ -1,57 +1,79 @@
 #include "PulseChainBatch.hpp"
 
+#include <array>
+
 #include "Timing.hpp"
 #include "constants.hpp"
 
-PulseChainBatch::PulseChainBatch(unsigned short batch_id, ViSession instr,
-                                 const std::vector<ProtocolStep>& steps,
-                                 Logger* logger_ptr)
-    : ProtocolBatch(batch_id, instr, steps, logger_ptr) {
+PulseChainBatch::PulseChainBatch(uint32_t batch_id,
+                                 ChrolisDevice* device_ptr,
+                                 std::span<const ProtocolStep> steps,
+                                 Logger* logger_ptr,
+                                 ProgramArena& programs,
+                                 DeviceState* device_state)
+    : PulseChainBatch(batch_id, device_ptr, steps, logger_ptr,
+                      programs.addBatchProgram(steps), device_state) {}
+
+PulseChainBatch::PulseChainBatch(uint32_t batch_id,
+                                 ChrolisDevice* device_ptr,
+                                 std::span<const ProtocolStep> steps,
+                                 Logger* logger_ptr, BatchProgramView program,
+                                 DeviceState* device_state)
+    : ProtocolBatch(batch_id, device_ptr, steps, logger_ptr),
+      program(program),
+      device_state_ptr(device_state) {
   if (steps.empty()) {
     throw std::invalid_argument("No protocol steps provided.");
   }
+  if (device_state_ptr == nullptr) {
+    own_device_state = std::make_unique<DeviceState>();
+  }
   // Calculate busy and total duration. Busy duration is total duration minus
   // the very last idle time
-  //TODO: if at least one step has us_mode, busy_ms and total_ms should be in ns?
-  int busy_us = 0;
-  int total_us = 0;
-  
-  // If first step is us_mode and < 1 ms, startup guard time must be added, otherwise pulse is invisible. For some reason, pulses of 1 ms are fine if not ms_mode
-  if (steps.front().is_us_mode && steps.front().pulse_width_us < 1000) {
-      busy_us += Constants::STARTUP_GUARD_US; // guard break is right in the beginning of the batch, so count as busy time.
-      total_us += Constants::STARTUP_GUARD_US;
-      has_guard = true;
-	  logger_ptr->warning("PulseChainBatch: First pulse width is less than " + std::to_string(Constants::STARTUP_GUARD_US) + " us. Adding guard break of " + std::to_string(Constants::STARTUP_GUARD_US) + " us to busy and total duration.");
-  }
-  
+  // The startup guard (see setUpThisBatch()) is not part of busy and total
+  // duration: the batch is executed getStartupDelayUs() ahead of its planned
+  // start instead, i.e. the guard overlaps the break of the previous batch.
+  total_duration_us = std::chrono::microseconds(0);
   for (const auto& step : steps) {
-    // Set LED mask proper digit to 1, e.g. for led_index = 2, led_mask =
-    // 0b000100
-    int led_index = step.led_index;
-    if (!step.isBreak()) {
-      led_mask |= (1 << led_index);
-    }
-    total_us += step.getTotalDurationUs();
+    total_duration_us += std::chrono::microseconds(step.getTotalDurationUs());
   }
   // subtract the last idle time (time between pulses of the last step last
-  // pulse) to get busy_ms
-  ViUInt32 last_break_duration = steps.back().time_between_pulses_us;
-  has_trailing_break = last_break_duration > 0;
-  busy_us = total_us - last_break_duration;
+  // pulse, and the break steps after it, several for a long break) to get
+  // busy_ms
+  std::chrono::microseconds last_break_duration(0);
+  size_t i_step = steps.size();
+  do {
+    // the time between pulses of a break is its duration
+    last_break_duration +=
+        std::chrono::microseconds(steps[--i_step].time_between_pulses_us);
+  } while (i_step > 0 && steps[i_step].isBreak());
+  has_trailing_break = last_break_duration.count() > 0;
+  busy_duration_us = total_duration_us - last_break_duration;
 
-  busy_duration_us = std::chrono::microseconds(busy_us);
-  total_duration_us = std::chrono::microseconds(total_us);
-
-  protocol_steps = steps;
-  batch_type = "PulseChainBatch";
+  batch_type = this->program.trigger_points.empty() ? "PulseChainBatch"
+                                                    : "TriggerChainBatch";
 }
 
-std::chrono::microseconds PulseChainBatch::getBusyDurationUs() const {
-  return busy_duration_us;
+PulseChainBatch::PulseChainBatch(uint32_t batch_id,
+                                 ChrolisDevice* device_ptr,
+                                 std::span<const ProtocolStep> steps,
+                                 Logger* logger_ptr, BatchProgramView program,
+                                 std::chrono::microseconds busy_duration_us,
+                                 std::chrono::microseconds total_duration_us,
+                                 DeviceState* device_state)
+    : PulseChainBatch(batch_id, device_ptr, steps, logger_ptr, program,
+                      device_state) {
+  if (busy_duration_us > total_duration_us) {
+    throw std::invalid_argument(
+        "PulseChainBatch: busy duration longer than total duration.");
+  }
+  this->busy_duration_us = busy_duration_us;
+  this->total_duration_us = total_duration_us;
+  has_trailing_break = total_duration_us > busy_duration_us;
 }
 
-std::chrono::microseconds PulseChainBatch::getTotalDurationUs() const {
-  return total_duration_us;
+std::chrono::microseconds PulseChainBatch::getStartupDelayUs() const {
+  return std::chrono::microseconds(program.startup_delay_us);
 }
 
 std::chrono::microseconds PulseChainBatch::execute() {
@@ -60,175 +82,169 @@ std::chrono::microseconds PulseChainBatch::execute() {
     throw std::logic_error(
         "PulseChainBatch: attempting to execute already executed batch.");
   }
-  auto start = std::chrono::high_resolution_clock::now();
+  auto start = Timing::Clock::now();
   ViStatus err;
-  // Start the timer
-  logger_ptr->protocol("Executing PulseChainBatch with steps:");
-  logger_ptr->multiLineProtocol(toChars("\t", "\t\t"));
-  ViBoolean led_states[6] = {VI_FALSE, VI_FALSE, VI_FALSE,
-                             VI_FALSE, VI_FALSE, VI_FALSE};
+  // The steps of every batch are in the protocol plan logged before the run
+  logger_ptr->protocolf("Executing %s %u", batch_type, batch_id);
   execute_attempted = true;
-  // Go through LED mask, set led_states accordingly
-  for (int i = 0; i < 6; i++) {
-    if (led_mask & (1 << i)) {
-      led_states[i] = VI_TRUE;
-    }
-  }
 
-  logger_ptr->trace(
-      "PulseChainBatch::execute(): TL6WL_TU_StartStopGeneratorOutput_TU(instr, "
-      "true)");
-  err = TL6WL_TU_StartStopGeneratorOutput_TU(instr, true);
-  err = TL6WL_setLED_HeadPowerStates(instr, led_states[0], led_states[1],
-      led_states[2], led_states[3],
-      led_states[4], led_states[5]);
-  logger_ptr->trace(
-      "PulseChainBatch::execute(): TL6WL_setLED_HeadPowerStates() has set "
-      "states to " +
-      std::to_string(led_states[0]) + ", " + std::to_string(led_states[1]) +
-      ", " + std::to_string(led_states[2]) + ", " +
-      std::to_string(led_states[3]) + ", " + std::to_string(led_states[4]) +
-      ", " + std::to_string(led_states[5]));
+  err = device_ptr->TU_StartStopGeneratorOutput_TU(true);
+  // The generator counts the start delay from here
+  auto generator_start = Timing::Clock::now();
+  logEvent(LogEvent::StartStopGenerator, LogEventData::NO_STEP, err,
+           {VI_TRUE});
   if (VI_SUCCESS != err) {
     throw std::runtime_error(
         "PulseChainBatch::execute(): Error starting signal generator.");
   }
+  const std::array<ViBoolean, 6>& power_states = program.power_states;
+  DeviceState& state = getDeviceState();
+  // Still on if the previous batch had no trailing break
+  if (state.power_states != power_states) {
+    state.power_states.reset();
+    err = device_ptr->setLED_HeadPowerStates(power_states[0], power_states[1],
+                                             power_states[2], power_states[3],
+                                             power_states[4], power_states[5]);
+    logEvent(LogEvent::SetHeadPowerStates, LogEventData::NO_STEP, err,
+             {power_states[0], power_states[1], power_states[2],
+              power_states[3], power_states[4], power_states[5]});
+    if (VI_SUCCESS != err) {
+      throw std::runtime_error(
+          "PulseChainBatch::execute(): Error setting head power states.");
+    }
+    state.power_states = power_states;
+  }
 
-  // Cast to next millisecond
-  std::chrono::milliseconds busy_duration_ms = duration_cast<std::chrono::milliseconds>(busy_duration_us + std::chrono::microseconds(999));
-
-  Timing::precise_sleep_for(busy_duration_ms);
+  // The first step starts after the startup guard
+  Timing::precise_sleep_until(generator_start + getStartupDelayUs() +
+                              busy_duration_us);
   logger_ptr->trace("PulseChainBatch execute() done.");
   if (has_trailing_break) {  // turn off LEDs to make sure set up of next batch
                              // does not affect light output
-    err = TL6WL_setLED_HeadPowerStates(instr, VI_FALSE, VI_FALSE, VI_FALSE,
-                                       VI_FALSE, VI_FALSE, VI_FALSE);
+    state.power_states.reset();
+    err = device_ptr->setLED_HeadPowerStates(VI_FALSE, VI_FALSE, VI_FALSE,
+                                             VI_FALSE, VI_FALSE, VI_FALSE);
+    logEvent(LogEvent::SetHeadPowerStates, LogEventData::NO_STEP, err,
+             {0, 0, 0, 0, 0, 0});
     if (VI_SUCCESS != err) {
       throw std::runtime_error(
           "PulseChainBatch::execute(): Error turning off head power states.");
     }
+    state.power_states =
+        std::array<ViBoolean, 6>{VI_FALSE, VI_FALSE, VI_FALSE,
+                                 VI_FALSE, VI_FALSE, VI_FALSE};
   }
-  auto end = std::chrono::high_resolution_clock::now();
+  auto end = Timing::Clock::now();
   auto actual_duration_us =
       std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  busy_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(
-      actual_duration_us);  // update actual busy duration
   return actual_duration_us;
 }
 
-void PulseChainBatch::setUpNextBatch(ProtocolBatch& next_batch) {
-  auto start = std::chrono::high_resolution_clock::now();
-  logger_ptr->trace("PulseChainBatch setUpNextBatch()");
-  // TODO: avoid repeating this code in other implementations of ProtocolBatch
-  if (!execute_attempted) {
-    throw std::logic_error(
-        "Cannot set up next batch before executing this batch.");
-  }
-  next_batch.setUpThisBatch();
-  auto end = std::chrono::high_resolution_clock::now();
-  std::chrono::milliseconds duration =
-      std::chrono::duration_cast<std::chrono::milliseconds>(
-          end - start);  // Truncate to milliseconds
-  // Wait for rest of the (busy - total duration) time if any left after
-  // <duration> time passed Convert duration to nearest milliseconds int
-  if (duration < total_duration_us - busy_duration_us) {
-	  // Cast to next millisecond
-	  std::chrono::milliseconds total_duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(total_duration_us - busy_duration_us - duration + std::chrono::microseconds(999));
-    Timing::precise_sleep_for(total_duration_ms);
-  }
-  logger_ptr->trace("PulseChainBatch setUpNextBatch() done.");
-}
-
 void PulseChainBatch::setUpThisBatch() {
   logger_ptr->trace("PulseChainBatch setUpThisBatch()");
-  // Loop over steps, set up periodic signal and keep track of delay times
+  execute_attempted = false;  // may be executed (again) once set up
   ViStatus err;
   // Stop timer
   // TODO: this should not be necessary, as timer is stopped in beginning of the
   // program, and at the end of each execute().
-  err = TL6WL_TU_StartStopGeneratorOutput_TU(instr, false);
+  err = device_ptr->TU_StartStopGeneratorOutput_TU(false);
+  logEvent(LogEvent::StartStopGenerator, LogEventData::NO_STEP, err,
+           {VI_FALSE});
   if (VI_SUCCESS != err) {
     throw std::runtime_error(
         "PulseChainBatch::setUpThisBatch(): Error stopping signal generator.");
   }
-  // Reset timer
-  err = TL6WL_TU_ResetSequence(instr);
-  if (VI_SUCCESS != err) {
-    throw std::runtime_error(
-        "PulseChainBatch::setUpThisBatch(): Error resetting signal generator.");
+  // Only the calls that change the programmed state. The state is unknown
+  // while a call that changes it is pending, so after a failed call the next
+  // set up programs everything.
+  DeviceState& state = getDeviceState();
+  BatchSetUp set_up = state.diff(program);
+  logger_ptr->tracef(
+      "%s %u: reset %s, adding %zu of %zu signals and %zu of %zu trigger "
+      "points, brightness %s",
+      batch_type, batch_id, set_up.reset ? "yes" : "no",
+      set_up.n_added_signals, program.signals.size(),
+      set_up.n_added_trigger_points, program.trigger_points.size(),
+      set_up.set_brightness ? "set" : "unchanged");
+  if (set_up.reset) {
+    state.signals.reset();
+    state.trigger_points.reset();
+    err = device_ptr->TU_ResetSequence();
+    logEvent(LogEvent::ResetSequence, LogEventData::NO_STEP, err);
+    if (VI_SUCCESS != err) {
+      throw std::runtime_error(
+          "PulseChainBatch::setUpThisBatch(): Error resetting signal "
+          "generator.");
+    }
+    state.signals.emplace();
+    state.trigger_points.emplace();
   }
-  ViUInt32 duration_so_far_us = Constants::STARTUP_GUARD_US; // Need a guard right in the beginning, otherwise the first pulse may be skipped if it is too short (e.g. 5 us)
-  int led_brightness[6] = {0, 0, 0, 0, 0, 0};
-  // TODO: extract this logic into constructor: create an array for each
-  // parameter TL6WL_TU_AddGeneratedSelfRunningSignal takes, and pre-calculate
-  // the values, so here one must only loop through an index, and call
-  // TL6WL_TU_AddGeneratedSelfRunningSignal two times (for LED head and BOB) per
-  // index
-  for (const auto& step : protocol_steps) {
-    int led_index = step.led_index;
-    int brightness = step.brightness;
-    led_brightness[led_index] = brightness;
-    if (step.isBreak()) {
-        duration_so_far_us += step.getTotalDurationUs();
-        continue;
+  for (size_t i = program.signals.size() - set_up.n_added_signals;
+       i < program.signals.size(); i++) {
+    const GeneratorSignal& signal = program.signals[i];
+    if (signal.triggered) {
+      err = device_ptr->TU_AddGeneratedTriggeredSignal(
+          signal.signal_nr, signal.active_low, signal.start_delay_us,
+          signal.active_us, signal.inactive_us, signal.repetitions);
+    } else {
+      err = device_ptr->TU_AddGeneratedSelfRunningSignal(
+          signal.signal_nr, signal.active_low, signal.start_delay_us,
+          signal.active_us, signal.inactive_us, signal.repetitions);
     }
-    err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-        instr, led_index + 1, VI_FALSE, duration_so_far_us,
-        step.pulse_width_us, step.time_between_pulses_us,
-        step.n_pulses);
+    logEvent(signal.triggered ? LogEvent::AddTriggeredSignal
+                              : LogEvent::AddSelfRunningSignal,
+             program.signal_step_ids[i], err,
+             {signal.signal_nr, signal.active_low, signal.start_delay_us,
+              signal.active_us, signal.inactive_us, signal.repetitions});
     if (VI_SUCCESS != err) {
+      state.signals.reset();
       throw std::runtime_error(
-          "PulseChainBatch::setUpThisBatch(): Error adding signal to signal "
-          "generator.");
-      logger_ptr->error(
-          "PulseChainBatch::setUpThisBatch(): Error setting up step: signalNr" +
-          std::to_string(led_index + 1) + ", startDelay: " +
-          std::to_string(duration_so_far_us) + "us, activeTimeus" +
-          std::to_string(step.pulse_width_us) + " us, inactiveTimeus " +
-          std::to_string(step.time_between_pulses_us) +
-          " us, repetitionCount " + std::to_string(step.n_pulses));
+          signal.signal_nr > 6
+              ? "PulseChainBatch::setUpThisBatch(): Error adding signal to "
+                "signal generator (breakout board)."
+              : "PulseChainBatch::setUpThisBatch(): Error adding signal to "
+                "signal generator.");
     }
-    // Add breakout box signal as well
-    err = TL6WL_TU_AddGeneratedSelfRunningSignal(
-        instr, step.led_index + 1 + 6, VI_FALSE, duration_so_far_us,
-        step.pulse_width_us, step.time_between_pulses_us,
-        step.n_pulses);
+    state.signals->push_back(signal);
+  }
+  for (size_t i = program.trigger_points.size() - set_up.n_added_trigger_points;
+       i < program.trigger_points.size(); i++) {
+    const TriggerPoint& trigger_point = program.trigger_points[i];
+    err = device_ptr->TU_AddTriggerPoint(
+        trigger_point.signal_nr, trigger_point.starts_low,
+        trigger_point.edge_count, trigger_point.affected_signal_bitmask);
+    logEvent(LogEvent::AddTriggerPoint, LogEventData::NO_STEP, err,
+             {trigger_point.signal_nr, trigger_point.starts_low,
+              trigger_point.edge_count,
+              static_cast<uint16_t>(trigger_point.affected_signal_bitmask)});
     if (VI_SUCCESS != err) {
+      state.trigger_points.reset();
       throw std::runtime_error(
-          "PulseChainBatch::setUpThisBatch(): Error adding signal to signal "
-          "generator.");
-      logger_ptr->error(
-          "PulseChainBatch::setUpThisBatch(): Error setting up (breakout "
-          "board) "
-          "step: signalNr" +
-          std::to_string(led_index + 1 + 6) + ", startDelay: " +
-          std::to_string(duration_so_far_us) + "us, activeTimeus" +
-          std::to_string(step.pulse_width_us) + " us, inactiveTimeus " +
-          std::to_string(step.time_between_pulses_us) +
-          " us, repetitionCount " + std::to_string(step.n_pulses));
+          "PulseChainBatch::setUpThisBatch(): Error adding trigger point to "
+          "signal generator.");
     }
-    duration_so_far_us += step.getTotalDurationUs();
+    state.trigger_points->push_back(trigger_point);
   }
-  logger_ptr->trace(
-      "PulseChainBatch::setUpThisBatch(): Setting brightnesses to " +
-      std::to_string(led_brightness[0]) + ", " +
-      std::to_string(led_brightness[1]) + ", " +
-      std::to_string(led_brightness[2]) + ", " +
-      std::to_string(led_brightness[3]) + ", " +
-      std::to_string(led_brightness[4]) + ", " +
-      std::to_string(led_brightness[5]));
-  err = TL6WL_setLED_HeadBrightness(instr, led_brightness[0], led_brightness[1],
-                                    led_brightness[2], led_brightness[3],
-                                    led_brightness[4], led_brightness[5]);
-  if (VI_SUCCESS != err) {
-    throw std::runtime_error(
-        "PulseChainBatch::setUpThisBatch(): Error setting LED head "
-        "brightness.");
+  if (set_up.set_brightness) {
+    const std::array<ViUInt16, 6>& brightness = program.brightness;
+    state.brightness.reset();
+    err = device_ptr->setLED_HeadBrightness(brightness[0], brightness[1],
+                                            brightness[2], brightness[3],
+                                            brightness[4], brightness[5]);
+    logEvent(LogEvent::SetHeadBrightness, LogEventData::NO_STEP, err,
+             {brightness[0], brightness[1], brightness[2], brightness[3],
+              brightness[4], brightness[5]});
+    if (VI_SUCCESS != err) {
+      throw std::runtime_error(
+          "PulseChainBatch::setUpThisBatch(): Error setting LED head "
+          "brightness.");
+    }
+    state.brightness = brightness;
   }
   logger_ptr->trace("PulseChainBatch setUpThisBatch() done.");
 }
 
-char* PulseChainBatch::toChars(const std::string& prefix,
-                               const std::string& step_level_prefix) {
-	return batchToChars(batch_type + (has_guard ? " with " + std::to_string(Constants::STARTUP_GUARD_US) + " us guard" : ""), prefix, step_level_prefix);
+void PulseChainBatch::appendTo(std::string& out, const std::string& prefix,
+                               const std::string& step_level_prefix) const {
+  appendBatchTo(out, batch_type, prefix, step_level_prefix);
 }
@@ -0,0 +1,73 @@
+#include "SerialArduinoLink.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "COMFunctions.hpp"
+#include "Utils.hpp"
+
+/* Send data packet to Arduino. The response (CRC) is returned.
+ */
+uint16_t sendDataPacketToArduino(HANDLE h_Serial, ArduinoDataPacket& packet,
+                                 int dac_resolution_bits) {
+  DWORD bytesWritten;
+  DWORD bytesRead;
+  uint8_t crcResponse = 0;
+  try {
+    BOOL success = WriteFile(h_Serial, reinterpret_cast<uint8_t*>(&packet),
+                             sizeof(packet), &bytesWritten,
+                             nullptr  // synchronous write
+    );
+    if (!success || bytesWritten != sizeof(packet)) {
+      throw std::runtime_error("WriteFile failed or incomplete");
+    }
+    // Read the CRC response (1 byte)
+    success = ReadFile(h_Serial, &crcResponse, 1, &bytesRead, nullptr);
+
+    if (!success || bytesRead != 1) {
+      throw std::runtime_error("Failed to read CRC response from Arduino");
+    }
+
+    return crcResponse;
+  } catch (const std::exception& e) {
+    std::cerr << "Error sending data packet to Arduino: " << e.what()
+              << std::endl;
+    // raise error
+    throw std::runtime_error("Error sending data packet to Arduino: " +
+                             std::string(e.what()));
+  }
+}
+
+uint8_t sendCommandToArduinoOld(HANDLE h_Serial, uint8_t command) {
+  char message[5];
+  intToCharArray(command, message, sizeof(message));
+  writeMessage(h_Serial, message, sizeof(message));
+  char* response = readMessage(h_Serial, 1);
+  return static_cast<uint8_t>(response[0]);
+}
+
+/*
+Send single-byte command to Arduino.
+*/
+uint8_t sendCommandToArduino(HANDLE h_Serial, uint8_t command) {
+  if (command == APPEND_STEP) {
+    throw std::invalid_argument(
+        "sendCommand: APPEND_STEP is not a single-byte command.");
+  }
+  DWORD bytesWritten;
+  bool success = WriteFile(h_Serial, &command, 1, &bytesWritten, nullptr) &&
+                 bytesWritten == 1;
+  if (!success || bytesWritten != 1) {
+    throw std::runtime_error("Failed to write command to Arduino");
+  }
+  // Read response byte
+  uint8_t response = 0;
+  DWORD bytesRead;
+  success =
+      ReadFile(h_Serial, &response, 1, &bytesRead, nullptr) && bytesRead == 1;
+  if (!success || bytesRead != 1) {
+    throw std::runtime_error("Failed to read response from Arduino");
+  }
+  return response;
+}
@@ -0,0 +1,414 @@
+#include "SimulatedDevice.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+using std::chrono::nanoseconds;
+
+constexpr nanoseconds OPEN_END = nanoseconds::max();
+
+struct Interval {
+  nanoseconds begin;
+  nanoseconds end;
+};
+
+// Sort intervals and join the overlapping or touching ones.
+std::vector<Interval> mergeIntervals(std::vector<Interval> intervals) {
+  std::sort(intervals.begin(), intervals.end(),
+            [](const Interval& a, const Interval& b) {
+              return a.begin < b.begin;
+            });
+  std::vector<Interval> merged;
+  for (const auto& interval : intervals) {
+    if (!merged.empty() && interval.begin <= merged.back().end) {
+      merged.back().end = std::max(merged.back().end, interval.end);
+    } else {
+      merged.push_back(interval);
+    }
+  }
+  return merged;
+}
+
+// Intersection of two sorted, merged interval lists.
+std::vector<Interval> intersectIntervals(const std::vector<Interval>& a,
+                                         const std::vector<Interval>& b) {
+  std::vector<Interval> result;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() && j < b.size()) {
+    nanoseconds begin = std::max(a[i].begin, b[j].begin);
+    nanoseconds end = std::min(a[i].end, b[j].end);
+    if (begin < end) {
+      result.push_back({begin, end});
+    }
+    if (a[i].end < b[j].end) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return result;
+}
+
+// Convert a list of (time, is_on) state changes into on-intervals.
+template <typename Events, typename IsOn>
+std::vector<Interval> onIntervals(const Events& events, IsOn is_on) {
+  std::vector<Interval> intervals;
+  bool on = false;
+  nanoseconds on_since(0);
+  for (const auto& event : events) {
+    bool event_on = is_on(event);
+    if (event_on && !on) {
+      on_since = event.time;
+    } else if (!event_on && on && event.time > on_since) {
+      intervals.push_back({on_since, event.time});
+    }
+    on = event_on;
+  }
+  if (on) {
+    intervals.push_back({on_since, OPEN_END});
+  }
+  return intervals;
+}
+
+/*
+Active intervals of one start of a signal at time start, cut at cut (the next
+start of the signal or the generator stop). Infinitely repeating signals are
+cut at run_end.
+*/
+void addPulses(const SimulatedSignal& signal, nanoseconds start, nanoseconds cut,
+               nanoseconds run_end, std::vector<Interval>& intervals) {
+  if (signal.active_us == 0) {
+    return;
+  }
+  nanoseconds active = std::chrono::microseconds(signal.active_us);
+  nanoseconds period = std::chrono::microseconds(
+      static_cast<long long>(signal.active_us) + signal.inactive_us);
+  nanoseconds first = start + std::chrono::microseconds(signal.start_delay_us);
+  for (ViUInt32 k = 0; signal.repetitions == 0 || k < signal.repetitions;
+       k++) {
+    nanoseconds on = first + k * period;
+    if (on >= cut || (signal.repetitions == 0 && on >= run_end)) {
+      break;
+    }
+    intervals.push_back({on, std::min(on + active, cut)});
+  }
+}
+
+bool isValidSignalNr(ViUInt8 signal_nr) {
+  return signal_nr >= 1 && signal_nr <= 12;
+}
+}  // namespace
+
+SimulatedDevice::SimulatedDevice() : SimulatedDevice(Latencies()) {}
+
+SimulatedDevice::SimulatedDevice(const Latencies& latencies)
+    : latencies(latencies) {
+  resetHistory();
+}
+
+std::chrono::nanoseconds SimulatedDevice::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - epoch);
+}
+
+std::chrono::nanoseconds SimulatedDevice::simulateLatency(DeviceCall call) {
+  auto until = std::chrono::steady_clock::now() + latencies[call];
+  while (std::chrono::steady_clock::now() < until) {
+    // busy-wait: sleeping would add the OS scheduler's jitter on top
+  }
+  return now();
+}
+
+ViStatus SimulatedDevice::record(DeviceCall call, std::chrono::nanoseconds begin,
+                                 std::chrono::nanoseconds end,
+                                 ViStatus status) {
+  call_log.push_back({call, begin, end, status});
+  return status;
+}
+
+void SimulatedDevice::stopGenerator(std::chrono::nanoseconds time) {
+  if (generator_running) {
+    generator_runs.back().stop = time;
+    generator_running = false;
+  }
+}
+
+ViStatus SimulatedDevice::setLED_HeadPowerStates(ViBoolean led1, ViBoolean led2,
+                                                 ViBoolean led3, ViBoolean led4,
+                                                 ViBoolean led5,
+                                                 ViBoolean led6) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::SetHeadPowerStates);
+  power_states = {led1 != VI_FALSE, led2 != VI_FALSE, led3 != VI_FALSE,
+                  led4 != VI_FALSE, led5 != VI_FALSE, led6 != VI_FALSE};
+  power_events.push_back({end, power_states});
+  return record(DeviceCall::SetHeadPowerStates, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::setLED_HeadBrightness(ViUInt16 led1, ViUInt16 led2,
+                                                ViUInt16 led3, ViUInt16 led4,
+                                                ViUInt16 led5, ViUInt16 led6) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::SetHeadBrightness);
+  std::array<ViUInt16, 6> new_brightness = {led1, led2, led3,
+                                            led4, led5, led6};
+  for (size_t i = 0; i < new_brightness.size(); i++) {
+    if (new_brightness[i] > 1000) {
+      // instrument handle is parameter 1, led1 is parameter 2
+      return record(DeviceCall::SetHeadBrightness, begin, end,
+                    VI_ERROR_PARAMETER2 + static_cast<ViStatus>(i));
+    }
+  }
+  brightness = new_brightness;
+  brightness_events.push_back({end, brightness});
+  return record(DeviceCall::SetHeadBrightness, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::setLED_LinearModeValue(ViUInt16 value) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::SetLinearModeValue);
+  if (value > 1000) {
+    return record(DeviceCall::SetLinearModeValue, begin, end,
+                  VI_ERROR_PARAMETER2);
+  }
+  linear_mode_value = value;
+  return record(DeviceCall::SetLinearModeValue, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::TU_ResetSequence() {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::ResetSequence);
+  // A running generator has nothing left to play once its table is cleared.
+  stopGenerator(end);
+  signal_table.clear();
+  trigger_points.clear();
+  loop_back_trigger_point = 0;
+  return record(DeviceCall::ResetSequence, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::addSignal(DeviceCall call,
+                                    const SimulatedSignal& signal) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(call);
+  if (!isValidSignalNr(signal.signal_nr)) {
+    return record(call, begin, end, VI_ERROR_PARAMETER2);
+  }
+  if (max_signals_per_channel > 0 &&
+      static_cast<size_t>(std::count_if(
+          signal_table.begin(), signal_table.end(),
+          [&signal](const SimulatedSignal& other) {
+            return other.signal_nr == signal.signal_nr;
+          })) >= max_signals_per_channel) {
+    return record(call, begin, end, VI_ERROR_PARAMETER2);
+  }
+  // Signals added while the generator runs only apply from the next start.
+  signal_table.push_back(signal);
+  return record(call, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::TU_AddGeneratedSelfRunningSignal(
+    ViUInt8 signalNr, ViBoolean activeLow, ViUInt32 startDelayus,
+    ViUInt32 activeTimeus, ViUInt32 inactiveTimeus, ViUInt32 repetitionCount) {
+  return addSignal(DeviceCall::AddSelfRunningSignal,
+                   {signalNr, activeLow, startDelayus, activeTimeus,
+                    inactiveTimeus, repetitionCount, false});
+}
+
+ViStatus SimulatedDevice::TU_AddGeneratedTriggeredSignal(
+    ViUInt8 signalNr, ViBoolean activeLow, ViUInt32 startDelayus,
+    ViUInt32 activeTimeus, ViUInt32 inactiveTimeus, ViUInt32 repetitionCount) {
+  return addSignal(DeviceCall::AddTriggeredSignal,
+                   {signalNr, activeLow, startDelayus, activeTimeus,
+                    inactiveTimeus, repetitionCount, true});
+}
+
+ViStatus SimulatedDevice::TU_AddTriggerPoint(ViUInt8 signalNr,
+                                             ViBoolean startsLow,
+                                             ViUInt32 edgeCount,
+                                             ViInt16 affectedSignalBitmask) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::AddTriggerPoint);
+  if (!isValidSignalNr(signalNr)) {
+    return record(DeviceCall::AddTriggerPoint, begin, end,
+                  VI_ERROR_PARAMETER2);
+  }
+  // One bit per signal 1-12
+  uint16_t bitmask = static_cast<uint16_t>(affectedSignalBitmask);
+  if (bitmask == 0 || bitmask >= (1u << 12)) {
+    return record(DeviceCall::AddTriggerPoint, begin, end,
+                  VI_ERROR_PARAMETER5);
+  }
+  trigger_points.push_back(
+      {signalNr, startsLow, edgeCount, affectedSignalBitmask});
+  return record(DeviceCall::AddTriggerPoint, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::TU_LoopBackTrigger(ViUInt32 refTrigPoint) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::LoopBackTrigger);
+  if (refTrigPoint < 1 || refTrigPoint > trigger_points.size()) {
+    return record(DeviceCall::LoopBackTrigger, begin, end,
+                  VI_ERROR_PARAMETER2);
+  }
+  loop_back_trigger_point = refTrigPoint;
+  return record(DeviceCall::LoopBackTrigger, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::TU_StartStopGeneratorOutput_TU(ViBoolean start) {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::StartStopGenerator);
+  stopGenerator(end);  // starting a running generator restarts it
+  if (start != VI_FALSE) {
+    generator_runs.push_back({end, OPEN_END, signal_table, trigger_points,
+                              loop_back_trigger_point});
+    generator_running = true;
+  }
+  return record(DeviceCall::StartStopGenerator, begin, end, VI_SUCCESS);
+}
+
+ViStatus SimulatedDevice::close() {
+  nanoseconds begin = now();
+  nanoseconds end = simulateLatency(DeviceCall::Close);
+  return record(DeviceCall::Close, begin, end, VI_SUCCESS);
+}
+
+void SimulatedDevice::resetHistory() {
+  epoch = std::chrono::steady_clock::now();
+  call_log.clear();
+  generator_runs.clear();
+  generator_running = false;
+  power_events.clear();
+  brightness_events.clear();
+  power_events.push_back({nanoseconds(0), power_states});
+  brightness_events.push_back({nanoseconds(0), brightness});
+}
+
+std::vector<std::vector<std::chrono::nanoseconds>>
+SimulatedDevice::signalStarts(const GeneratorRun& run, nanoseconds run_end) {
+  std::vector<std::vector<nanoseconds>> starts(run.signals.size());
+  for (size_t i = 0; i < run.signals.size(); i++) {
+    if (!run.signals[i].triggered) {
+      starts[i].push_back(run.start);
+    }
+  }
+  size_t i_trigger_point = 0;
+  nanoseconds armed = run.start;
+  bool looped_back = false;
+  nanoseconds last_loop_back = run.start;
+  while (i_trigger_point < run.trigger_points.size()) {
+    const SimulatedTriggerPoint& trigger_point =
+        run.trigger_points[i_trigger_point];
+    nanoseconds fired = armed;
+    if (trigger_point.edge_count > 0) {
+      // Edges of the signal after the trigger point was armed. All starts so
+      // far are at or before it, only the last start of each signal matters.
+      std::vector<Interval> intervals;
+      for (size_t i = 0; i < run.signals.size(); i++) {
+        if (run.signals[i].signal_nr == trigger_point.signal_nr &&
+            !starts[i].empty()) {
+          addPulses(run.signals[i], starts[i].back(), run.stop, run_end,
+                    intervals);
+        }
+      }
+      ViUInt32 n_edges = 0;
+      for (const auto& interval : mergeIntervals(std::move(intervals))) {
+        for (nanoseconds edge : {interval.begin, interval.end}) {
+          if (edge > armed && n_edges < trigger_point.edge_count) {
+            n_edges++;
+            fired = edge;
+          }
+        }
+      }
+      if (n_edges < trigger_point.edge_count) {
+        break;  // never fires
+      }
+    }
+    if (fired >= run.stop || (looped_back && fired >= run_end)) {
+      break;
+    }
+    for (size_t i = 0; i < run.signals.size(); i++) {
+      const SimulatedSignal& signal = run.signals[i];
+      if (signal.triggered &&
+          (static_cast<uint16_t>(trigger_point.affected_signal_bitmask) >>
+           (signal.signal_nr - 1)) & 1) {
+        starts[i].push_back(fired);
+      }
+    }
+    armed = fired;
+    i_trigger_point++;
+    if (i_trigger_point == run.trigger_points.size() &&
+        run.loop_back_trigger_point > 0) {
+      if (looped_back && fired == last_loop_back) {
+        break;  // a loop of trigger points that all fire at once
+      }
+      i_trigger_point = run.loop_back_trigger_point - 1;
+      looped_back = true;
+      last_loop_back = fired;
+    }
+  }
+  return starts;
+}
+
+std::vector<LedEdge> SimulatedDevice::getLedTimeline() const {
+  std::vector<LedEdge> edges;
+  nanoseconds horizon = now();
+  std::vector<std::vector<std::vector<nanoseconds>>> run_starts;
+  run_starts.reserve(generator_runs.size());
+  for (const auto& run : generator_runs) {
+    run_starts.push_back(
+        signalStarts(run, std::min(run.stop, std::max(horizon, run.start))));
+  }
+  for (ViUInt16 led_index = 0; led_index < 6; led_index++) {
+    // When is the timing unit driving this LED channel?
+    std::vector<Interval> signal_intervals;
+    for (size_t i_run = 0; i_run < generator_runs.size(); i_run++) {
+      const GeneratorRun& run = generator_runs[i_run];
+      const std::vector<std::vector<nanoseconds>>& starts = run_starts[i_run];
+      nanoseconds run_end = std::min(run.stop, std::max(horizon, run.start));
+      for (size_t i = 0; i < run.signals.size(); i++) {
+        if (run.signals[i].signal_nr != led_index + 1) {
+          continue;
+        }
+        // A new start of a triggered signal cuts the previous one short
+        for (size_t k = 0; k < starts[i].size(); k++) {
+          nanoseconds cut = k + 1 < starts[i].size()
+                                ? std::min(starts[i][k + 1], run.stop)
+                                : run.stop;
+          addPulses(run.signals[i], starts[i][k], cut, run_end,
+                    signal_intervals);
+        }
+      }
+    }
+    signal_intervals = mergeIntervals(std::move(signal_intervals));
+    std::vector<Interval> power_intervals = onIntervals(
+        power_events,
+        [led_index](const PowerEvent& e) { return e.states[led_index]; });
+    std::vector<Interval> brightness_intervals =
+        onIntervals(brightness_events, [led_index](const BrightnessEvent& e) {
+          return e.brightness[led_index] > 0;
+        });
+    std::vector<Interval> lit = intersectIntervals(
+        intersectIntervals(signal_intervals, power_intervals),
+        brightness_intervals);
+    for (const auto& interval : lit) {
+      // brightness in effect at the on edge
+      auto it = std::upper_bound(
+          brightness_events.begin(), brightness_events.end(), interval.begin,
+          [](nanoseconds t, const BrightnessEvent& e) { return t < e.time; });
+      ViUInt16 on_brightness =
+          (it == brightness_events.begin()) ? 0 : (it - 1)->brightness[led_index];
+      edges.push_back({interval.begin, led_index, true, on_brightness});
+      edges.push_back({interval.end, led_index, false, 0});
+    }
+  }
+  std::sort(edges.begin(), edges.end(),
+            [](const LedEdge& a, const LedEdge& b) {
+              if (a.time != b.time) {
+                return a.time < b.time;
+              }
+              return !a.on && b.on;  // off edges first on ties
+            });
+  return edges;
+}
@@ -0,0 +1,107 @@
+#include "SinglePulsesBatch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Timing.hpp"
+
+SinglePulsesBatch::SinglePulsesBatch(uint32_t batch_id,
+                                     ChrolisDevice* device_ptr,
+                                     std::span<const ProtocolStep> steps,
+                                     Logger* logger_ptr,
+                                     std::chrono::microseconds call_lead_us,
+                                     ProgramArena& programs,
+                                     DeviceState* device_state)
+    : PulseChainBatch(batch_id, device_ptr, steps, logger_ptr,
+                      programs.addSinglePulsesProgram(steps), device_state),
+      call_lead_us(call_lead_us) {
+  const std::array<ViUInt16, 6> dark = {0, 0, 0, 0, 0, 0};
+  std::chrono::microseconds time_us(0);
+  // At most an on and an off edge per pulse, one allocation
+  edges.reserve(ProgramArena::countSignalsBound(steps));
+  for (const auto& step : steps) {
+    if (!step.isBreak()) {
+      if (step.n_pulses != 1) {
+        throw std::invalid_argument(
+            "SinglePulsesBatch: steps must have a single pulse.");
+      }
+      std::array<ViUInt16, 6> on = dark;
+      on[step.led_index] = step.brightness;
+      if (!edges.empty() && edges.back().time_us == time_us) {
+        edges.back() = {time_us, on, step.step_id};  // gapless, one call
+      } else {
+        edges.push_back({time_us, on, step.step_id});
+      }
+      edges.push_back({time_us + std::chrono::microseconds(step.pulse_width_us),
+                       dark, step.step_id});
+    }
+    time_us += std::chrono::microseconds(step.getTotalDurationUs());
+  }
+  // Consecutive edges with the same brightness need no call
+  edges.erase(std::unique(edges.begin(), edges.end(),
+                          [](const BrightnessEdge& call,
+                             const BrightnessEdge& edge) {
+                            return call.brightness == edge.brightness;
+                          }),
+              edges.end());
+  batch_type = "SinglePulsesBatch";
+}
+
+std::chrono::microseconds SinglePulsesBatch::execute() {
+  logger_ptr->trace("SinglePulsesBatch execute()");
+  if (execute_attempted) {
+    throw std::logic_error(
+        "SinglePulsesBatch: attempting to execute already executed batch.");
+  }
+  auto start = Timing::Clock::now();
+  ViStatus err;
+  logger_ptr->protocolf("Executing %s %u", batch_type, batch_id);
+  execute_attempted = true;
+
+  // Opens the gate signals, the LEDs stay dark at brightness 0
+  err = device_ptr->TU_StartStopGeneratorOutput_TU(true);
+  logEvent(LogEvent::StartStopGenerator, LogEventData::NO_STEP, err,
+           {VI_TRUE});
+  if (VI_SUCCESS != err) {
+    throw std::runtime_error(
+        "SinglePulsesBatch::execute(): Error starting signal generator.");
+  }
+  DeviceState& state = getDeviceState();
+  const std::array<ViBoolean, 6>& power_states = program.power_states;
+  if (state.power_states != power_states) {
+    state.power_states.reset();
+    err = device_ptr->setLED_HeadPowerStates(power_states[0], power_states[1],
+                                             power_states[2], power_states[3],
+                                             power_states[4], power_states[5]);
+    logEvent(LogEvent::SetHeadPowerStates, LogEventData::NO_STEP, err,
+             {power_states[0], power_states[1], power_states[2],
+              power_states[3], power_states[4], power_states[5]});
+    if (VI_SUCCESS != err) {
+      throw std::runtime_error(
+          "SinglePulsesBatch::execute(): Error setting head power states.");
+    }
+    state.power_states = power_states;
+  }
+  // The first step starts after the startup delay, as for a PulseChainBatch.
+  // The last edge turns the LEDs off, they stay powered at brightness 0.
+  Timing::Clock::time_point batch_start = start + getStartupDelayUs();
+  for (const auto& edge : edges) {
+    Timing::precise_sleep_until(batch_start + edge.time_us - call_lead_us);
+    const std::array<ViUInt16, 6>& brightness = edge.brightness;
+    state.brightness.reset();
+    err = device_ptr->setLED_HeadBrightness(brightness[0], brightness[1],
+                                            brightness[2], brightness[3],
+                                            brightness[4], brightness[5]);
+    logEvent(LogEvent::SetHeadBrightness, edge.step_id, err,
+             {brightness[0], brightness[1], brightness[2], brightness[3],
+              brightness[4], brightness[5]});
+    if (VI_SUCCESS != err) {
+      throw std::runtime_error(
+          "SinglePulsesBatch::execute(): Error setting LED head brightness.");
+    }
+    state.brightness = brightness;
+  }
+  logger_ptr->trace("SinglePulsesBatch execute() done.");
+  auto end = Timing::Clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+}
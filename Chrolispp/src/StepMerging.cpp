@@ -0,0 +1,186 @@
+#include "StepMerging.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+#include "constants.hpp"
+
+namespace {
+// Whether a merged time (or number of pulses) still fits the 32 bits the
+// device takes
+bool fitsDevice(uint64_t a, uint64_t b) {
+  return a + b <= Constants::MAX_DEVICE_TIME_US;
+}
+}  // namespace
+
+CompatibilityStatus stepsCompatibleForMerge(const ProtocolStep& step1,
+                                            const ProtocolStep& step2) {
+  if (step1.isBreak() && step2.isBreak()) {
+    return fitsDevice(step1.getBreakDurationUs(), step2.getBreakDurationUs())
+               ? CompatibilityStatus::BothBreaks
+               : CompatibilityStatus::Incompatible;
+  }
+  if (step1.isGaplessSinglePulse()) {
+    if (step2.isBreak()) {
+      if (fitsDevice(step1.time_between_pulses_us,
+                     step2.getBreakDurationUs())) {
+        return CompatibilityStatus::CompatibleGaplessAndBreak;
+      }
+    } else if ((step1.led_index == step2.led_index) &&
+               (step1.brightness == step2.brightness) &&
+               (step2.n_pulses == 1) &&
+               fitsDevice(step1.pulse_width_us, step2.pulse_width_us)) {
+      return CompatibilityStatus::CompatibleGaplessAndSingle;
+    }
+  }
+  if ((step1.led_index == step2.led_index) &&
+      (step1.brightness == step2.brightness) &&
+      (step1.pulse_width_us == step2.pulse_width_us) &&
+      (step1.time_between_pulses_us == step2.time_between_pulses_us) &&
+      fitsDevice(step1.n_pulses, step2.n_pulses)) {
+    return CompatibilityStatus::CompatibleSameShape;
+  }
+  return CompatibilityStatus::Incompatible;
+}
+
+namespace {
+/*
+step2 is a single pulse of the same shape as the pulse chain step1, except for
+a longer gap after it
+*/
+bool canMergeAfterGapSplit(const ProtocolStep& step1,
+                           const ProtocolStep& step2) {
+  return !step1.isBreak() && !step2.isBreak() &&
+         !step1.isGaplessSinglePulse() && step2.n_pulses == 1 &&
+         step1.led_index == step2.led_index &&
+         step1.brightness == step2.brightness &&
+         step1.pulse_width_us == step2.pulse_width_us &&
+         step2.time_between_pulses_us > step1.time_between_pulses_us;
+}
+
+// Turn the single pulse step, whose pulse and first gap_kept_us of gap went
+// into the preceding chain, into a break of the rest of its gap. Keeps the id.
+void splitOffGap(ProtocolStep& step, ViUInt32 gap_kept_us) {
+  step.time_between_pulses_us -= gap_kept_us;
+  step.led_index = 0;
+  step.brightness = 0;
+  step.pulse_width_us = 0;
+  step.n_pulses = 1;
+}
+
+// Record that steps[index] absorbed n_steps more original steps
+void addAbsorbed(MergeReport& report, size_t index, size_t n_steps) {
+  if (!report.merged_steps.empty() &&
+      report.merged_steps.back().index == index) {
+    report.merged_steps.back().n_absorbed += n_steps;
+  } else {
+    report.merged_steps.push_back({index, 1 + n_steps});
+  }
+}
+}  // namespace
+
+MergeReport mergeSteps(std::vector<ProtocolStep>& steps, bool split_gaps) {
+  MergeReport report;
+  report.steps_before = steps.size();
+  if (steps.empty()) {
+    return report;
+  }
+  auto count = [&report](CompatibilityStatus status) {
+    report.merge_counts[static_cast<int>(status)]++;
+  };
+  // steps[0..write] is the merged protocol so far, steps[write] the step the
+  // next one may be merged into. steps[read] is the next unmerged step.
+  size_t write = 0;
+  size_t n_absorbed = 0;  // steps merged into steps[write] so far
+  size_t read = 1;
+  while (read < steps.size()) {
+    ProtocolStep& current = steps[write];
+    ProtocolStep& next = steps[read];
+    CompatibilityStatus compatibility = stepsCompatibleForMerge(current, next);
+    switch (compatibility) {
+      case CompatibilityStatus::BothBreaks:
+        current.setBreakDuration(current.getBreakDurationUs() +
+                                 next.getBreakDurationUs());
+        break;
+      case CompatibilityStatus::CompatibleSameShape:
+        current.n_pulses += next.n_pulses;
+        break;
+      case CompatibilityStatus::CompatibleGaplessAndBreak:
+        // The break becomes the time between pulses (next is a break)
+        current.time_between_pulses_us += next.getBreakDurationUs();
+        break;
+      case CompatibilityStatus::CompatibleGaplessAndSingle:
+        current.pulse_width_us += next.pulse_width_us;
+        current.time_between_pulses_us += next.time_between_pulses_us;
+        current.n_pulses = 1;
+        break;
+      default:
+        if (split_gaps && canMergeAfterGapSplit(current, next)) {
+          // next becomes the rest of its gap, compared again with current
+          current.n_pulses++;
+          splitOffGap(next, current.time_between_pulses_us);
+          count(CompatibilityStatus::CompatibleAfterGapSplit);
+          n_absorbed++;
+          continue;
+        }
+        if (split_gaps && write > 0 && n_absorbed > 0) {
+          // Merging changed current, it may merge into the step before now
+          ProtocolStep& previous = steps[write - 1];
+          if (stepsCompatibleForMerge(previous, current) ==
+              CompatibilityStatus::CompatibleSameShape) {
+            previous.n_pulses += current.n_pulses;
+            count(CompatibilityStatus::CompatibleSameShape);
+            addAbsorbed(report, write - 1, 1 + n_absorbed);
+            write--;
+            n_absorbed = 0;
+            continue;
+          }
+          if (canMergeAfterGapSplit(previous, current)) {
+            previous.n_pulses++;
+            splitOffGap(current, previous.time_between_pulses_us);
+            count(CompatibilityStatus::CompatibleAfterGapSplit);
+            addAbsorbed(report, write - 1, 1 + n_absorbed);
+            n_absorbed = 0;
+            continue;
+          }
+        }
+        // current is final, next starts the next merged step
+        if (n_absorbed > 0) {
+          addAbsorbed(report, write, n_absorbed);
+        }
+        n_absorbed = 0;
+        write++;
+        if (write != read) {
+          steps[write] = std::move(steps[read]);
+        }
+        read++;
+        continue;
+    }
+    count(compatibility);
+    n_absorbed++;
+    read++;
+  }
+  if (n_absorbed > 0) {
+    addAbsorbed(report, write, n_absorbed);
+  }
+  steps.erase(steps.begin() + write + 1, steps.end());
+  report.steps_after = steps.size();
+  return report;
+}
+
+std::string summarizeMergeReport(const MergeReport& report) {
+  char summary[256];
+  std::snprintf(
+      summary, sizeof(summary),
+      "Merged %zu steps into %zu: %zu merges (breaks: %zu, same shape: %zu, "
+      "gapless pulse and break: %zu, gapless pulse and single pulse: %zu, "
+      "after gap split: %zu).",
+      report.steps_before, report.steps_after, report.getMergeCount(),
+      report.getMergeCount(CompatibilityStatus::BothBreaks),
+      report.getMergeCount(CompatibilityStatus::CompatibleSameShape),
+      report.getMergeCount(CompatibilityStatus::CompatibleGaplessAndBreak),
+      report.getMergeCount(CompatibilityStatus::CompatibleGaplessAndSingle),
+      report.getMergeCount(CompatibilityStatus::CompatibleAfterGapSplit));
+  return summary;
+}
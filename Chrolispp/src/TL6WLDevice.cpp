@@ -0,0 +1,57 @@
+#include "TL6WLDevice.hpp"
+
+ViStatus TL6WLDevice::setLED_HeadPowerStates(ViBoolean led1, ViBoolean led2,
+                                             ViBoolean led3, ViBoolean led4,
+                                             ViBoolean led5, ViBoolean led6) {
+  return TL6WL_setLED_HeadPowerStates(instr, led1, led2, led3, led4, led5,
+                                      led6);
+}
+
+ViStatus TL6WLDevice::setLED_HeadBrightness(ViUInt16 led1, ViUInt16 led2,
+                                            ViUInt16 led3, ViUInt16 led4,
+                                            ViUInt16 led5, ViUInt16 led6) {
+  return TL6WL_setLED_HeadBrightness(instr, led1, led2, led3, led4, led5,
+                                     led6);
+}
+
+ViStatus TL6WLDevice::setLED_LinearModeValue(ViUInt16 value) {
+  return TL6WL_setLED_LinearModeValue(instr, value);
+}
+
+ViStatus TL6WLDevice::TU_ResetSequence() {
+  return TL6WL_TU_ResetSequence(instr);
+}
+
+ViStatus TL6WLDevice::TU_AddGeneratedSelfRunningSignal(
+    ViUInt8 signalNr, ViBoolean activeLow, ViUInt32 startDelayus,
+    ViUInt32 activeTimeus, ViUInt32 inactiveTimeus, ViUInt32 repetitionCount) {
+  return TL6WL_TU_AddGeneratedSelfRunningSignal(instr, signalNr, activeLow,
+                                                startDelayus, activeTimeus,
+                                                inactiveTimeus,
+                                                repetitionCount);
+}
+
+ViStatus TL6WLDevice::TU_AddGeneratedTriggeredSignal(
+    ViUInt8 signalNr, ViBoolean activeLow, ViUInt32 startDelayus,
+    ViUInt32 activeTimeus, ViUInt32 inactiveTimeus, ViUInt32 repetitionCount) {
+  return TL6WL_TU_AddGeneratedTriggeredSignal(instr, signalNr, activeLow,
+                                              startDelayus, activeTimeus,
+                                              inactiveTimeus, repetitionCount);
+}
+
+ViStatus TL6WLDevice::TU_AddTriggerPoint(ViUInt8 signalNr, ViBoolean startsLow,
+                                         ViUInt32 edgeCount,
+                                         ViInt16 affectedSignalBitmask) {
+  return TL6WL_TU_AddTriggerPoint(instr, signalNr, startsLow, edgeCount,
+                                  affectedSignalBitmask);
+}
+
+ViStatus TL6WLDevice::TU_LoopBackTrigger(ViUInt32 refTrigPoint) {
+  return TL6WL_TU_LoopBackTrigger(instr, refTrigPoint);
+}
+
+ViStatus TL6WLDevice::TU_StartStopGeneratorOutput_TU(ViBoolean start) {
+  return TL6WL_TU_StartStopGeneratorOutput_TU(instr, start);
+}
+
+ViStatus TL6WLDevice::close() { return TL6WL_close(instr); }
@@ -0,0 +1,52 @@
+#include "TimestampFormatter.hpp"
+
+#include <cstring>
+#include <ctime>
+
+TimestampFormatter::TimestampFormatter()
+    : TimestampFormatter(std::chrono::system_clock::now(),
+                         std::chrono::steady_clock::now()) {}
+
+TimestampFormatter::TimestampFormatter(
+    std::chrono::system_clock::time_point wall_epoch,
+    std::chrono::steady_clock::time_point steady_epoch)
+    : wall_epoch(wall_epoch),
+      steady_epoch(steady_epoch),
+      cached_second(-1),
+      cached_prefix() {}
+
+size_t TimestampFormatter::format(int64_t steady_ticks, char* out) {
+  using std::chrono::duration_cast;
+  auto wall = wall_epoch +
+              duration_cast<std::chrono::system_clock::duration>(
+                  std::chrono::steady_clock::time_point(
+                      std::chrono::steady_clock::duration(steady_ticks)) -
+                  steady_epoch);
+  int64_t ms_since_epoch =
+      duration_cast<std::chrono::milliseconds>(wall.time_since_epoch())
+          .count();
+  int64_t second = ms_since_epoch / 1000;
+  int ms = static_cast<int>(ms_since_epoch % 1000);
+  if (ms < 0) {  // before 1970, round towards the earlier second
+    second--;
+    ms += 1000;
+  }
+  if (second != cached_second) {
+    std::time_t now_time = static_cast<std::time_t>(second);
+    std::tm now_tm;
+#ifdef _WIN32
+    localtime_s(&now_tm, &now_time);
+#else
+    localtime_r(&now_time, &now_tm);
+#endif
+    std::strftime(cached_prefix, sizeof(cached_prefix), "%Y-%m-%d %H:%M:%S",
+                  &now_tm);
+    cached_second = second;
+  }
+  std::memcpy(out, cached_prefix, PREFIX_LENGTH);
+  out[PREFIX_LENGTH] = '.';
+  out[PREFIX_LENGTH + 1] = static_cast<char>('0' + ms / 100);
+  out[PREFIX_LENGTH + 2] = static_cast<char>('0' + ms / 10 % 10);
+  out[PREFIX_LENGTH + 3] = static_cast<char>('0' + ms % 10);
+  return LENGTH;
+}
@@ -1,40 +1,133 @@
 #include "Timing.hpp"
 
+#include <algorithm>
+
 #if defined(_WIN32)
 #pragma comment(lib, "Winmm.lib")
 #include <windows.h>
 
-#include <iostream>
+#include <cstdlib>
+
+namespace {
+// Sleep() rounds to the timer tick; with 1 ms resolution it typically wakes up
+// 1-2 ms late.
+constexpr std::chrono::nanoseconds INITIAL_OVERSHOOT =
+    std::chrono::microseconds(2000);
+// Sleep() takes whole milliseconds; shorter waits are spun entirely.
+constexpr std::chrono::nanoseconds MIN_COARSE_SLEEP =
+    std::chrono::milliseconds(1);
 
-void Timing::precise_sleep_for(std::chrono::milliseconds ms) {
-  // Request 1 ms timer resolution on Windows
-  DWORD dw_ms = static_cast<DWORD>(ms.count());
-  //std::cout << "Sleeping for " << dw_ms << " ms" << std::endl;
-  timeBeginPeriod(1);
+void requestTimerResolution() {
+  // Request 1 ms timer resolution on Windows once, instead of around every
+  // single Sleep (which itself costs time and reprograms the system timer).
+  static const bool requested = [] {
+    timeBeginPeriod(1);
+    std::atexit([] { timeEndPeriod(1); });
+    return true;
+  }();
+  (void)requested;
+}
+
+void coarse_sleep(std::chrono::nanoseconds duration) {
+  requestTimerResolution();
+  DWORD dw_ms = static_cast<DWORD>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
   Sleep(dw_ms);
-  timeEndPeriod(1);
 }
+}  // namespace
 
 #elif defined(__linux__)
 #include <time.h>
 
-void Timing::precise_sleep_for(std::chrono::milliseconds ms) {
+namespace {
+constexpr std::chrono::nanoseconds INITIAL_OVERSHOOT =
+    std::chrono::microseconds(200);
+// Not worth a context switch below this; shorter waits are spun entirely.
+constexpr std::chrono::nanoseconds MIN_COARSE_SLEEP =
+    std::chrono::microseconds(50);
+
+void coarse_sleep(std::chrono::nanoseconds duration) {
   timespec ts;
-  ts.tv_sec = ms.count() / 1000;
-  ts.tv_nsec = (ms.count() % 1000) * 1'000'000;
+  ts.tv_sec = duration.count() / 1'000'000'000;
+  ts.tv_nsec = duration.count() % 1'000'000'000;
   clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, nullptr);
 }
+}  // namespace
 
 #elif defined(__APPLE__)
 #include <time.h>
 
-void Timing::precise_sleep_for(std::chrono::milliseconds ms) {
+namespace {
+constexpr std::chrono::nanoseconds INITIAL_OVERSHOOT =
+    std::chrono::microseconds(500);
+constexpr std::chrono::nanoseconds MIN_COARSE_SLEEP =
+    std::chrono::microseconds(50);
+
+void coarse_sleep(std::chrono::nanoseconds duration) {
   timespec ts;
-  ts.tv_sec = ms.count() / 1000;
-  ts.tv_nsec = (ms.count() % 1000) * 1'000'000;
+  ts.tv_sec = duration.count() / 1'000'000'000;
+  ts.tv_nsec = duration.count() % 1'000'000'000;
   nanosleep(&ts, nullptr);
 }
+}  // namespace
 
 #else
 #error "Unsupported platform"
 #endif
+
+namespace {
+using std::chrono::nanoseconds;
+
+/*
+Online estimate of how late the OS wakes us up, in the style of the TCP
+retransmission timer: exponentially smoothed mean and mean deviation of the
+observed overshoot. The OS sleep is ended mean + 4 * deviation early; the rest
+is spun.
+*/
+struct OvershootEstimator {
+  double mean_ns = static_cast<double>(INITIAL_OVERSHOOT.count());
+  double deviation_ns = static_cast<double>(INITIAL_OVERSHOOT.count()) / 4;
+
+  nanoseconds margin() const {
+    return nanoseconds(static_cast<long long>(mean_ns + 4 * deviation_ns));
+  }
+
+  void update(nanoseconds overshoot) {
+    double sample =
+        static_cast<double>(std::max(overshoot, nanoseconds(0)).count());
+    double error = sample - mean_ns;
+    mean_ns += error / 8;
+    deviation_ns += ((error < 0 ? -error : error) - deviation_ns) / 4;
+  }
+};
+
+thread_local OvershootEstimator estimator;
+}  // namespace
+
+void Timing::precise_sleep_until(Clock::time_point deadline) {
+  // Coarse phase: let the OS sleep, ending early by the learned margin. May
+  // take several rounds if the OS wakes us up too early.
+  for (;;) {
+    Clock::time_point now = Clock::now();
+    nanoseconds request = deadline - now - estimator.margin();
+    if (request < MIN_COARSE_SLEEP) {
+      break;
+    }
+    coarse_sleep(request);
+    estimator.update(Clock::now() - now - request);
+  }
+  // Fine phase: spin on the clock for the final stretch.
+  while (Clock::now() < deadline) {
+  }
+}
+
+void Timing::precise_sleep_for(std::chrono::microseconds duration) {
+  if (duration.count() > 0) {
+    precise_sleep_until(Clock::now() + duration);
+  }
+}
+
+std::chrono::microseconds Timing::sleep_overshoot_estimate() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      estimator.margin());
+}
@@ -0,0 +1,223 @@
+#include "TriggerChaining.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+using std::chrono::microseconds;
+
+namespace {
+// Only batches of pulse chains are timed by the signal generator
+bool isChainable(const BatchPartition& partition, size_t i_batch) {
+  return partition.batch_kinds[i_batch] == BatchKind::PulseChain;
+}
+
+// Index of the last pulse step of a pulse batch
+size_t lastPulseStep(const std::vector<ProtocolStep>& steps,
+                     const BatchPartition& partition, size_t i_batch) {
+  size_t i_step = partition.getBatchEnd(i_batch, steps.size());
+  while (steps[--i_step].isBreak()) {
+  }
+  return i_step;
+}
+
+// Dark time from the last falling edge of a pulse batch to its end
+uint64_t trailingGapUs(const std::vector<ProtocolStep>& steps,
+                       const BatchPartition& partition, size_t i_batch) {
+  uint64_t gap_us = 0;
+  size_t i_step = partition.getBatchEnd(i_batch, steps.size());
+  do {
+    // the time between pulses of a break is its duration
+    gap_us += steps[--i_step].time_between_pulses_us;
+  } while (steps[i_step].isBreak());
+  return gap_us;
+}
+
+/*
+Builds the program of a trigger chain batch by batch, see
+compileTriggerChain().
+*/
+class ChainCompiler {
+ public:
+  ChainCompiler(const std::vector<ProtocolStep>& steps,
+                const BatchPartition& partition, ViUInt32 trigger_lead_us)
+      : steps(steps), partition(partition) {
+    program.startup_delay_us = trigger_lead_us;
+  }
+
+  // Append the batch after the last appended one. Returns false (and leaves
+  // the program unchanged) if the device cannot express it.
+  bool append(size_t i_batch) {
+    uint64_t lead_us = program.startup_delay_us;
+    TriggerPoint trigger_point = {0, VI_TRUE, 0, 0};
+    if (!program.trigger_points.empty()) {
+      const ProtocolStep& source =
+          steps[lastPulseStep(steps, partition, i_batch - 1)];
+      if (source.pulse_width_us == 0 ||
+          (source.n_pulses > 1 && source.time_between_pulses_us == 0)) {
+        return false;  // no distinct edges to count
+      }
+      lead_us = trailingGapUs(steps, partition, i_batch - 1);
+      if (lead_us == 0) {
+        return false;  // would start on the edge that triggers it
+      }
+      trigger_point.signal_nr = static_cast<ViUInt8>(source.led_index + 1);
+      trigger_point.edge_count = 2 * source.n_pulses;
+    }
+    std::vector<GeneratorSignal> added_signals;
+    std::vector<uint32_t> added_step_ids;
+    std::array<ViUInt16, 6> brightness = program.brightness;
+    std::array<ViBoolean, 6> power_states = program.power_states;
+    uint16_t bitmask = 0;
+    uint64_t duration_so_far_us = lead_us;
+    size_t end = partition.getBatchEnd(i_batch, steps.size());
+    for (size_t i_step = partition.batch_starts[i_batch]; i_step < end;
+         i_step++) {
+      const ProtocolStep& step = steps[i_step];
+      if (step.isBreak()) {
+        duration_so_far_us += step.getTotalDurationUs();
+        continue;
+      }
+      if (power_states[step.led_index] &&
+          brightness[step.led_index] != step.brightness) {
+        return false;
+      }
+      if (duration_so_far_us > Constants::MAX_DEVICE_TIME_US) {
+        return false;  // too late after the trigger for the timing unit
+      }
+      brightness[step.led_index] = step.brightness;
+      power_states[step.led_index] = VI_TRUE;
+      for (ViUInt8 signal_nr :
+           {static_cast<ViUInt8>(step.led_index + 1),
+            static_cast<ViUInt8>(step.led_index + 1 + 6)}) {
+        GeneratorSignal signal = {signal_nr,
+                                  VI_FALSE,
+                                  static_cast<ViUInt32>(duration_so_far_us),
+                                  step.pulse_width_us,
+                                  step.time_between_pulses_us,
+                                  step.n_pulses,
+                                  true};
+        bitmask |= static_cast<uint16_t>(1u << (signal_nr - 1));
+        auto same_nr = [signal_nr](const GeneratorSignal& other) {
+          return other.signal_nr == signal_nr;
+        };
+        auto found = std::find_if(program.signals.begin(),
+                                  program.signals.end(), same_nr);
+        if (found == program.signals.end()) {
+          found = std::find_if(added_signals.begin(), added_signals.end(),
+                               same_nr);
+          if (found != added_signals.end()) {
+            return false;  // one LED twice in the batch
+          }
+          added_signals.push_back(signal);
+          added_step_ids.push_back(step.step_id);
+        } else if (*found != signal) {
+          return false;  // one signal number, one set of parameters
+        }
+      }
+      duration_so_far_us += step.getTotalDurationUs();
+    }
+    if (bitmask == 0) {
+      return false;  // nothing to trigger
+    }
+    if (program.trigger_points.empty()) {
+      // fires at once, the signal number only has to be valid
+      trigger_point.signal_nr = static_cast<ViUInt8>(
+          steps[lastPulseStep(steps, partition, i_batch)].led_index + 1);
+    }
+    trigger_point.affected_signal_bitmask = static_cast<ViInt16>(bitmask);
+    program.signals.insert(program.signals.end(), added_signals.begin(),
+                           added_signals.end());
+    program.signal_step_ids.insert(program.signal_step_ids.end(),
+                                   added_step_ids.begin(),
+                                   added_step_ids.end());
+    program.trigger_points.push_back(trigger_point);
+    program.brightness = brightness;
+    program.power_states = power_states;
+    return true;
+  }
+
+  const BatchProgram& getProgram() const { return program; }
+  BatchProgram takeProgram() { return std::move(program); }
+
+ private:
+  const std::vector<ProtocolStep>& steps;
+  const BatchPartition& partition;
+  BatchProgram program;
+};
+}  // namespace
+
+std::vector<ScheduledBatch> chainBatches(
+    const std::vector<ProtocolStep>& steps, const BatchPartition& partition,
+    const std::vector<size_t>& next_same_batch, const BatchCostModel& model) {
+  std::vector<ScheduledBatch> chains;
+  size_t n_batches = partition.getBatchCount();
+  // Append batches to a chain starting at batch first, return its end
+  auto extend = [&](ChainCompiler& compiler, size_t first) {
+    size_t end = first;
+    while (end < n_batches && isChainable(partition, end) &&
+           compiler.append(end)) {
+      end++;
+    }
+    return end;
+  };
+  size_t first = 0;
+  while (first < n_batches) {
+    if (!isChainable(partition, first)) {
+      chains.push_back({first, first + 1});
+      first++;
+      continue;
+    }
+    ScheduledBatch chain = {first, first + 1};
+    size_t next = next_same_batch[first];
+    if (next < n_batches) {
+      // Lead of the batch when the chain triggers it again
+      uint64_t recurring_lead_us = trailingGapUs(steps, partition, next - 1);
+      if (recurring_lead_us >= Constants::STARTUP_GUARD_US &&
+          recurring_lead_us <= Constants::MAX_DEVICE_TIME_US) {
+        ChainCompiler compiler(steps, partition,
+                               static_cast<ViUInt32>(recurring_lead_us));
+        size_t end = extend(compiler, first);
+        bool fits = first == 0;  // set up before the protocol starts
+        if (!fits) {
+          // The host starts the chain the whole lead ahead of the batch
+          microseconds needed_us =
+              model.estimateBoundaryUs(
+                  BatchSetUp::full(compiler.getProgram()),
+                  partition.batch_starts[first] > 1 || !steps[0].isBreak()) -
+              model.startup_delay_us + microseconds(recurring_lead_us);
+          fits = needed_us.count() <=
+                 steps[partition.batch_starts[first] - 1]
+                     .time_between_pulses_us;
+        }
+        if (fits && end > next) {
+          chain = {first, end, static_cast<ViUInt32>(recurring_lead_us)};
+        }
+      }
+    }
+    if (!chain.isTriggerChain()) {
+      ChainCompiler compiler(steps, partition, chain.trigger_lead_us);
+      // A batch the device cannot express on its own (e.g. one LED twice) is
+      // started by the host alone
+      chain.end_batch = std::max(extend(compiler, first), first + 1);
+    }
+    chains.push_back(chain);
+    first = chain.end_batch;
+  }
+  return chains;
+}
+
+BatchProgram compileTriggerChain(const std::vector<ProtocolStep>& steps,
+                                 const BatchPartition& partition,
+                                 const ScheduledBatch& chain) {
+  ChainCompiler compiler(steps, partition, chain.trigger_lead_us);
+  for (size_t i_batch = chain.first_batch; i_batch < chain.end_batch;
+       i_batch++) {
+    if (!compiler.append(i_batch)) {
+      throw std::logic_error(
+          "compileTriggerChain(): batches cannot be chained.");
+    }
+  }
+  return compiler.takeProgram();
+}
@@ -3,6 +3,7 @@
 #include <windows.h>
 
 #include <chrono>
+#include <cstdint>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
@@ -12,6 +13,7 @@
 #include <vector>
 
 #include "Utils.hpp"
+#include "constants.hpp"
 
 std::string BrowseCSV() {
   TCHAR szFile[MAX_PATH] = {0};
@@ -85,10 +87,28 @@ std::string SelectFolderAndSuggestFile(const std::string& suggested_fname) {
   return result;
 }
 
+namespace {
+// A break longer than 32-bit us (about 71 min, e.g. an overnight break) is
+// several break steps with the id of its row
+void addCSVStep(std::vector<ProtocolStep>& protocolSteps, uint32_t i_step,
+                const std::vector<int>& row, bool is_us_mode) {
+  uint64_t to_us = is_us_mode ? 1 : 1000;
+  uint64_t break_us = (static_cast<uint64_t>(row[1]) + row[2]) * to_us;
+  if ((row[1] == 0 || row[4] == 0) &&
+      break_us > Constants::MAX_DEVICE_TIME_US) {
+    std::vector<ProtocolStep> breaks = makeBreakSteps(i_step, break_us);
+    protocolSteps.insert(protocolSteps.end(), breaks.begin(), breaks.end());
+    return;
+  }
+  protocolSteps.emplace_back(i_step, row[0], row[1], row[2], row[3], row[4],
+                             is_us_mode);
+}
+}  // namespace
+
 std::vector<ProtocolStep> readProtocolCSV(const std::string& filePath) {
   std::vector<ProtocolStep> protocolSteps;
   std::ifstream file(filePath);
-  unsigned short i_step = 1; // Start with 1 for incremental ID starting with 1 (i.e. first step will be step 1 and not step 0)
+  uint32_t i_step = 1; // Start with 1 for incremental ID starting with 1 (i.e. first step will be step 1 and not step 0)
   if (!file.is_open()) {
     std::cerr << "Error opening file: " << filePath << std::endl;
     return protocolSteps;
@@ -115,15 +135,12 @@ std::vector<ProtocolStep> readProtocolCSV(const std::string& filePath) {
 
     // Legacy mode: 5 columns. Then us mode is off (default).
     if (row.size() == 5) {
-      ProtocolStep step(i_step, row[0], row[1], row[2], row[3], row[4], false);
-      protocolSteps.push_back(step);
+      addCSVStep(protocolSteps, i_step, row, false);
       i_step++;
     }
     else if (row.size() == 6) {  // New mode (since 2.1.0) with 6 columns, last column is us mode flag
       bool is_ns_mode = (row[5] != 0);
-      ProtocolStep step(i_step, row[0], row[1], row[2], row[3], row[4],
-                        is_ns_mode);
-      protocolSteps.push_back(step);
+      addCSVStep(protocolSteps, i_step, row, is_ns_mode);
       i_step++;
     } else {
       std::cerr << "Invalid number of columns in CSV file. Expected 5 or 6, got "
@@ -0,0 +1,108 @@
+/*
+chrolispp-logdump: renders a binary run log (Logger with LogFormat::Binary)
+to stdout, either in the format of the text log
+("YYYY-MM-DD HH:MM:SS.mmm\t[TYPE]\tmessage") or as CSV with one column per
+record field.
+Usage: chrolispp-logdump <log file> [--csv]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "BinaryLog.hpp"
+#include "LogRecords.hpp"
+#include "TimestampFormatter.hpp"
+
+namespace {
+int64_t nsToTicks(int64_t ns) {
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+             std::chrono::nanoseconds(ns))
+      .count();
+}
+
+// Quote a CSV field, doubling embedded quotes
+std::string csvQuote(const std::string& field) {
+  std::string quoted = "\"";
+  for (char c : field) {
+    if (c == '"') {
+      quoted += '"';
+    }
+    quoted += c;
+  }
+  quoted += '"';
+  return quoted;
+}
+
+void writeCsvRow(std::ostream& out, const BinaryLog::Entry& entry,
+                 const char* timestamp) {
+  out << entry.steady_ns << ',' << timestamp << ','
+      << logTypeString(entry.type) << ',';
+  if (entry.kind == BinaryLog::RecordKind::Event) {
+    const LogEventData& event = entry.event;
+    out << logEventName(event.event) << ',' << event.batch_id << ',';
+    if (event.step_id != LogEventData::NO_STEP) {
+      out << event.step_id;
+    }
+    out << ',' << event.status << ',';
+    for (uint8_t i = 0; i < event.n_args; i++) {
+      out << (i == 0 ? "" : " ") << event.args[i];
+    }
+    out << ',' << csvQuote(renderLogEvent(event)) << '\n';
+  } else {
+    out << ",,,,," << csvQuote(entry.text) << '\n';
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3 || (argc == 3 && std::strcmp(argv[2], "--csv"))) {
+    std::cerr << "Usage: chrolispp-logdump <log file> [--csv]" << std::endl;
+    return 2;
+  }
+  bool csv = argc == 3;
+  std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Could not open log file: " << argv[1] << std::endl;
+    return 1;
+  }
+  try {
+    BinaryLog::Reader reader(file);
+    const BinaryLog::Header& header = reader.getHeader();
+    TimestampFormatter formatter(
+        std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(header.wall_clock_ns))),
+        std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(
+                nsToTicks(header.steady_clock_ns))));
+    std::ostream& out = std::cout;
+    if (csv) {
+      out << "steady_ns,timestamp,level,event,batch_id,step_id,status,args,"
+             "message\n";
+    }
+    BinaryLog::Entry entry;
+    char timestamp[TimestampFormatter::LENGTH + 1];
+    while (reader.next(entry)) {
+      timestamp[formatter.format(nsToTicks(entry.steady_ns), timestamp)] =
+          '\0';
+      if (csv) {
+        writeCsvRow(out, entry, timestamp);
+      } else {
+        out << timestamp << '\t' << logTypeString(entry.type) << '\t'
+            << (entry.kind == BinaryLog::RecordKind::Event
+                    ? renderLogEvent(entry.event)
+                    : entry.text)
+            << '\n';
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cout.flush();
+    std::cerr << argv[1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}